@@ -50,6 +50,8 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct kgflags_string_array {
     char **_items; // private
@@ -59,13 +61,97 @@ typedef struct kgflags_string_array {
 typedef struct kgflags_int_array {
     char **_items; // private
     int _count; // private
+    int _length; // private, number of values if some items are range expressions
+    bool _has_ranges; // private
+    const struct _kgflags_range_entry *_terms; // private, index of range terms, NULL if it isn't built
+    int _terms_count; // private
 } kgflags_int_array_t;
 
 typedef struct kgflags_double_array {
     char **_items; // private
     int _count; // private
+    int _length; // private, number of values if some items are range expressions
+    bool _has_ranges; // private
+    const struct _kgflags_range_entry *_terms; // private, index of range terms, NULL if it isn't built
+    int _terms_count; // private
 } kgflags_double_array_t;
 
+typedef struct kgflags_int64_array {
+    int64_t *_items; // private, points into storage passed when declaring the flag
+    int _count; // private
+} kgflags_int64_array_t;
+
+typedef struct kgflags_uint64_array {
+    uint64_t *_items; // private, points into storage passed when declaring the flag
+    int _count; // private
+} kgflags_uint64_array_t;
+
+typedef struct kgflags_size_array {
+    uint64_t *_items; // private, points into storage passed when declaring the flag
+    int _count; // private
+} kgflags_size_array_t;
+
+typedef struct kgflags_duration_array {
+    int64_t *_items; // private, points into storage passed when declaring the flag
+    int _count; // private
+} kgflags_duration_array_t;
+
+// Item of a string list, offset and length are relative to the list argument.
+typedef struct kgflags_span {
+    int offset;
+    int length;
+} kgflags_span_t;
+
+typedef struct kgflags_string_list {
+    const char *_arg; // private
+    kgflags_span_t *_spans; // private
+    int _count; // private
+} kgflags_string_list_t;
+
+typedef struct kgflags_file {
+    const char *_path; // private
+    const void *_data; // private
+    size_t _length; // private
+    const char *_mapped_path; // private, path _data was mapped from
+} kgflags_file_t;
+
+// Read-only view of file contents.
+typedef struct kgflags_bytes {
+    const void *data; // NULL if contents aren't available
+    size_t length;
+} kgflags_bytes_t;
+
+typedef struct kgflags_int_list {
+    int *_items; // private
+    int _count; // private
+} kgflags_int_list_t;
+
+typedef struct kgflags_double_list {
+    double *_items; // private
+    int _count; // private
+} kgflags_double_list_t;
+
+typedef struct kgflags_custom_list {
+    void *_items; // private
+    const char *_arg; // private
+    int _count; // private
+} kgflags_custom_list_t;
+
+// Values parsed by reference custom kinds, addresses are in network byte order.
+typedef struct kgflags_ipv4 {
+    uint8_t bytes[4];
+} kgflags_ipv4_t;
+
+typedef struct kgflags_ipv6 {
+    uint8_t bytes[16];
+} kgflags_ipv6_t;
+
+typedef struct kgflags_cidr {
+    uint8_t bytes[16]; // IPv4 addresses use the first 4 bytes, the rest is zero
+    int prefix_length;
+    bool ipv6;
+} kgflags_cidr_t;
+
 #ifndef KGFLAGS_MAX_FLAGS
 #define KGFLAGS_MAX_FLAGS 256
 #endif
@@ -78,6 +164,123 @@ typedef struct kgflags_double_array {
 #define KGFLAGS_MAX_ERRORS 512
 #endif
 
+#ifndef KGFLAGS_MAX_PARALLEL_CHUNKS
+#define KGFLAGS_MAX_PARALLEL_CHUNKS 64
+#endif
+
+#ifndef KGFLAGS_MAX_CONSTRAINTS
+#define KGFLAGS_MAX_CONSTRAINTS 64
+#endif
+
+// Total number of choices shared by all choice flags.
+#ifndef KGFLAGS_MAX_CHOICES
+#define KGFLAGS_MAX_CHOICES 1024
+#endif
+
+#ifndef KGFLAGS_MAX_CUSTOM_KINDS
+#define KGFLAGS_MAX_CUSTOM_KINDS 16
+#endif
+
+// Total number of range terms indexed for int and double arrays, see kgflags_int_array_get_item.
+#ifndef KGFLAGS_MAX_RANGE_TERMS
+#define KGFLAGS_MAX_RANGE_TERMS 1024
+#endif
+
+// Bytes each snapshot has for items of list and repeatable flags, see kgflags_reload.
+#ifndef KGFLAGS_SNAPSHOT_STORAGE_SIZE
+#define KGFLAGS_SNAPSHOT_STORAGE_SIZE 8192
+#endif
+
+typedef enum kgflags_error_kind {
+    KGFLAGS_ERROR_KIND_NONE,
+    KGFLAGS_ERROR_KIND_MISSING_VALUE,
+    KGFLAGS_ERROR_KIND_UNKNOWN_FLAG,
+    KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG,
+    KGFLAGS_ERROR_KIND_INVALID_INT,
+    KGFLAGS_ERROR_KIND_INVALID_DOUBLE,
+    KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS,
+    KGFLAGS_ERROR_KIND_TOO_MANY_NON_FLAG_ARGS,
+    KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT,
+    KGFLAGS_ERROR_KIND_DUPLICATE_FLAG,
+    KGFLAGS_ERROR_KIND_PREFIX_NO,
+    KGFLAGS_ERROR_KIND_INVALID_INT64,
+    KGFLAGS_ERROR_KIND_INVALID_UINT64,
+    KGFLAGS_ERROR_KIND_INVALID_SIZE,
+    KGFLAGS_ERROR_KIND_INVALID_DURATION,
+    KGFLAGS_ERROR_KIND_INVALID_CHOICE,
+    KGFLAGS_ERROR_KIND_TOO_MANY_CHOICES,
+    KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS,
+    KGFLAGS_ERROR_KIND_UNEXPECTED_VALUE,
+    KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS,
+    KGFLAGS_ERROR_KIND_MISSING_ONE_OF,
+    KGFLAGS_ERROR_KIND_MISSING_DEPENDENCY,
+    KGFLAGS_ERROR_KIND_TOO_MANY_CONSTRAINTS,
+    KGFLAGS_ERROR_KIND_UNKNOWN_SHORT_FLAG,
+    KGFLAGS_ERROR_KIND_INVALID_SHORT_NAME,
+    KGFLAGS_ERROR_KIND_SCHEMA_FROZEN,
+    KGFLAGS_ERROR_KIND_SCHEMA_NOT_FROZEN,
+    KGFLAGS_ERROR_KIND_PATH_NOT_FOUND,
+    KGFLAGS_ERROR_KIND_PATH_NOT_FILE,
+    KGFLAGS_ERROR_KIND_PATH_NOT_DIRECTORY,
+    KGFLAGS_ERROR_KIND_PATH_NOT_READABLE,
+    KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE,
+    KGFLAGS_ERROR_KIND_SNAPSHOT_STORAGE_FULL,
+} kgflags_error_kind_t;
+
+typedef struct kgflags_snapshot {
+    union {
+        const char *string_value;
+        bool bool_value;
+        int int_value;
+        double double_value;
+        int64_t int64_value;
+        uint64_t uint64_value;
+        kgflags_string_array_t string_array;
+        kgflags_int_array_t int_array;
+        kgflags_double_array_t double_array;
+        kgflags_int64_array_t int64_array;
+        kgflags_uint64_array_t uint64_array;
+        kgflags_size_array_t size_array;
+        kgflags_duration_array_t duration_array;
+        kgflags_string_list_t string_list;
+        kgflags_int_list_t int_list;
+        kgflags_double_list_t double_list;
+        kgflags_custom_list_t custom_list;
+    } _values[KGFLAGS_MAX_FLAGS]; // private
+    union {
+        double double_value;
+        int64_t int64_value;
+        void *pointer_value;
+    } _storage[(KGFLAGS_SNAPSHOT_STORAGE_SIZE + 7) / 8]; // private, items of list and repeatable flags
+    int _count; // private
+} kgflags_snapshot_t;
+
+typedef enum kgflags_dump_format {
+    KGFLAGS_DUMP_FORMAT_JSON_LINES, // {"name":"int","source":"argv","value":123}
+    KGFLAGS_DUMP_FORMAT_KEY_VALUE, // argv int=123
+} kgflags_dump_format_t;
+
+typedef enum kgflags_shell {
+    KGFLAGS_SHELL_BASH,
+    KGFLAGS_SHELL_ZSH,
+} kgflags_shell_t;
+
+typedef struct kgflags_error_info {
+    kgflags_error_kind_t kind;
+    const char *flag_name; // NULL if error isn't related to a single flag
+    const char *value; // offending value, NULL if there is none
+    int arg_index; // index in argv, -1 if error isn't related to an argument (e.g. declaration errors)
+    int item_index; // index of array item, -1 if error isn't related to an array item
+    int limit; // for KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS maximum number of items, -1 otherwise
+    int char_index; // for KGFLAGS_ERROR_KIND_UNKNOWN_SHORT_FLAG position of the alias in value, -1 otherwise
+} kgflags_error_info_t;
+
+// Result of validating one argument vector, small enough to keep one per vector in a large batch.
+typedef struct kgflags_validation {
+    int errors_count; // 0 if arguments are valid
+    kgflags_error_info_t first_error; // kind is KGFLAGS_ERROR_KIND_NONE if there are no errors
+} kgflags_validation_t;
+
 // Functions used to declare flags. If kgflags_parse succeeds values are assigned to out_res/out_arr. Description is optional.
 void kgflags_string(const char *name, const char *default_value, const char *description, bool required, const char** out_res);
 void kgflags_bool(const char *name, bool default_value, const char *description, bool required, bool *out_res);
@@ -89,16 +292,335 @@ void kgflags_string_array(const char *name, const char *description, bool requir
 void kgflags_int_array(const char *name, const char *description, bool required, kgflags_int_array_t *out_arr);
 void kgflags_double_array(const char *name, const char *description, bool required, kgflags_double_array_t *out_arr);
 
+// Items of int and double arrays can also be range expressions, which are expanded lazily by getters:
+// "a..b" (a, a + 1, ... b excluded), "a:b" or "a:b:step" (a, a + step, ... b excluded) and, for ints only,
+// "a-b" (a, a + 1, ... b). Several terms can be joined with commas, e.g. "--ids 1-10,20-30 64".
+
+// 64-bit integers are parsed without going through strtod, values out of range are errors.
+void kgflags_int64(const char *name, int64_t default_value, const char *description, bool required, int64_t *out_res);
+void kgflags_uint64(const char *name, uint64_t default_value, const char *description, bool required, uint64_t *out_res);
+
+// Sizes are parsed to bytes, e.g. "512", "64K", "4MiB", "1.5G". K/KiB, M/MiB, G/GiB, T/TiB are powers of 1024,
+// KB, MB, GB, TB are powers of 1000. Fractions (up to 9 digits) are truncated to whole bytes.
+void kgflags_size(const char *name, uint64_t default_value, const char *description, bool required, uint64_t *out_res);
+
+// Durations are parsed to nanoseconds, e.g. "250us", "1.5s", "2h". Units are ns, us, ms, s, m and h,
+// unit can be omitted only for 0. Fractions (up to 9 digits) are truncated to whole nanoseconds.
+void kgflags_duration(const char *name, int64_t default_value, const char *description, bool required, int64_t *out_res);
+
+// Choice flags accept one of given strings and resolve it to its index, e.g. "--compression lz4" with
+// choices {"zstd", "lz4", "none"} -> 1. Choices are hashed once when declared, they must outlive parsing.
+// default_index can be -1, out_index is -1 while no value is set.
+void kgflags_choice(const char *name, const char *const *choices, int choices_count, int default_index,
+                    const char *description, bool required, int *out_index);
+
+// Lists are parsed from a single argument split on delimiter, e.g. "--ids 1,2,3" or "--ids=1,2,3".
+// Items are written to caller's storage (at most capacity of them) only if all items of the argument are
+// valid, string lists store spans into the argument instead of copies. Numeric items are at most 63
+// characters long. Storage is shared by all snapshots created with kgflags_reload.
+void kgflags_string_list(const char *name, char delimiter, kgflags_span_t *storage, int capacity,
+                         const char *description, bool required, kgflags_string_list_t *out_list);
+void kgflags_int_list(const char *name, char delimiter, int *storage, int capacity,
+                      const char *description, bool required, kgflags_int_list_t *out_list);
+void kgflags_double_list(const char *name, char delimiter, double *storage, int capacity,
+                         const char *description, bool required, kgflags_double_list_t *out_list);
+
+// Repeatable flags take one value per occurrence, e.g. "--include a --include=b", and collect values as arrays
+// read with kgflags_*_array_get_* functions. Pointers to values (not copies) are appended to caller's storage
+// (at most capacity of them), which is shared by all snapshots created with kgflags_reload.
+void kgflags_string_repeatable(const char *name, char **storage, int capacity,
+                               const char *description, bool required, kgflags_string_array_t *out_arr);
+void kgflags_int_repeatable(const char *name, char **storage, int capacity,
+                            const char *description, bool required, kgflags_int_array_t *out_arr);
+void kgflags_double_repeatable(const char *name, char **storage, int capacity,
+                               const char *description, bool required, kgflags_double_array_t *out_arr);
+
+// Path flags are string flags whose values are checked during parsing, checks is a combination of
+// kgflags_path_check_t (0 for no checks, every other check implies KGFLAGS_PATH_EXISTS). Items of path arrays
+// are checked through the parallel-for hook just like arrays of numbers, errors (KGFLAGS_ERROR_KIND_PATH_*)
+// have item_index set. Defaults aren't checked.
+typedef enum kgflags_path_check {
+    KGFLAGS_PATH_EXISTS = 1 << 0,
+    KGFLAGS_PATH_FILE = 1 << 1, // regular file
+    KGFLAGS_PATH_DIRECTORY = 1 << 2,
+    KGFLAGS_PATH_READABLE = 1 << 3,
+} kgflags_path_check_t;
+
+void kgflags_path(const char *name, const char *default_value, int checks, const char *description, bool required, const char **out_res);
+// Checks aren't batched, every item costs one stat (plus access for KGFLAGS_PATH_READABLE) made from whichever
+// parallel-for chunk it falls into, so large arrays of paths on a slow filesystem take one syscall per item.
+void kgflags_path_array(const char *name, int checks, const char *description, bool required, kgflags_string_array_t *out_arr);
+
+// File flags take a path of a readable regular file (checked like kgflags_path) and give access to its contents,
+// which are mapped read-only with mmap on first access instead of being copied. Mappings are released with
+// kgflags_file_release or kgflags_release_files.
+void kgflags_file(const char *name, const char *default_path, const char *description, bool required, kgflags_file_t *out_file);
+
+// Custom kinds parse values of user types straight into caller's storage. Parse function gets a value that
+// isn't NUL-terminated (list items point into the argument) and writes elem_size bytes to out_value, which is
+// NULL when arguments are only validated. It has to return false without writing anything if value is invalid,
+// the error (KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE) is reported just like for built-in kinds. It may be called
+// concurrently by kgflags_validate_batch workers. type_name is shown in usage and errors, e.g. "IPv4 address".
+typedef bool (*kgflags_custom_parse_t)(const char *value, size_t length, void *out_value, void *ctx);
+
+// Returns id of the kind used to declare flags, -1 if KGFLAGS_MAX_CUSTOM_KINDS kinds are already registered.
+int kgflags_register_custom_kind(const char *type_name, size_t elem_size, kgflags_custom_parse_t parse, void *ctx);
+
+// out_value keeps its contents until the flag is passed, so it can be initialized with the default. Lists work
+// like kgflags_int_list, values come out as a contiguous array of capacity elements at most.
+void kgflags_custom(const char *name, int kind, const char *description, bool required, void *out_value);
+void kgflags_custom_list(const char *name, int kind, char delimiter, void *storage, int capacity,
+                         const char *description, bool required, kgflags_custom_list_t *out_list);
+
+// Reference parse functions, register them with element sizes of kgflags_ipv4_t, kgflags_ipv6_t and kgflags_cidr_t.
+// IPv6 addresses can end with an IPv4 address (e.g. "::ffff:10.0.0.1"), zone ids aren't supported. Leading zeros
+// in IPv4 addresses are rejected as they are ambiguous. Host bits of CIDR addresses don't have to be zero.
+bool kgflags_parse_ipv4(const char *value, size_t length, void *out_value, void *ctx);
+bool kgflags_parse_ipv6(const char *value, size_t length, void *out_value, void *ctx);
+bool kgflags_parse_cidr(const char *value, size_t length, void *out_value, void *ctx);
+
+// Maps files of all file flags passed in argv that are at most max_size bytes long (possibly in parallel through
+// the parallel-for hook), so later kgflags_file_get_contents calls don't touch the file system.
+// Returns number of files that weren't mapped (larger than max_size or unreadable).
+int kgflags_preload_files(size_t max_size);
+
+// Unmaps files of all file flags.
+void kgflags_release_files(void);
+
+// Items are converted once while parsing into storage, which must be valid as long as the array is used.
+// More than capacity items is an error (KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS).
+void kgflags_int64_array(const char *name, int64_t *storage, int capacity,
+                         const char *description, bool required, kgflags_int64_array_t *out_arr);
+void kgflags_uint64_array(const char *name, uint64_t *storage, int capacity,
+                          const char *description, bool required, kgflags_uint64_array_t *out_arr);
+void kgflags_size_array(const char *name, uint64_t *storage, int capacity,
+                        const char *description, bool required, kgflags_size_array_t *out_arr);
+void kgflags_duration_array(const char *name, int64_t *storage, int capacity,
+                            const char *description, bool required, kgflags_duration_array_t *out_arr);
+
 // Optionally sets prefix used for flags (such as "--", "-" or "/").
 // Default prefix is "--". Should be called *before* calling kgflags_parse.
 void kgflags_set_prefix(const char *prefix);
 
+// Constraints between flags, checked after parsing. Flags have to be declared before constraints using them,
+// unknown names are reported as KGFLAGS_ERROR_KIND_UNKNOWN_FLAG.
+// - exactly one of the flags has to be passed (KGFLAGS_ERROR_KIND_MISSING_ONE_OF or KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS),
+//   flags in such group shouldn't be required.
+// - at most one of the flags can be passed (KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS, flag_name and value are two of them).
+// - if flag is passed then required_flag has to be passed too (KGFLAGS_ERROR_KIND_MISSING_DEPENDENCY, value is
+//   required_flag's name).
+// Defaults don't count as passing a flag.
+void kgflags_exactly_one_of(const char *const *names, int names_count);
+void kgflags_at_most_one_of(const char *const *names, int names_count);
+void kgflags_requires(const char *name, const char *required_name);
+
+// Optionally sets single character alias of a declared flag. Aliases use the first character of prefix,
+// e.g. "-v" for "--verbose", and can be clustered ("-xvf"). In a cluster, rest of the argument after a
+// non-boolean flag is its value ("-ofile"), otherwise value is the next argument. Arguments not starting with
+// a registered alias, such as "-1" or "-foo", stay values or non-flag arguments. Aliases work only with
+// prefixes at least 2 characters long (e.g. the default "--").
+// For KGFLAGS_ERROR_KIND_UNKNOWN_SHORT_FLAG value is the whole argument and char_index is position of the alias.
+void kgflags_set_short_name(const char *name, char short_name);
+
+// Optionally makes kgflags_parse reorder argv like GNU getopt: flags (with their values) keep their order
+// at the front and non-flag arguments are moved, also in order, to a contiguous tail of argv. Non-flag
+// arguments are then read straight from argv, so KGFLAGS_MAX_NON_FLAG_ARGS doesn't apply.
+// Argument indices in errors refer to positions before reordering. Disabled by default.
+void kgflags_set_permute_argv(bool permute);
+
+// Returns how many arguments following unknown flag_arg (e.g. "--level" or "-x") belong to it.
+typedef int (*kgflags_arity_t)(const char *flag_arg, void *ctx);
+
+// Optionally makes kgflags_parse (and kgflags_validate) pass unknown flags through instead of reporting
+// KGFLAGS_ERROR_KIND_UNKNOWN_FLAG. Unknown flags are kept in order with non-flag arguments, so enabling it also
+// enables argv permutation. Following non-flag arguments end up there anyway, arity is only needed for values
+// that look like flags, it can be NULL. A short alias cluster passes through if its first alias is unknown,
+// without pass-through such arguments (e.g. "-foo") are non-flag arguments.
+void kgflags_set_pass_through(bool pass_through, kgflags_arity_t arity, void *arity_ctx);
+
+// With argv permutation, returns the tail of argv holding passed through and non-flag arguments as a vector
+// for execv: [0] is set to arg0 and it's NULL-terminated if argv[argc] is NULL (as for argv of main). Slot used
+// for arg0 held argv[0] or the last argument consumed by kgflags (array items are moved out of it first, so
+// array results stay valid). Returns NULL if argv wasn't permuted.
+char** kgflags_get_pass_through_argv(const char *arg0, int *out_argc);
+
 // Parses arguments and assign values to declared flags.
+// Values can also be passed inline as "--name=value", except for boolean and array flags.
 bool kgflags_parse(int argc, char **argv);
 
+// Clears values, errors and non-flag arguments left by the last kgflags_parse so it can be called again
+// (e.g. for every command read by a REPL). Declared flags are kept. Cost depends only on what the last
+// parse touched, not on the number of declared flags.
+void kgflags_reset_values(void);
+
+// Live reload: parses argv into out_snapshot instead of variables passed when declaring flags, which are not
+// modified. Returns false on errors (see kgflags_print_errors), snapshot should be discarded then.
+// Strings and arrays in the snapshot point into argv, so it has to outlive the snapshot. Items of list and
+// repeatable flags are parsed into the snapshot itself instead of storage passed when declaring them, their
+// capacities (rounded up to 8 bytes each) have to fit into KGFLAGS_SNAPSHOT_STORAGE_SIZE, otherwise reload fails
+// with KGFLAGS_ERROR_KIND_SNAPSHOT_STORAGE_FULL. Custom kinds can't need alignment stricter than 8 bytes.
+// Non-flag arguments, dump, serialize and pass-through argv keep reporting the last kgflags_parse, errors of
+// a failed reload replace the error list.
+bool kgflags_reload(int argc, char **argv, kgflags_snapshot_t *out_snapshot);
+
+// Writes ids of flags whose values differ between snapshots to out_ids (at most cap of them).
+// Returns number of changed flags.
+int kgflags_snapshot_diff(const kgflags_snapshot_t *a, const kgflags_snapshot_t *b, int *out_ids, int cap);
+
+// Publishes snapshot to readers by atomically storing it in *slot (release), readers load it with
+// kgflags_snapshot_acquire without taking any locks. Snapshot that got replaced can be reused for
+// the next kgflags_reload only after readers stopped using it (e.g. keep 3 snapshots and let readers
+// hold a snapshot only while handling a single request).
+void kgflags_snapshot_publish(kgflags_snapshot_t **slot, kgflags_snapshot_t *snapshot);
+const kgflags_snapshot_t* kgflags_snapshot_acquire(kgflags_snapshot_t *const *slot);
+
+// Flag ids are indices in declaration order, lookup them once and use them to read snapshots.
+// Returns -1 if flag isn't declared.
+int kgflags_get_flag_id(const char *name);
+const char* kgflags_snapshot_get_string(const kgflags_snapshot_t *snapshot, int id);
+bool kgflags_snapshot_get_bool(const kgflags_snapshot_t *snapshot, int id);
+int kgflags_snapshot_get_int(const kgflags_snapshot_t *snapshot, int id); // also for choice flags
+double kgflags_snapshot_get_double(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_string_array_t* kgflags_snapshot_get_string_array(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_int_array_t* kgflags_snapshot_get_int_array(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_double_array_t* kgflags_snapshot_get_double_array(const kgflags_snapshot_t *snapshot, int id);
+int64_t kgflags_snapshot_get_int64(const kgflags_snapshot_t *snapshot, int id); // also for duration flags
+uint64_t kgflags_snapshot_get_uint64(const kgflags_snapshot_t *snapshot, int id); // also for size flags
+const kgflags_int64_array_t* kgflags_snapshot_get_int64_array(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_uint64_array_t* kgflags_snapshot_get_uint64_array(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_size_array_t* kgflags_snapshot_get_size_array(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_duration_array_t* kgflags_snapshot_get_duration_array(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_string_list_t* kgflags_snapshot_get_string_list(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_int_list_t* kgflags_snapshot_get_int_list(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_double_list_t* kgflags_snapshot_get_double_list(const kgflags_snapshot_t *snapshot, int id);
+const kgflags_custom_list_t* kgflags_snapshot_get_custom_list(const kgflags_snapshot_t *snapshot, int id);
+
+// Hook used to run work in parallel. It has to call job(job_ctx, i) for every i in [0, count), in any order
+// and possibly concurrently, and return only after all calls finished.
+typedef void (*kgflags_parallel_for_t)(int count, void (*job)(void *job_ctx, int index), void *job_ctx, void *user_ctx);
+
+// Optionally sets a parallel-for hook used to validate numeric arrays with at least min_items items.
+// Arrays are split into at most KGFLAGS_MAX_PARALLEL_CHUNKS chunks, errors are still reported in item order.
+// Pass NULL to disable (default). Should be called *before* calling kgflags_parse.
+void kgflags_set_parallel_for(kgflags_parallel_for_t parallel_for, void *user_ctx, int min_items);
+
+// Freezes declared flags, constraints and short names, after that declaring anything else is reported as
+// KGFLAGS_ERROR_KIND_SCHEMA_FROZEN. Prefix and permute_argv shouldn't be changed either. Frozen schema is only read,
+// so it can be shared by threads calling kgflags_validate. Returns false if there were declaration errors.
+bool kgflags_freeze(void);
+
+// Checks argv against the frozen schema the same way kgflags_parse does, but doesn't assign values, modify argv
+// or record errors, so it can be called concurrently. Errors are counted in out_result, which also keeps the first one
+// (strings in it point into the schema or argv). With stop_at_first_error validation ends at the first error.
+// Without frozen schema it fails with KGFLAGS_ERROR_KIND_SCHEMA_NOT_FROZEN. Returns true if argv is valid.
+bool kgflags_validate(int argc, char **argv, bool stop_at_first_error, kgflags_validation_t *out_result);
+
+// Validates count argument vectors (argvs[i] has argcs[i] arguments) into out_results[i]. If the parallel-for
+// hook is set and count >= its min_items, vectors are split into at most KGFLAGS_MAX_PARALLEL_CHUNKS chunks
+// validated through the hook. Returns number of invalid vectors.
+int kgflags_validate_batch(int count, const int *argcs, char **const *argvs, bool stop_at_first_error, kgflags_validation_t *out_results);
+
 // Prints errors that might've occured when declaring flags or during flag parsing.
 void kgflags_print_errors(void);
 
+// Same errors as printed by kgflags_print_errors, for callers that want to handle them without stdio.
+// kgflags_get_error returns false if at is out of range.
+int kgflags_get_error_count(void);
+bool kgflags_get_error(int at, kgflags_error_info_t *out_info);
+
+// Writes resolved value of every declared flag, one flag per line, to buf (always NUL terminated if cap > 0).
+// Each line says whether value came from argv ("argv"), from default value ("default") or if flag is unassigned ("unset").
+// Returns length of the whole dump (excluding NUL), if it's >= cap the output was truncated (just like snprintf).
+// Doesn't allocate memory, so it's fine to call it with a stack buffer and write it out with a single call.
+int kgflags_dump(char *buf, size_t cap, kgflags_dump_format_t fmt);
+
+// Writes argument list reproducing values of the last kgflags_parse: argv[0], non-flag arguments and then flags
+// passed in argv, in declaration order. Flags equal to their defaults are left out (unless they're required),
+// scalar values are passed inline ("--name=value") and short aliases are replaced with names. Arguments are
+// written NUL-terminated to buf and pointers to them to argv_out, followed by NULL.
+// On input *argc_out is the number of pointers argv_out can hold, on output the number of arguments.
+// Returns number of bytes used in buf, if it's > cap or *argc_out isn't less than the capacity passed in, output
+// was truncated and only arguments that fit whole are in argv_out.
+int kgflags_serialize_argv(char *buf, size_t cap, char **argv_out, int *argc_out);
+
+// Hash of declared flags (names, kinds, requiredness, list delimiters and choices), changes whenever stored
+// values would be laid out or interpreted differently. Walks all flags, after kgflags_freeze it's computed once.
+uint64_t kgflags_get_schema_hash(void);
+
+// Writes resolved values of all flags and non-flag arguments of the last kgflags_parse as a position-independent
+// image (offsets instead of pointers, at most 4 GiB). It can be written straight into shared memory, e.g.
+// memfd_create + ftruncate + mmap in the parent, and attached by forked workers.
+// Returns size of the image, if it's > cap the image was truncated (just like kgflags_dump). Returns 0 if it'd be
+// larger than 4 GiB.
+size_t kgflags_image_write(void *buf, size_t cap);
+
+// Binds variables passed when declaring flags to an image written by kgflags_image_write, instead of calling
+// kgflags_parse. Strings, list items and non-flag arguments point into the image (it has to be 8-byte aligned and
+// outlive the flags), pointers to array items are stored in items_storage. Fails without changing anything if image
+// was written with different schema (see kgflags_get_schema_hash), is truncated or malformed (e.g. a list longer than
+// its storage) or items_storage is too small.
+bool kgflags_image_attach(const void *image, size_t size, char **items_storage, int items_capacity);
+
+// Parse cache: an image of the last kgflags_parse stored with a key of its inputs and a checksum, so the next
+// run with the same arguments can attach it instead of parsing. Key covers schema hash, prefix, short names,
+// argv permutation and pass-through mode and all arguments after argv[0] (pass-through arity callback
+// has to behave the same way).
+uint64_t kgflags_get_cache_key(int argc, char **argv);
+
+// Writes cache of the last kgflags_parse (which got argc and argv) to buf, returns its size like kgflags_image_write.
+// The result can be stored anywhere, e.g. in a file mapped with mmap on the next start.
+size_t kgflags_cache_write(void *buf, size_t cap, int argc, char **argv);
+
+// Like kgflags_image_attach, but fails if cache was written for different arguments, schema or library version,
+// or if its checksum doesn't match (e.g. partially written or corrupted file). Cache has to be 8-byte aligned.
+// Key doesn't cover the file system, so values of path and file flags are checked again (see kgflags_path)
+// and attach fails if any of them wouldn't pass now.
+// Attach hashes all arguments and the whole cache (and the schema, unless it's frozen) and validates every
+// record, so it costs about as much as parsing plain flags. It pays off when parsing does more per argument:
+// long numeric arrays and lists, ranges, custom kinds or validators. Path checks are repeated by attach.
+bool kgflags_cache_attach(const void *cache, size_t size, int argc, char **argv, char **items_storage, int items_capacity);
+
+// Stdio helpers: save writes cache through buf to a temporary file renamed to path, so readers never see
+// a partial file (on Windows it's replaced with MoveFileEx, save fails if path can't be replaced atomically).
+// load reads path into buf (which has to outlive the flags) and attaches it.
+bool kgflags_cache_save(const char *path, int argc, char **argv, void *buf, size_t cap);
+bool kgflags_cache_load(const char *path, int argc, char **argv, void *buf, size_t cap, char **items_storage, int items_capacity);
+
+#ifdef KGFLAGS_TRACE
+// Parse trace, compiled in only if KGFLAGS_TRACE is defined. Ring keeps the last KGFLAGS_TRACE_CAPACITY events
+// of all parses, each parse starts with KGFLAGS_TRACE_PARSE_BEGIN. Argument indices are positions in argv at
+// the time arguments were consumed (before permutation).
+#ifndef KGFLAGS_TRACE_CAPACITY
+#define KGFLAGS_TRACE_CAPACITY 1024
+#endif
+
+typedef enum kgflags_trace_kind {
+    KGFLAGS_TRACE_PARSE_BEGIN, // span_length is argc
+    KGFLAGS_TRACE_FLAG, // values taken from argv[span_start, span_start + span_length), detail is 1 if value was inline
+    KGFLAGS_TRACE_NON_FLAG,
+    KGFLAGS_TRACE_PASS_THROUGH, // unknown flag left in argv together with next span_length arguments
+    KGFLAGS_TRACE_ERROR, // detail is kgflags_error_kind_t, span_start is array item index or -1
+    KGFLAGS_TRACE_PARSE_END, // span_length is number of errors
+} kgflags_trace_kind_t;
+
+typedef struct kgflags_trace_event {
+    int32_t arg_index; // -1 if event isn't related to an argument
+    int32_t span_start;
+    int32_t span_length;
+    int32_t flag_id; // index of flag in declaration order, -1 if there is none
+    uint8_t kind; // kgflags_trace_kind_t
+    uint8_t detail;
+} kgflags_trace_event_t;
+
+int kgflags_trace_get_count(void);
+void kgflags_trace_get_event(int at, kgflags_trace_event_t *out_event); // 0 is the oldest event still in the ring
+void kgflags_trace_clear(void);
+
+// Writes one line per event (preceded by number of dropped events if ring overflowed), flag names are
+// resolved with current declarations. Returns length just like kgflags_dump.
+int kgflags_trace_decode(char *buf, size_t cap);
+#endif
+
 // Prints usage based on flags declared with kgflags_string, kgflags_int etc.
 // Can be customized with custom description by calling kgflags_set_custom_description.
 // By default it starts with "Usage of ./app:". If custom_description is set with
@@ -109,23 +631,160 @@ void kgflags_print_usage(void);
 // e.g. kgflags_set_custom_description("Usage: ./app [--FLAGS] [file ...]");
 void kgflags_set_custom_description(const char *description);
 
+// Shell completion. If called as "./app --__complete <partial>" (with current prefix) writes all flags starting
+// with partial (including "no-" forms of boolean flags) to stdout, one per line, and returns true.
+// Otherwise returns false and does nothing. Should be called after declaring flags and *before* kgflags_parse:
+// if (kgflags_complete(argc, argv)) { return 0; }
+bool kgflags_complete(int argc, char **argv);
+
+// Same candidates as kgflags_complete, written to buf. Returns length just like kgflags_dump.
+int kgflags_get_completions(const char *partial, char *buf, size_t cap);
+
+// Prints bash or zsh completion script for app_name to stdout. Script calls "app_name --__complete <word>"
+// for words starting with the first character of prefix and falls back to file names otherwise.
+void kgflags_print_completion_script(kgflags_shell_t shell, const char *app_name);
+
 int kgflags_string_array_get_count(const kgflags_string_array_t *arr);
 const char* kgflags_string_array_get_item(const kgflags_string_array_t *arr, int at);
 
-// Result is parsed from string every time you get an item.
+// Result is parsed from string every time you get an item. Count and indices are in values. Range terms
+// are indexed after parse, so with range expressions get_item binary searches the term containing value at
+// (arrays past KGFLAGS_MAX_RANGE_TERMS walk items from the start instead). To read many values use
+// kgflags_int_array_fill, which writes up to cap values starting at value offset and returns how many
+// were written.
 int kgflags_int_array_get_count(const kgflags_int_array_t *arr);
 int kgflags_int_array_get_item(const kgflags_int_array_t *arr, int at);
+int kgflags_int_array_fill(const kgflags_int_array_t *arr, int offset, int *out, int cap);
 
-// Result is parsed from string every time you get an item.
+// Same as int arrays, see above.
 int kgflags_double_array_get_count(const kgflags_double_array_t *arr);
 double kgflags_double_array_get_item(const kgflags_double_array_t *arr, int at);
+int kgflags_double_array_fill(const kgflags_double_array_t *arr, int offset, double *out, int cap);
+
+// Items are stored contiguously, get_items returns NULL if array is empty.
+int kgflags_int64_array_get_count(const kgflags_int64_array_t *arr);
+int64_t kgflags_int64_array_get_item(const kgflags_int64_array_t *arr, int at);
+const int64_t* kgflags_int64_array_get_items(const kgflags_int64_array_t *arr);
+
+int kgflags_uint64_array_get_count(const kgflags_uint64_array_t *arr);
+uint64_t kgflags_uint64_array_get_item(const kgflags_uint64_array_t *arr, int at);
+const uint64_t* kgflags_uint64_array_get_items(const kgflags_uint64_array_t *arr);
+
+// Items are in bytes.
+int kgflags_size_array_get_count(const kgflags_size_array_t *arr);
+uint64_t kgflags_size_array_get_item(const kgflags_size_array_t *arr, int at);
+const uint64_t* kgflags_size_array_get_items(const kgflags_size_array_t *arr);
+
+// Items are in nanoseconds.
+int kgflags_duration_array_get_count(const kgflags_duration_array_t *arr);
+int64_t kgflags_duration_array_get_item(const kgflags_duration_array_t *arr, int at);
+const int64_t* kgflags_duration_array_get_items(const kgflags_duration_array_t *arr);
+
+// Items are returned as spans, use kgflags_string_list_get_arg to get the string they point into.
+int kgflags_string_list_get_count(const kgflags_string_list_t *list);
+const char* kgflags_string_list_get_arg(const kgflags_string_list_t *list);
+kgflags_span_t kgflags_string_list_get_span(const kgflags_string_list_t *list, int at);
+
+// Items are converted when parsing, these return pointers to caller's storage.
+int kgflags_int_list_get_count(const kgflags_int_list_t *list);
+const int* kgflags_int_list_get_items(const kgflags_int_list_t *list);
+int kgflags_double_list_get_count(const kgflags_double_list_t *list);
+const double* kgflags_double_list_get_items(const kgflags_double_list_t *list);
+int kgflags_custom_list_get_count(const kgflags_custom_list_t *list);
+const void* kgflags_custom_list_get_items(const kgflags_custom_list_t *list);
+
+// Contents are mapped on first call (or remapped if path changed since), which isn't thread-safe, so map files
+// before sharing them (e.g. with kgflags_preload_files). Mapping is supported only on POSIX systems, elsewhere
+// and if file can't be mapped data is NULL. Contents can't be used after kgflags_file_release.
+const char* kgflags_file_get_path(const kgflags_file_t *file); // NULL if not set
+kgflags_bytes_t kgflags_file_get_contents(kgflags_file_t *file);
+void kgflags_file_release(kgflags_file_t *file);
 
 // Returns arguments that don't belong to any flags.
 // e.g. if we defined a flag named "file" and call "./app arg0 --file test arg1"
 // then non-flag arguments' count is 2 and non-flag[0] is arg0 and non-flag[1] is arg1.
+// With kgflags_set_permute_argv(true) they're the last kgflags_get_non_flag_args_count() elements of argv.
+// In pass-through mode they include passed through flags and their values.
 int kgflags_get_non_flag_args_count(void);
 const char* kgflags_get_non_flag_arg(int at);
 
+// Link-time registration (GCC/Clang on ELF platforms). KGFLAGS_DEFINE_* macros define a global variable
+// and put a const spec of the flag into "kgflags_specs" section, specs from all linked modules are
+// registered in one pass on first call to kgflags_parse (or functions looking up flags), so nothing
+// runs at startup. Use them at file scope, e.g. KGFLAGS_DEFINE_INT(port, "port", 8080, "Port.", false);
+// and declare variable as extern (e.g. extern int port;) in other modules.
+#if defined(__GNUC__) && defined(__ELF__)
+#define KGFLAGS_HAS_SECTION_REGISTRATION
+
+typedef enum kgflags_spec_kind {
+    KGFLAGS_SPEC_KIND_STRING,
+    KGFLAGS_SPEC_KIND_BOOL,
+    KGFLAGS_SPEC_KIND_INT,
+    KGFLAGS_SPEC_KIND_DOUBLE,
+    KGFLAGS_SPEC_KIND_INT64,
+    KGFLAGS_SPEC_KIND_UINT64,
+    KGFLAGS_SPEC_KIND_SIZE,
+    KGFLAGS_SPEC_KIND_DURATION,
+    KGFLAGS_SPEC_KIND_STRING_ARRAY,
+    KGFLAGS_SPEC_KIND_INT_ARRAY,
+    KGFLAGS_SPEC_KIND_DOUBLE_ARRAY,
+} kgflags_spec_kind_t;
+
+// Defaults are separate fields (not a union) so specs can be initialized the same way in C and C++.
+typedef struct kgflags_spec {
+    kgflags_spec_kind_t kind;
+    const char *name;
+    const char *description;
+    bool required;
+    void *out;
+    const char *default_string;
+    bool default_bool;
+    int default_int;
+    double default_double;
+    int64_t default_int64;
+    uint64_t default_uint64;
+} kgflags_spec_t;
+
+#define _KGFLAGS_DEFINE_SPEC(var, kind, name, description, required, def_string, def_bool, def_int, def_double, def_int64, def_uint64) \
+    static const kgflags_spec_t _kgflags_spec_##var \
+        __attribute__((used, section("kgflags_specs"), aligned(__alignof__(kgflags_spec_t)))) = \
+        { kind, name, description, required, (void*)&var, def_string, def_bool, def_int, def_double, def_int64, def_uint64 }
+
+#define KGFLAGS_DEFINE_STRING(var, name, default_value, description, required) \
+    const char *var = NULL; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_STRING, name, description, required, default_value, false, 0, 0.0, 0, 0)
+#define KGFLAGS_DEFINE_BOOL(var, name, default_value, description, required) \
+    bool var = false; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_BOOL, name, description, required, NULL, default_value, 0, 0.0, 0, 0)
+#define KGFLAGS_DEFINE_INT(var, name, default_value, description, required) \
+    int var = 0; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_INT, name, description, required, NULL, false, default_value, 0.0, 0, 0)
+#define KGFLAGS_DEFINE_DOUBLE(var, name, default_value, description, required) \
+    double var = 0.0; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_DOUBLE, name, description, required, NULL, false, 0, default_value, 0, 0)
+#define KGFLAGS_DEFINE_INT64(var, name, default_value, description, required) \
+    int64_t var = 0; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_INT64, name, description, required, NULL, false, 0, 0.0, default_value, 0)
+#define KGFLAGS_DEFINE_UINT64(var, name, default_value, description, required) \
+    uint64_t var = 0; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_UINT64, name, description, required, NULL, false, 0, 0.0, 0, default_value)
+#define KGFLAGS_DEFINE_SIZE(var, name, default_value, description, required) \
+    uint64_t var = 0; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_SIZE, name, description, required, NULL, false, 0, 0.0, 0, default_value)
+#define KGFLAGS_DEFINE_DURATION(var, name, default_value, description, required) \
+    int64_t var = 0; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_DURATION, name, description, required, NULL, false, 0, 0.0, default_value, 0)
+#define KGFLAGS_DEFINE_STRING_ARRAY(var, name, description, required) \
+    kgflags_string_array_t var = { NULL, 0 }; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_STRING_ARRAY, name, description, required, NULL, false, 0, 0.0, 0, 0)
+#define KGFLAGS_DEFINE_INT_ARRAY(var, name, description, required) \
+    kgflags_int_array_t var = { NULL, 0, 0, false, NULL, 0 }; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_INT_ARRAY, name, description, required, NULL, false, 0, 0.0, 0, 0)
+#define KGFLAGS_DEFINE_DOUBLE_ARRAY(var, name, description, required) \
+    kgflags_double_array_t var = { NULL, 0, 0, false, NULL, 0 }; \
+    _KGFLAGS_DEFINE_SPEC(var, KGFLAGS_SPEC_KIND_DOUBLE_ARRAY, name, description, required, NULL, false, 0, 0.0, 0, 0)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -142,6 +801,17 @@ const char* kgflags_get_non_flag_arg(int at);
 #include <errno.h>
 #include <math.h>
 
+#if defined(_WIN32)
+#include <sys/stat.h>
+#include <io.h>
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 typedef enum _kgflags_flag_kind {
     KGFLAGS_FLAG_KIND_NONE,
     KGFLAGS_FLAG_KIND_STRING,
@@ -151,82 +821,508 @@ typedef enum _kgflags_flag_kind {
     KGFLAGS_FLAG_KIND_STRING_ARRAY,
     KGFLAGS_FLAG_KIND_INT_ARRAY,
     KGFLAGS_FLAG_KIND_DOUBLE_ARRAY,
+    KGFLAGS_FLAG_KIND_INT64,
+    KGFLAGS_FLAG_KIND_UINT64,
+    KGFLAGS_FLAG_KIND_SIZE,
+    KGFLAGS_FLAG_KIND_DURATION,
+    KGFLAGS_FLAG_KIND_INT64_ARRAY,
+    KGFLAGS_FLAG_KIND_UINT64_ARRAY,
+    KGFLAGS_FLAG_KIND_SIZE_ARRAY,
+    KGFLAGS_FLAG_KIND_DURATION_ARRAY,
+    KGFLAGS_FLAG_KIND_CHOICE,
+    KGFLAGS_FLAG_KIND_STRING_LIST,
+    KGFLAGS_FLAG_KIND_INT_LIST,
+    KGFLAGS_FLAG_KIND_DOUBLE_LIST,
+    KGFLAGS_FLAG_KIND_CUSTOM_LIST, // also single custom values, which are lists with capacity 1 and no delimiter
 } _kgflags_flag_kind_t;
 
+// Where parsed values are written, caller's variables or a snapshot (see kgflags_reload).
+typedef union _kgflags_result {
+    const char **string_value;
+    bool *bool_value;
+    int *int_value;
+    double *double_value;
+    int64_t *int64_value;
+    uint64_t *uint64_value;
+    kgflags_string_array_t *string_array;
+    kgflags_int_array_t *int_array;
+    kgflags_double_array_t *double_array;
+    kgflags_int64_array_t *int64_array;
+    kgflags_uint64_array_t *uint64_array;
+    kgflags_size_array_t *size_array;
+    kgflags_duration_array_t *duration_array;
+    kgflags_string_list_t *string_list;
+    kgflags_int_list_t *int_list;
+    kgflags_double_list_t *double_list;
+    kgflags_custom_list_t *custom_list;
+} _kgflags_result_t;
+
+// Fields read while parsing, see _kgflags_flag_key_t and _kgflags_flag_cold_t for the rest of a flag.
 typedef struct _kgflags_flag {
     const char *name;
+    _kgflags_result_t result;
+    const char *const *choices;
+    int choices_count;
+    int choices_offset; // into choice_keys, its table starts at choices_offset * 2 in choice_index
+    void *list_storage; // also values of repeatable flags
+    int list_capacity;
+    char list_delimiter;
+    bool repeatable;
+    int path_checks; // kgflags_path_check_t bits of string flags and arrays
+    int custom_kind; // index into custom_kinds
+    kgflags_file_t *file; // set for file flags, string result points to its path
+    bool assigned;
+    bool error;
+    bool required;
+    _kgflags_flag_kind_t kind;
+} _kgflags_flag_t;
+
+// Fields read only when assigning defaults, printing usage or dumping, kept in flag_colds parallel to flags.
+typedef struct _kgflags_flag_cold {
     const char *description;
     union {
         const char *string_value;
         bool bool_value;
         int int_value;
         double double_value;
+        int64_t int64_value;
+        uint64_t uint64_value;
     } default_value;
-    union {
-        const char **string_value;
-        bool *bool_value;
-        int *int_value;
-        double *double_value;
-        kgflags_string_array_t *string_array;
-        kgflags_int_array_t *int_array;
-        kgflags_double_array_t *double_array;
-    } result;
-    bool assigned;
-    bool error;
-    bool required;
+    char short_name; // '\0' if there is none
+} _kgflags_flag_cold_t;
+
+typedef struct _kgflags_custom_kind {
+    const char *type_name;
+    size_t elem_size;
+    kgflags_custom_parse_t parse;
+    void *ctx;
+} _kgflags_custom_kind_t;
+
+typedef struct _kgflags_unit {
+    const char *suffix;
+    uint64_t multiplier;
+} _kgflags_unit_t;
+
+static const _kgflags_unit_t _kgflags_size_units[] = {
+    { "", 1 }, { "B", 1 },
+    { "K", (uint64_t)1 << 10 }, { "KiB", (uint64_t)1 << 10 }, { "KB", 1000 },
+    { "M", (uint64_t)1 << 20 }, { "MiB", (uint64_t)1 << 20 }, { "MB", 1000 * 1000 },
+    { "G", (uint64_t)1 << 30 }, { "GiB", (uint64_t)1 << 30 }, { "GB", 1000 * 1000 * 1000 },
+    { "T", (uint64_t)1 << 40 }, { "TiB", (uint64_t)1 << 40 }, { "TB", (uint64_t)1000 * 1000 * 1000 * 1000 },
+};
+
+static const _kgflags_unit_t _kgflags_duration_units[] = {
+    { "ns", 1 },
+    { "us", 1000 },
+    { "ms", 1000 * 1000 },
+    { "s", 1000 * 1000 * 1000 },
+    { "m", (uint64_t)60 * 1000 * 1000 * 1000 },
+    { "h", (uint64_t)60 * 60 * 1000 * 1000 * 1000 },
+};
+
+// Hot part of a flag used by lookups, kept in a packed array parallel to flags. Name and kind are here
+// so a lookup, including resolving a "no-" name, doesn't read the flag record.
+typedef struct _kgflags_flag_key {
+    const char *name;
+    unsigned int hash;
+    unsigned int length;
     _kgflags_flag_kind_t kind;
-} _kgflags_flag_t;
+} _kgflags_flag_key_t;
 
-typedef enum _kgflags_error_kind {
-    KGFLAGS_ERROR_KIND_NONE,
-    KGFLAGS_ERROR_KIND_MISSING_VALUE,
-    KGFLAGS_ERROR_KIND_UNKNOWN_FLAG,
-    KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG,
-    KGFLAGS_ERROR_KIND_INVALID_INT,
-    KGFLAGS_ERROR_KIND_INVALID_DOUBLE,
-    KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS,
-    KGFLAGS_ERROR_KIND_TOO_MANY_NON_FLAG_ARGS,
-    KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT,
-    KGFLAGS_ERROR_KIND_DUPLICATE_FLAG,
-    KGFLAGS_ERROR_KIND_PREFIX_NO,
-} _kgflags_error_kind_t;
+// Open addressing index from name hash to (flag index + 1), 0 marks an empty slot.
+#define _KGFLAGS_INDEX_SIZE (KGFLAGS_MAX_FLAGS * 2)
+
+// Flag sets are bitsets indexed by flag index, so constraints are checked a word (64 flags) at a time.
+#define _KGFLAGS_BITSET_WORDS ((KGFLAGS_MAX_FLAGS + 63) / 64)
+
+typedef enum _kgflags_constraint_kind {
+    KGFLAGS_CONSTRAINT_KIND_EXACTLY_ONE,
+    KGFLAGS_CONSTRAINT_KIND_AT_MOST_ONE,
+    KGFLAGS_CONSTRAINT_KIND_REQUIRES,
+} _kgflags_constraint_kind_t;
+
+typedef struct _kgflags_constraint {
+    _kgflags_constraint_kind_t kind;
+    uint64_t flags[_KGFLAGS_BITSET_WORDS]; // for REQUIRES only the dependent flag
+    int required_flag;
+} _kgflags_constraint_t;
 
 typedef struct _kgflags_error {
     const char *flag_name;
     const char *arg;
-    _kgflags_error_kind_t kind;
+    int arg_index;
+    int item_index;
+    int limit;
+    int char_index;
+    int constraint; // index of violated constraint, -1 if there is none
+    kgflags_error_kind_t kind;
 } _kgflags_error_t;
 
+typedef enum _kgflags_arg_kind {
+    KGFLAGS_ARG_KIND_NON_FLAG,
+    KGFLAGS_ARG_KIND_LONG,
+    KGFLAGS_ARG_KIND_SHORT,
+} _kgflags_arg_kind_t;
+
+// What the last kgflags_parse (or image attach) left describing its arguments. kgflags_reload keeps it on
+// its stack while parsing into a snapshot, so non-flag arguments, dump, serialize_argv and pass-through
+// argv keep describing the parse the declared variables came from.
+typedef struct _kgflags_parse_state {
+    int argc;
+    char **argv;
+    const char *arg0;
+    const char *image_non_flags;
+    const char *image_base;
+    int arg_cursor;
+    int non_flag_start;
+    int non_flag_count;
+    const char *non_flag_args[KGFLAGS_MAX_NON_FLAG_ARGS];
+    int touched_count;
+    int touched_flags[KGFLAGS_MAX_FLAGS];
+    uint64_t assigned_bits[_KGFLAGS_BITSET_WORDS];
+    uint64_t error_bits[_KGFLAGS_BITSET_WORDS];
+    uint64_t flag_assigned[_KGFLAGS_BITSET_WORDS]; // assigned fields of flag records
+    uint64_t flag_error[_KGFLAGS_BITSET_WORDS]; // error fields of flag records
+    int errors_count;
+    int declaration_errors_count;
+    _kgflags_error_t errors[KGFLAGS_MAX_ERRORS];
+} _kgflags_parse_state_t;
+
+// Per-call state of kgflags_validate, lives on the caller's stack instead of in _kgflags_g.
+typedef struct _kgflags_validator {
+    int argc;
+    char **argv;
+    int arg_cursor;
+    const char *inline_value;
+    int non_flag_count;
+    bool stop_at_first_error;
+    int occurrences[KGFLAGS_MAX_FLAGS]; // of repeatable flags
+    bool has_ranges[KGFLAGS_MAX_FLAGS]; // of repeatable flags, ranges_lengths are valid only if set
+    int ranges_lengths[KGFLAGS_MAX_FLAGS]; // see _kgflags_get_ranges_length
+    uint64_t assigned_bits[_KGFLAGS_BITSET_WORDS];
+    uint64_t error_bits[_KGFLAGS_BITSET_WORDS];
+    kgflags_validation_t *result;
+} _kgflags_validator_t;
+
 static bool _kgflags_is_flag(const char* arg);
-static const char* _kgflags_get_flag_name(const char* arg);
-static void _kgflags_add_flag(_kgflags_flag_t arg);
+static _kgflags_arg_kind_t _kgflags_get_arg_kind(const char* arg);
+static _kgflags_flag_t* _kgflags_parse_short_flags(const char *arg);
+static void _kgflags_process_flag(_kgflags_flag_t *flag, bool prefix_no);
+static void _kgflags_add_flag(_kgflags_flag_t flag, _kgflags_flag_cold_t cold);
+static _kgflags_flag_cold_t* _kgflags_get_cold(const _kgflags_flag_t *flag);
 static _kgflags_flag_t* _kgflags_get_flag(const char* name, bool *out_prefix_no);
+static _kgflags_flag_t* _kgflags_get_flag_n(const char* name, unsigned int length, bool *out_prefix_no);
+static unsigned int _kgflags_hash(const char *str, unsigned int *out_length);
+static unsigned int _kgflags_hash_n(const char *str, unsigned int length);
+static int _kgflags_find_flag(const char *name, unsigned int length, unsigned int hash);
 static int _kgflags_parse_int(const char *str, bool *out_ok);
 static double _kgflags_parse_double(const char *str, bool *out_ok);
-static void _kgflags_add_error(_kgflags_error_kind_t kind, const char *flag, const char *arg);
+static int _kgflags_parse_digits(const char **str, uint64_t *out_val);
+static bool _kgflags_to_int64(uint64_t magnitude, bool negative, int64_t *out_val);
+static bool _kgflags_parse_with_unit(const char *str, const _kgflags_unit_t *units, int units_count, uint64_t *out_val);
+static int64_t _kgflags_parse_int64(const char *str, bool *out_ok);
+static uint64_t _kgflags_parse_uint64(const char *str, bool *out_ok);
+static uint64_t _kgflags_parse_size(const char *str, bool *out_ok);
+static int64_t _kgflags_parse_duration(const char *str, bool *out_ok);
+static kgflags_error_kind_t _kgflags_get_invalid_value_error(_kgflags_flag_kind_t kind);
+static void _kgflags_add_error(kgflags_error_kind_t kind, const char *flag, const char *arg, int arg_index, int item_index);
+static void _kgflags_add_constraint(_kgflags_constraint_kind_t kind, const char *const *names, int names_count, const char *required_name);
+static void _kgflags_report_error(_kgflags_validator_t *validator, kgflags_error_kind_t kind, const char *flag_name, const char *arg, int arg_index, int item_index);
+static void _kgflags_report_too_many_items(_kgflags_validator_t *validator, const char *flag_name, const char *arg, int arg_index, int item_index, int limit);
+static void _kgflags_report_unknown_short_flag(_kgflags_validator_t *validator, const char *arg, int arg_index, int char_index);
+static void _kgflags_store_error(_kgflags_validator_t *validator, const kgflags_error_info_t *info);
+static void _kgflags_check_constraints(void);
+static void _kgflags_check_constraint_bits(const uint64_t *assigned, const uint64_t *errors, _kgflags_validator_t *validator);
+static void _kgflags_ensure_registered(void);
+static int _kgflags_popcount(uint64_t word);
+static int _kgflags_lowest_bit(uint64_t word);
+static int _kgflags_first_flag(const uint64_t *bits);
 static void _kgflags_assign_default_values(void);
 static bool _kgflags_add_non_flag_arg(const char* arg);
+static void _kgflags_reverse_args(int begin, int end);
+static void _kgflags_move_before_non_flag_args(_kgflags_flag_t *flag, int begin, int end);
+static int _kgflags_get_pass_through_arity(const char *arg, int remaining);
+static char*** _kgflags_get_array_items(_kgflags_flag_t *flag);
 static const char* _kgflags_consume_arg(void);
 static const char* _kgflags_peek_arg(void);
+static const char* _kgflags_consume_value(void);
+static int _kgflags_parse_int_span(const char *str, size_t length, bool *out_ok);
+static double _kgflags_parse_double_span(const char *str, size_t length, bool *out_ok);
+static void _kgflags_declare_list(_kgflags_flag_kind_t kind, const char *name, char delimiter, void *storage, int capacity,
+                                  const char *description, bool required, void *out_list);
+static void _kgflags_parse_list(_kgflags_flag_t *flag, const char *val);
+static void _kgflags_declare_custom(const char *name, int kind, char delimiter, void *storage, int capacity,
+                                    const char *description, bool required, kgflags_custom_list_t *out_list);
+static bool _kgflags_parse_ipv4_bytes(const char *str, size_t length, uint8_t *out_bytes);
+static bool _kgflags_parse_ipv6_bytes(const char *str, size_t length, uint8_t *out_bytes);
+static void _kgflags_declare_repeatable(_kgflags_flag_kind_t kind, const char *name, char **storage, int capacity,
+                                        const char *description, bool required, void *out_arr);
+static void _kgflags_parse_occurrence(_kgflags_flag_t *flag);
+static bool _kgflags_takes_inline_value(_kgflags_flag_kind_t kind);
 static void _kgflags_parse_flag(_kgflags_flag_t *flag, bool prefix_no);
+static void _kgflags_mark_touched(_kgflags_flag_t *flag);
+static void _kgflags_save_parse_state(_kgflags_parse_state_t *state);
+static void _kgflags_restore_parse_state(const _kgflags_parse_state_t *state, bool restore_errors);
+static void _kgflags_redirect_result(_kgflags_flag_t *flag, kgflags_snapshot_t *snapshot, int id);
+static size_t _kgflags_get_storage_size(const _kgflags_flag_t *flag);
+static bool _kgflags_strings_equal(const char *a, const char *b);
+static bool _kgflags_items_equal(char **a, int a_count, char **b, int b_count);
+static bool _kgflags_values_equal(const void *a, int a_count, const void *b, int b_count, size_t elem_size);
+static int _kgflags_consume_array_args(void);
+static int _kgflags_find_choice(const _kgflags_flag_t *flag, const char *value);
+static void _kgflags_print_choices(const _kgflags_flag_t *flag);
+
+// If file is set buffer is flushed to it when full, otherwise output is truncated to cap and len counts all of it.
+typedef struct _kgflags_writer {
+    char *buf;
+    size_t cap;
+    size_t len;
+    FILE *file;
+} _kgflags_writer_t;
+
+// Splits writer output into NUL-terminated arguments, arg_start is where the current one begins.
+typedef struct _kgflags_argv_writer {
+    _kgflags_writer_t writer;
+    size_t arg_start;
+    char **argv;
+    int argv_cap;
+    int argc;
+} _kgflags_argv_writer_t;
+
+#define _KGFLAGS_IMAGE_MAGIC 0x4946474bu // "KGFI"
+#define _KGFLAGS_IMAGE_VERSION 4u
+
+typedef struct _kgflags_image_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t schema_hash;
+    uint64_t size;
+    uint32_t flags_count;
+    uint32_t non_flag_count; // followed by flags_count records and non_flag_count string offsets
+    uint32_t arg0_offset;
+    uint32_t reserved;
+} _kgflags_image_header_t;
+
+// Offsets are relative to the start of the image, 0 stands for NULL.
+typedef struct _kgflags_image_record {
+    union {
+        int64_t int64_value;
+        uint64_t uint64_value;
+        double double_value;
+    } value; // for int and double arrays ranges length, see _kgflags_get_ranges_length
+    uint32_t offset; // string, string list argument, table of array item offsets or list items
+    uint32_t spans_offset; // string list spans
+    uint32_t count;
+    uint32_t assigned;
+} _kgflags_image_record_t;
+
+#define _KGFLAGS_CACHE_MAGIC 0x4346474bu // "KGFC"
+#define _KGFLAGS_CACHE_VERSION 2u
+
+#ifdef KGFLAGS_TRACE
+#define _KGFLAGS_TRACE(kind, arg_index, flag_id, detail, span_start, span_length) \
+    _kgflags_trace_record(kind, arg_index, flag_id, detail, span_start, span_length)
+#else
+#define _KGFLAGS_TRACE(kind, arg_index, flag_id, detail, span_start, span_length) ((void)0)
+#endif
+
+// Image follows the header.
+typedef struct _kgflags_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t checksum;
+    uint64_t image_size;
+} _kgflags_cache_header_t;
+
+// Values start, start + step, ... count of them, single values are terms with count 1.
+typedef struct _kgflags_range_term {
+    double start;
+    double step;
+    int64_t count;
+} _kgflags_range_term_t;
+
+// Range term of an int or double array with index of its first value among values of the whole array.
+typedef struct _kgflags_range_entry {
+    double start;
+    double step;
+    int first;
+} _kgflags_range_entry_t;
+
+typedef struct _kgflags_completion_entry {
+    int flag;
+    bool prefix_no;
+} _kgflags_completion_entry_t;
+
+static void _kgflags_write(_kgflags_writer_t *writer, const char *str, size_t len);
+static void _kgflags_flush(_kgflags_writer_t *writer);
+static char _kgflags_completion_char(const _kgflags_completion_entry_t *entry, unsigned int at);
+static int _kgflags_compare_completion_entries(const void *a, const void *b);
+static int _kgflags_compare_completion_partial(const _kgflags_completion_entry_t *entry, const char *partial);
+static void _kgflags_build_completion_index(void);
+static void _kgflags_write_completions(_kgflags_writer_t *writer, const char *partial);
+static const char* _kgflags_get_prefix(void);
+static void _kgflags_write_string(_kgflags_writer_t *writer, const char *str);
+static void _kgflags_write_escaped(_kgflags_writer_t *writer, const char *str, kgflags_dump_format_t fmt);
+static void _kgflags_write_escaped_n(_kgflags_writer_t *writer, const char *str, size_t length, kgflags_dump_format_t fmt);
+static void _kgflags_write_double(_kgflags_writer_t *writer, double val, kgflags_dump_format_t fmt);
+static void _kgflags_write_flag_value(_kgflags_writer_t *writer, const _kgflags_flag_t *flag, kgflags_dump_format_t fmt);
+static void _kgflags_end_arg(_kgflags_argv_writer_t *argv_writer);
+static bool _kgflags_equals_default(const _kgflags_flag_t *flag);
+static void _kgflags_write_arg_value(_kgflags_writer_t *writer, const _kgflags_flag_t *flag);
+static void _kgflags_get_array(const _kgflags_flag_t *flag, char ***out_items, int *out_count);
+static void _kgflags_set_array(_kgflags_flag_t *flag, char **items, int count);
+static bool _kgflags_is_typed_array(_kgflags_flag_kind_t kind);
+static void _kgflags_get_typed_array(const _kgflags_flag_t *flag, const void **out_items, int *out_count);
+static void _kgflags_set_typed_array(_kgflags_flag_t *flag, void *items, int count);
+static void _kgflags_write_typed_item(_kgflags_writer_t *writer, const _kgflags_flag_t *flag, int index);
+static int _kgflags_get_ranges_length(const _kgflags_flag_t *flag);
+static void _kgflags_set_ranges_length(_kgflags_flag_t *flag, int length);
+static uint64_t _kgflags_hash_bytes(uint64_t hash, const void *data, size_t length);
+static void _kgflags_write_at(_kgflags_writer_t *writer, size_t offset, const void *data, size_t length);
+static size_t _kgflags_image_reserve(_kgflags_writer_t *writer, size_t length, size_t align);
+static uint32_t _kgflags_image_append(_kgflags_writer_t *writer, const void *data, size_t length, size_t align);
+static uint32_t _kgflags_image_append_string(_kgflags_writer_t *writer, const char *str);
+static void _kgflags_image_write_record(_kgflags_writer_t *writer, const _kgflags_flag_t *flag, _kgflags_image_record_t *record);
+static bool _kgflags_image_record_ok(const _kgflags_flag_t *flag, const _kgflags_image_record_t *record, const char *base, size_t size);
+static bool _kgflags_image_string_ok(const char *base, size_t size, uint32_t offset);
+static bool _kgflags_image_paths_ok(const _kgflags_flag_t *flag, const _kgflags_image_record_t *record, const char *base);
+static bool _kgflags_image_attach(const void *image, size_t size, char **items_storage, int items_capacity,
+                                  uint64_t schema_hash, bool check_paths);
+static uint64_t _kgflags_get_cache_key(uint64_t schema_hash, int argc, char **argv);
+static bool _kgflags_is_valid_array_item(_kgflags_flag_kind_t kind, const char *item);
+static kgflags_error_kind_t _kgflags_check_item(_kgflags_flag_kind_t kind, int path_checks, const char *item,
+                                                int64_t *out_values, bool *out_range);
+static kgflags_error_kind_t _kgflags_convert_item(_kgflags_flag_kind_t kind, const char *item, void *storage, int index);
+static double _kgflags_parse_range_bound(_kgflags_flag_kind_t kind, const char *str, size_t length, bool *out_ok);
+static bool _kgflags_parse_range_term(_kgflags_flag_kind_t kind, const char *term, size_t length, _kgflags_range_term_t *out_term);
+static int64_t _kgflags_expand_range(_kgflags_flag_kind_t kind, const char *expr, int64_t skip, int cap,
+                                     int *out_ints, double *out_doubles, int *out_written);
+static int64_t _kgflags_get_item_values(_kgflags_flag_kind_t kind, const char *item, bool *out_range);
+static int _kgflags_fill_array(_kgflags_flag_kind_t kind, char **items, int count, bool has_ranges, int offset,
+                               int *out_ints, double *out_doubles, int cap);
+static bool _kgflags_parse(int argc, char **argv);
+static void _kgflags_index_ranges(_kgflags_range_entry_t *entries, int capacity);
+static int _kgflags_fill_indexed(const _kgflags_range_entry_t *terms, int terms_count, int length, int offset,
+                                 int *out_ints, double *out_doubles, int cap);
+static kgflags_error_kind_t _kgflags_check_path(const char *path, int checks);
+static bool _kgflags_map_file(kgflags_file_t *file, size_t max_size);
+static void _kgflags_preload_file_job(void *job_ctx, int index);
+static void _kgflags_validate_array_job(void *job_ctx, int chunk);
+static bool _kgflags_validate_array(_kgflags_flag_t *flag, char **items, int count, int *out_ranges_length);
+static void _kgflags_validate_argv(_kgflags_validator_t *validator);
+static void _kgflags_validate_flag(_kgflags_validator_t *validator, int index);
+static bool _kgflags_validate_value(_kgflags_validator_t *validator, const _kgflags_flag_t *flag, const char *val);
+static bool _kgflags_validate_list(_kgflags_validator_t *validator, const _kgflags_flag_t *flag, const char *val, int arg_index);
+static void _kgflags_validate_batch_job(void *job_ctx, int chunk);
+#ifdef KGFLAGS_TRACE
+static void _kgflags_trace_record(kgflags_trace_kind_t kind, int arg_index, int flag_id, int detail, int span_start, int span_length);
+static int _kgflags_trace_flag_id(const char *flag_name);
+#endif
+
+typedef struct _kgflags_array_job {
+    char **items;
+    int count;
+    int chunk_size;
+    _kgflags_flag_kind_t kind;
+    int path_checks;
+    void *storage; // converted values of int64, uint64, size and duration arrays are written here, if not NULL
+    bool chunk_failed[KGFLAGS_MAX_PARALLEL_CHUNKS];
+    int64_t chunk_values[KGFLAGS_MAX_PARALLEL_CHUNKS]; // values of int and double array items, see _kgflags_get_item_values
+    bool chunk_ranges[KGFLAGS_MAX_PARALLEL_CHUNKS];
+} _kgflags_array_job_t;
+
+typedef struct _kgflags_preload_job {
+    int flags[KGFLAGS_MAX_FLAGS];
+    bool failed[KGFLAGS_MAX_FLAGS];
+    size_t max_size;
+} _kgflags_preload_job_t;
+
+typedef struct _kgflags_batch_job {
+    const int *argcs;
+    char **const *argvs;
+    kgflags_validation_t *results;
+    int count;
+    int chunk_size;
+    bool stop_at_first_error;
+    int chunk_invalid_count[KGFLAGS_MAX_PARALLEL_CHUNKS];
+} _kgflags_batch_job_t;
 
 static struct {
     int flags_count;
+    _kgflags_flag_key_t flag_keys[KGFLAGS_MAX_FLAGS];
+    int flag_index[_KGFLAGS_INDEX_SIZE];
     _kgflags_flag_t flags[KGFLAGS_MAX_FLAGS];
+    _kgflags_flag_cold_t flag_colds[KGFLAGS_MAX_FLAGS];
 
     int non_flag_count;
     const char* non_flag_args[KGFLAGS_MAX_NON_FLAG_ARGS];
+    const char *image_non_flags; // table of non-flag argument offsets of the attached image, used instead of non_flag_args
+    const char *image_base;
+    const char *arg0; // argv[0] of the last kgflags_parse or of the attached image, NULL if there was neither
+    bool permute_argv;
+    int non_flag_start; // with permute_argv non-flag arguments seen so far are argv[non_flag_start, arg_cursor)
+    bool pass_through;
+    kgflags_arity_t pass_through_arity;
+    void *pass_through_arity_ctx;
 
     int errors_count;
+    int declaration_errors_count;
     _kgflags_error_t errors[KGFLAGS_MAX_ERRORS];
 
+    int touched_count;
+    int touched_flags[KGFLAGS_MAX_FLAGS];
+
     const char *flag_prefix;
+    size_t flag_prefix_length;
+
+    // Short aliases indexed by character, storing (flag index + 1).
+    int short_flags[256];
 
     int arg_cursor;
     int argc;
     char **argv;
+    const char *inline_value; // value of current "--name=value" argument, NULL if there is none
 
     const char *custom_description;
+
+    kgflags_parallel_for_t parallel_for;
+    void *parallel_for_ctx;
+    int parallel_min_items;
+
+    int custom_kinds_count;
+    _kgflags_custom_kind_t custom_kinds[KGFLAGS_MAX_CUSTOM_KINDS];
+    kgflags_custom_list_t custom_singles[KGFLAGS_MAX_FLAGS]; // results of kgflags_custom flags, indexed like flags
+
+    // Names (and "no-" forms) sorted for completion, built on first use.
+    int completion_count;
+    int completion_flags_count;
+    _kgflags_completion_entry_t completion_index[KGFLAGS_MAX_FLAGS * 2];
+
+    // Range terms of int and double arrays with range expressions, rebuilt after every parse and attach.
+    _kgflags_range_entry_t range_terms[KGFLAGS_MAX_RANGE_TERMS];
+
+    uint64_t required_bits[_KGFLAGS_BITSET_WORDS];
+    uint64_t assigned_bits[_KGFLAGS_BITSET_WORDS]; // rebuilt from touched flags after every parse
+    uint64_t error_bits[_KGFLAGS_BITSET_WORDS];
+
+    int constraints_count;
+    _kgflags_constraint_t constraints[KGFLAGS_MAX_CONSTRAINTS];
+
+    bool specs_registered;
+    bool frozen;
+    uint64_t schema_hash; // set by kgflags_freeze, frozen schema can't change
+
+    // Every choice flag owns a range of choice_keys and a twice as large open addressing
+    // table in choice_index storing (choice index + 1).
+    int choices_count;
+    _kgflags_flag_key_t choice_keys[KGFLAGS_MAX_CHOICES];
+    int choice_index[KGFLAGS_MAX_CHOICES * 2];
+
+#ifdef KGFLAGS_TRACE
+    uint64_t trace_total; // events ever recorded, the last one is at (trace_total - 1) % KGFLAGS_TRACE_CAPACITY
+    kgflags_trace_event_t trace[KGFLAGS_TRACE_CAPACITY];
+#endif
 } _kgflags_g;
 
 void kgflags_string(const char *name, const char *default_value, const char *description, bool required, const char** out_res) {
@@ -234,34 +1330,38 @@ void kgflags_string(const char *name, const char *default_value, const char *des
 
     _kgflags_flag_t flag;
     memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
     flag.kind = KGFLAGS_FLAG_KIND_STRING;
     flag.name = name;
-    flag.default_value.string_value = default_value;
-    flag.description = description;
+    cold.default_value.string_value = default_value;
+    cold.description = description;
     flag.required = required;
     flag.result.string_value = out_res;
     flag.assigned = false;
-    _kgflags_add_flag(flag);
+    _kgflags_add_flag(flag, cold);
 }
 
 void kgflags_bool(const char *name, bool default_value, const char *description, bool required, bool *out_res) {
     *out_res = false;
 
     if (strstr(name, "no-") == name) {
-        _kgflags_add_error(KGFLAGS_ERROR_KIND_PREFIX_NO, name, NULL);
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_PREFIX_NO, name, NULL, -1, -1);
         return;
     }
 
     _kgflags_flag_t flag;
     memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
     flag.kind = KGFLAGS_FLAG_KIND_BOOL;
     flag.name = name;
-    flag.default_value.bool_value = default_value;
-    flag.description = description;
+    cold.default_value.bool_value = default_value;
+    cold.description = description;
     flag.required = required;
     flag.result.bool_value = out_res;
     flag.assigned = false;
-    _kgflags_add_flag(flag);
+    _kgflags_add_flag(flag, cold);
 }
 
 void kgflags_int(const char *name, int default_value, const char *description, bool required, int *out_res) {
@@ -269,14 +1369,16 @@ void kgflags_int(const char *name, int default_value, const char *description, b
 
     _kgflags_flag_t flag;
     memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
     flag.kind = KGFLAGS_FLAG_KIND_INT;
     flag.name = name;
-    flag.default_value.int_value = default_value;
-    flag.description = description;
+    cold.default_value.int_value = default_value;
+    cold.description = description;
     flag.required = required;
     flag.result.int_value = out_res;
     flag.assigned = false;
-    _kgflags_add_flag(flag);
+    _kgflags_add_flag(flag, cold);
 }
 
 void kgflags_double(const char *name, double default_value, const char *description, bool required, double *out_res) {
@@ -284,14 +1386,16 @@ void kgflags_double(const char *name, double default_value, const char *descript
 
     _kgflags_flag_t flag;
     memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
     flag.kind = KGFLAGS_FLAG_KIND_DOUBLE;
     flag.name = name;
-    flag.default_value.double_value = default_value;
-    flag.description = description;
+    cold.default_value.double_value = default_value;
+    cold.description = description;
     flag.required = required;
     flag.result.double_value = out_res;
     flag.assigned = false;
-    _kgflags_add_flag(flag);
+    _kgflags_add_flag(flag, cold);
 }
 
 void kgflags_string_array(const char *name, const char *description, bool required, kgflags_string_array_t *out_arr) {
@@ -300,551 +1404,5355 @@ void kgflags_string_array(const char *name, const char *description, bool requir
 
     _kgflags_flag_t flag;
     memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
     flag.kind = KGFLAGS_FLAG_KIND_STRING_ARRAY;
     flag.name = name;
-    flag.description = description;
+    cold.description = description;
     flag.required = required;
     flag.result.string_array = out_arr;
     flag.assigned = false;
-    _kgflags_add_flag(flag);
+    _kgflags_add_flag(flag, cold);
 }
 
 void kgflags_int_array(const char *name, const char *description, bool required, kgflags_int_array_t *out_arr) {
     out_arr->_items = NULL;
     out_arr->_count = 0;
+    out_arr->_length = 0;
+    out_arr->_has_ranges = false;
+    out_arr->_terms = NULL;
+    out_arr->_terms_count = 0;
 
     _kgflags_flag_t flag;
     memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
     flag.kind = KGFLAGS_FLAG_KIND_INT_ARRAY;
     flag.name = name;
-    flag.description = description;
+    cold.description = description;
     flag.required = required;
     flag.result.int_array = out_arr;
     flag.assigned = false;
-    _kgflags_add_flag(flag);
+    _kgflags_add_flag(flag, cold);
 }
 
 void kgflags_double_array(const char *name, const char *description, bool required, kgflags_double_array_t *out_arr) {
     out_arr->_items = NULL;
     out_arr->_count = 0;
+    out_arr->_length = 0;
+    out_arr->_has_ranges = false;
+    out_arr->_terms = NULL;
+    out_arr->_terms_count = 0;
 
     _kgflags_flag_t flag;
     memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
     flag.kind = KGFLAGS_FLAG_KIND_DOUBLE_ARRAY;
     flag.name = name;
-    flag.description = description;
+    cold.description = description;
     flag.required = required;
     flag.result.double_array = out_arr;
     flag.assigned = false;
-    _kgflags_add_flag(flag);
+    _kgflags_add_flag(flag, cold);
 }
 
-void kgflags_set_prefix(const char *prefix) {
-    _kgflags_g.flag_prefix = prefix;
-}
+void kgflags_int64(const char *name, int64_t default_value, const char *description, bool required, int64_t *out_res) {
+    *out_res = 0;
 
-bool kgflags_parse(int argc, char **argv) {
-    _kgflags_g.argc = argc;
-    _kgflags_g.argv = argv;
-    _kgflags_g.arg_cursor = 1;
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_INT64;
+    flag.name = name;
+    cold.default_value.int64_value = default_value;
+    cold.description = description;
+    flag.required = required;
+    flag.result.int64_value = out_res;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
 
-    if (_kgflags_g.flag_prefix == NULL) {
-        _kgflags_g.flag_prefix = "--";
-    }
+void kgflags_uint64(const char *name, uint64_t default_value, const char *description, bool required, uint64_t *out_res) {
+    *out_res = 0;
 
-    if (_kgflags_g.errors_count > 0) {
-        return false;
-    }
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_UINT64;
+    flag.name = name;
+    cold.default_value.uint64_value = default_value;
+    cold.description = description;
+    flag.required = required;
+    flag.result.uint64_value = out_res;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
 
-    const char *arg = NULL;
-    while ((arg = _kgflags_consume_arg()) != NULL) {
-        _kgflags_flag_t *flag = NULL;
-        bool is_flag = _kgflags_is_flag(arg);
-        bool prefix_no = false;
-        if (is_flag) {
-            const char *flag_name = _kgflags_get_flag_name(arg);
-            flag = _kgflags_get_flag(flag_name, &prefix_no);
-            if (flag == NULL) {
-                _kgflags_add_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG, flag_name, NULL);
-                continue;
-            }
-        } else {
-            _kgflags_add_non_flag_arg(arg);
-            continue;
-        }
+void kgflags_size(const char *name, uint64_t default_value, const char *description, bool required, uint64_t *out_res) {
+    *out_res = 0;
 
-        if (flag->assigned) {
-            _kgflags_add_error(KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT, flag->name, NULL);
-        }
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_SIZE;
+    flag.name = name;
+    cold.default_value.uint64_value = default_value;
+    cold.description = description;
+    flag.required = required;
+    flag.result.uint64_value = out_res;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
 
-        _kgflags_parse_flag(flag, prefix_no);
-    }
+void kgflags_duration(const char *name, int64_t default_value, const char *description, bool required, int64_t *out_res) {
+    *out_res = 0;
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_DURATION;
+    flag.name = name;
+    cold.default_value.int64_value = default_value;
+    cold.description = description;
+    flag.required = required;
+    flag.result.int64_value = out_res;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+void kgflags_choice(const char *name, const char *const *choices, int choices_count, int default_index,
+                    const char *description, bool required, int *out_index) {
+    *out_index = -1;
+
+    if (choices_count <= 0 || _kgflags_g.choices_count + choices_count > KGFLAGS_MAX_CHOICES) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_TOO_MANY_CHOICES, name, NULL, -1, -1);
+        return;
+    }
+    if (default_index < -1 || default_index >= choices_count) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_CHOICE, name, NULL, -1, -1);
+        return;
+    }
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_CHOICE;
+    flag.name = name;
+    cold.default_value.int_value = default_index;
+    cold.description = description;
+    flag.required = required;
+    flag.result.int_value = out_index;
+    flag.choices = choices;
+    flag.choices_count = choices_count;
+    flag.choices_offset = _kgflags_g.choices_count;
+    flag.assigned = false;
+
+    int flags_count = _kgflags_g.flags_count;
+    _kgflags_add_flag(flag, cold);
+    if (_kgflags_g.flags_count == flags_count) {
+        return;
+    }
+
+    _kgflags_flag_key_t *keys = _kgflags_g.choice_keys + flag.choices_offset;
+    int *table = _kgflags_g.choice_index + flag.choices_offset * 2;
+    unsigned int table_size = (unsigned int)choices_count * 2;
+    for (int i = 0; i < choices_count; i++) {
+        keys[i].name = choices[i];
+        keys[i].hash = _kgflags_hash(choices[i], &keys[i].length);
+        unsigned int slot = keys[i].hash % table_size;
+        while (table[slot] != 0) {
+            slot = (slot + 1) % table_size;
+        }
+        table[slot] = i + 1;
+    }
+    _kgflags_g.choices_count += choices_count;
+}
+
+void kgflags_string_list(const char *name, char delimiter, kgflags_span_t *storage, int capacity,
+                         const char *description, bool required, kgflags_string_list_t *out_list) {
+    out_list->_arg = NULL;
+    out_list->_spans = storage;
+    out_list->_count = 0;
+    _kgflags_declare_list(KGFLAGS_FLAG_KIND_STRING_LIST, name, delimiter, storage, capacity, description, required, out_list);
+}
+
+void kgflags_int_list(const char *name, char delimiter, int *storage, int capacity,
+                      const char *description, bool required, kgflags_int_list_t *out_list) {
+    out_list->_items = storage;
+    out_list->_count = 0;
+    _kgflags_declare_list(KGFLAGS_FLAG_KIND_INT_LIST, name, delimiter, storage, capacity, description, required, out_list);
+}
+
+void kgflags_double_list(const char *name, char delimiter, double *storage, int capacity,
+                         const char *description, bool required, kgflags_double_list_t *out_list) {
+    out_list->_items = storage;
+    out_list->_count = 0;
+    _kgflags_declare_list(KGFLAGS_FLAG_KIND_DOUBLE_LIST, name, delimiter, storage, capacity, description, required, out_list);
+}
+
+void kgflags_string_repeatable(const char *name, char **storage, int capacity,
+                               const char *description, bool required, kgflags_string_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+    _kgflags_declare_repeatable(KGFLAGS_FLAG_KIND_STRING_ARRAY, name, storage, capacity, description, required, out_arr);
+}
+
+void kgflags_int_repeatable(const char *name, char **storage, int capacity,
+                            const char *description, bool required, kgflags_int_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+    out_arr->_length = 0;
+    out_arr->_has_ranges = false;
+    out_arr->_terms = NULL;
+    out_arr->_terms_count = 0;
+    _kgflags_declare_repeatable(KGFLAGS_FLAG_KIND_INT_ARRAY, name, storage, capacity, description, required, out_arr);
+}
+
+void kgflags_double_repeatable(const char *name, char **storage, int capacity,
+                               const char *description, bool required, kgflags_double_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+    out_arr->_length = 0;
+    out_arr->_has_ranges = false;
+    out_arr->_terms = NULL;
+    out_arr->_terms_count = 0;
+    _kgflags_declare_repeatable(KGFLAGS_FLAG_KIND_DOUBLE_ARRAY, name, storage, capacity, description, required, out_arr);
+}
+
+void kgflags_path(const char *name, const char *default_value, int checks, const char *description, bool required, const char **out_res) {
+    *out_res = NULL;
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_STRING;
+    flag.name = name;
+    cold.default_value.string_value = default_value;
+    cold.description = description;
+    flag.required = required;
+    flag.result.string_value = out_res;
+    flag.path_checks = checks;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+void kgflags_path_array(const char *name, int checks, const char *description, bool required, kgflags_string_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_STRING_ARRAY;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.result.string_array = out_arr;
+    flag.path_checks = checks;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+void kgflags_file(const char *name, const char *default_path, const char *description, bool required, kgflags_file_t *out_file) {
+    memset(out_file, 0, sizeof(kgflags_file_t));
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_STRING;
+    flag.name = name;
+    cold.default_value.string_value = default_path;
+    cold.description = description;
+    flag.required = required;
+    flag.result.string_value = &out_file->_path;
+    flag.path_checks = KGFLAGS_PATH_FILE | KGFLAGS_PATH_READABLE;
+    flag.file = out_file;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+int kgflags_preload_files(size_t max_size) {
+    _kgflags_preload_job_t job;
+    memset(&job, 0, sizeof(_kgflags_preload_job_t));
+    job.max_size = max_size;
+    int count = 0;
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        const _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        if (flag->file != NULL && flag->assigned) {
+            job.flags[count] = i;
+            count++;
+        }
+    }
+    if (_kgflags_g.parallel_for != NULL && count > 1 && count >= _kgflags_g.parallel_min_items) {
+        _kgflags_g.parallel_for(count, _kgflags_preload_file_job, &job, _kgflags_g.parallel_for_ctx);
+    } else {
+        for (int i = 0; i < count; i++) {
+            _kgflags_preload_file_job(&job, i);
+        }
+    }
+    int failed_count = 0;
+    for (int i = 0; i < count; i++) {
+        failed_count += job.failed[i] ? 1 : 0;
+    }
+    return failed_count;
+}
+
+void kgflags_release_files(void) {
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        if (_kgflags_g.flags[i].file != NULL) {
+            kgflags_file_release(_kgflags_g.flags[i].file);
+        }
+    }
+}
+
+int kgflags_register_custom_kind(const char *type_name, size_t elem_size, kgflags_custom_parse_t parse, void *ctx) {
+    if (_kgflags_g.custom_kinds_count >= KGFLAGS_MAX_CUSTOM_KINDS) {
+        return -1;
+    }
+    _kgflags_custom_kind_t *kind = &_kgflags_g.custom_kinds[_kgflags_g.custom_kinds_count];
+    kind->type_name = type_name;
+    kind->elem_size = elem_size;
+    kind->parse = parse;
+    kind->ctx = ctx;
+    return _kgflags_g.custom_kinds_count++;
+}
+
+void kgflags_custom(const char *name, int kind, const char *description, bool required, void *out_value) {
+    int index = _kgflags_g.flags_count;
+    kgflags_custom_list_t *list = index < KGFLAGS_MAX_FLAGS ? &_kgflags_g.custom_singles[index] : NULL;
+    _kgflags_declare_custom(name, kind, '\0', out_value, 1, description, required, list);
+}
+
+void kgflags_custom_list(const char *name, int kind, char delimiter, void *storage, int capacity,
+                         const char *description, bool required, kgflags_custom_list_t *out_list) {
+    _kgflags_declare_custom(name, kind, delimiter, storage, capacity, description, required, out_list);
+}
+
+bool kgflags_parse_ipv4(const char *value, size_t length, void *out_value, void *ctx) {
+    (void)ctx;
+    return _kgflags_parse_ipv4_bytes(value, length, out_value != NULL ? ((kgflags_ipv4_t*)out_value)->bytes : NULL);
+}
+
+bool kgflags_parse_ipv6(const char *value, size_t length, void *out_value, void *ctx) {
+    (void)ctx;
+    return _kgflags_parse_ipv6_bytes(value, length, out_value != NULL ? ((kgflags_ipv6_t*)out_value)->bytes : NULL);
+}
+
+bool kgflags_parse_cidr(const char *value, size_t length, void *out_value, void *ctx) {
+    (void)ctx;
+    const char *slash = (const char*)memchr(value, '/', length);
+    if (slash == NULL) {
+        return false;
+    }
+    kgflags_cidr_t cidr;
+    memset(&cidr, 0, sizeof(kgflags_cidr_t));
+    size_t address_length = (size_t)(slash - value);
+    cidr.ipv6 = memchr(value, ':', address_length) != NULL;
+    bool ok = cidr.ipv6 ? _kgflags_parse_ipv6_bytes(value, address_length, cidr.bytes)
+                        : _kgflags_parse_ipv4_bytes(value, address_length, cidr.bytes);
+    size_t digits = length - address_length - 1;
+    if (!ok || digits == 0 || digits > 3) {
+        return false;
+    }
+    for (size_t i = 0; i < digits; i++) {
+        char c = slash[1 + i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        cidr.prefix_length = cidr.prefix_length * 10 + (c - '0');
+    }
+    if (cidr.prefix_length > (cidr.ipv6 ? 128 : 32)) {
+        return false;
+    }
+    if (out_value != NULL) {
+        memcpy(out_value, &cidr, sizeof(kgflags_cidr_t));
+    }
+    return true;
+}
+
+void kgflags_int64_array(const char *name, int64_t *storage, int capacity,
+                         const char *description, bool required, kgflags_int64_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_INT64_ARRAY;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.list_storage = storage;
+    flag.list_capacity = capacity;
+    flag.result.int64_array = out_arr;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+void kgflags_uint64_array(const char *name, uint64_t *storage, int capacity,
+                          const char *description, bool required, kgflags_uint64_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_UINT64_ARRAY;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.list_storage = storage;
+    flag.list_capacity = capacity;
+    flag.result.uint64_array = out_arr;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+void kgflags_size_array(const char *name, uint64_t *storage, int capacity,
+                        const char *description, bool required, kgflags_size_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_SIZE_ARRAY;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.list_storage = storage;
+    flag.list_capacity = capacity;
+    flag.result.size_array = out_arr;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+void kgflags_duration_array(const char *name, int64_t *storage, int capacity,
+                            const char *description, bool required, kgflags_duration_array_t *out_arr) {
+    out_arr->_items = NULL;
+    out_arr->_count = 0;
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_DURATION_ARRAY;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.list_storage = storage;
+    flag.list_capacity = capacity;
+    flag.result.duration_array = out_arr;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+void kgflags_set_prefix(const char *prefix) {
+    _kgflags_g.flag_prefix = prefix;
+}
+
+void kgflags_set_parallel_for(kgflags_parallel_for_t parallel_for, void *user_ctx, int min_items) {
+    _kgflags_g.parallel_for = parallel_for;
+    _kgflags_g.parallel_for_ctx = user_ctx;
+    _kgflags_g.parallel_min_items = min_items;
+}
+
+bool kgflags_freeze(void) {
+    _kgflags_ensure_registered();
+    _kgflags_get_prefix();
+    _kgflags_g.schema_hash = kgflags_get_schema_hash();
+    _kgflags_g.frozen = true;
+    int errors_count = _kgflags_g.argv != NULL ? _kgflags_g.declaration_errors_count : _kgflags_g.errors_count;
+    return errors_count == 0;
+}
+
+bool kgflags_validate(int argc, char **argv, bool stop_at_first_error, kgflags_validation_t *out_result) {
+    memset(out_result, 0, sizeof(kgflags_validation_t));
+    out_result->first_error.arg_index = -1;
+    out_result->first_error.item_index = -1;
+    out_result->first_error.limit = -1;
+    out_result->first_error.char_index = -1;
+
+    _kgflags_validator_t validator;
+    memset(&validator, 0, sizeof(_kgflags_validator_t));
+    validator.argc = argc;
+    validator.argv = argv;
+    validator.arg_cursor = 1;
+    validator.stop_at_first_error = stop_at_first_error;
+    validator.result = out_result;
+
+    if (!_kgflags_g.frozen) {
+        _kgflags_report_error(&validator, KGFLAGS_ERROR_KIND_SCHEMA_NOT_FROZEN, NULL, NULL, -1, -1);
+        return false;
+    }
+    _kgflags_validate_argv(&validator);
+    return out_result->errors_count == 0;
+}
+
+int kgflags_validate_batch(int count, const int *argcs, char **const *argvs, bool stop_at_first_error, kgflags_validation_t *out_results) {
+    _kgflags_batch_job_t job;
+    memset(&job, 0, sizeof(_kgflags_batch_job_t));
+    job.argcs = argcs;
+    job.argvs = argvs;
+    job.results = out_results;
+    job.count = count;
+    job.stop_at_first_error = stop_at_first_error;
+
+    int chunks_count = 1;
+    job.chunk_size = count;
+    if (_kgflags_g.parallel_for != NULL && count > 1 && count >= _kgflags_g.parallel_min_items) {
+        chunks_count = count < KGFLAGS_MAX_PARALLEL_CHUNKS ? count : KGFLAGS_MAX_PARALLEL_CHUNKS;
+        job.chunk_size = (count + chunks_count - 1) / chunks_count;
+        chunks_count = (count + job.chunk_size - 1) / job.chunk_size;
+        _kgflags_g.parallel_for(chunks_count, _kgflags_validate_batch_job, &job, _kgflags_g.parallel_for_ctx);
+    } else {
+        _kgflags_validate_batch_job(&job, 0);
+    }
+
+    int invalid_count = 0;
+    for (int chunk = 0; chunk < chunks_count; chunk++) {
+        invalid_count += job.chunk_invalid_count[chunk];
+    }
+    return invalid_count;
+}
+
+void kgflags_exactly_one_of(const char *const *names, int names_count) {
+    _kgflags_add_constraint(KGFLAGS_CONSTRAINT_KIND_EXACTLY_ONE, names, names_count, NULL);
+}
+
+void kgflags_at_most_one_of(const char *const *names, int names_count) {
+    _kgflags_add_constraint(KGFLAGS_CONSTRAINT_KIND_AT_MOST_ONE, names, names_count, NULL);
+}
+
+void kgflags_requires(const char *name, const char *required_name) {
+    _kgflags_add_constraint(KGFLAGS_CONSTRAINT_KIND_REQUIRES, &name, 1, required_name);
+}
+
+void kgflags_set_short_name(const char *name, char short_name) {
+    _kgflags_ensure_registered();
+    if (_kgflags_g.frozen) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_SCHEMA_FROZEN, name, NULL, -1, -1);
+        return;
+    }
+    unsigned char c = (unsigned char)short_name;
+    if (c == '\0' || c == '-' || c == '=') {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_SHORT_NAME, name, NULL, -1, -1);
+        return;
+    }
+    _kgflags_flag_t *flag = _kgflags_get_flag(name, NULL);
+    if (flag == NULL) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG, name, NULL, -1, -1);
+        return;
+    }
+    _kgflags_flag_cold_t *cold = _kgflags_get_cold(flag);
+    if (_kgflags_g.short_flags[c] != 0 || cold->short_name != '\0') {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_DUPLICATE_FLAG, name, NULL, -1, -1);
+        return;
+    }
+    _kgflags_g.short_flags[c] = (int)(flag - _kgflags_g.flags) + 1;
+    cold->short_name = short_name;
+}
+
+void kgflags_set_permute_argv(bool permute) {
+    _kgflags_g.permute_argv = permute;
+}
+
+void kgflags_set_pass_through(bool pass_through, kgflags_arity_t arity, void *arity_ctx) {
+    _kgflags_g.pass_through = pass_through;
+    _kgflags_g.pass_through_arity = arity;
+    _kgflags_g.pass_through_arity_ctx = arity_ctx;
+    if (pass_through) {
+        _kgflags_g.permute_argv = true;
+    }
+}
+
+char** kgflags_get_pass_through_argv(const char *arg0, int *out_argc) {
+    if (!_kgflags_g.permute_argv || _kgflags_g.argv == NULL) {
+        *out_argc = 0;
+        return NULL;
+    }
+    // Slot for arg0 holds the last argument consumed by kgflags. If that's an item of an array flag, the
+    // flag's own argument (right before its items) is rotated into it, so array results stay valid.
+    int slot = _kgflags_g.non_flag_start - 1;
+    for (int i = 0; i < _kgflags_g.flags_count && slot > 0; i++) {
+        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        char ***items = _kgflags_get_array_items(flag);
+        if (items == NULL || flag->repeatable || *items <= _kgflags_g.argv || *items > _kgflags_g.argv + slot) {
+            continue;
+        }
+        int first = (int)(*items - _kgflags_g.argv);
+        int count = flag->kind == KGFLAGS_FLAG_KIND_STRING_ARRAY ? flag->result.string_array->_count
+            : flag->kind == KGFLAGS_FLAG_KIND_INT_ARRAY ? flag->result.int_array->_count : flag->result.double_array->_count;
+        if (first + count - 1 != slot) {
+            continue;
+        }
+        char *flag_arg = _kgflags_g.argv[first - 1];
+        memmove(_kgflags_g.argv + first - 1, _kgflags_g.argv + first, sizeof(char*) * (size_t)(slot - first + 1));
+        _kgflags_g.argv[slot] = flag_arg;
+        *items -= 1;
+        break;
+    }
+    char **res = _kgflags_g.argv + slot;
+    res[0] = (char*)arg0;
+    *out_argc = _kgflags_g.argc - _kgflags_g.non_flag_start + 1;
+    return res;
+}
+
+bool kgflags_parse(int argc, char **argv) {
+    bool ok = _kgflags_parse(argc, argv);
+    _kgflags_index_ranges(_kgflags_g.range_terms, KGFLAGS_MAX_RANGE_TERMS);
+    return ok;
+}
+
+static bool _kgflags_parse(int argc, char **argv) {
+    _kgflags_ensure_registered();
+
+    _kgflags_g.argc = argc;
+    _kgflags_g.argv = argv;
+    _kgflags_g.arg0 = argc > 0 && argv[0] != NULL ? argv[0] : "";
+    _kgflags_g.image_non_flags = NULL;
+    _kgflags_g.arg_cursor = 1;
+    _kgflags_g.non_flag_start = 1;
+
+    _kgflags_get_prefix();
+
+    _KGFLAGS_TRACE(KGFLAGS_TRACE_PARSE_BEGIN, -1, -1, 0, 0, argc);
+    _kgflags_g.declaration_errors_count = _kgflags_g.errors_count;
+    if (_kgflags_g.errors_count > 0) {
+        _KGFLAGS_TRACE(KGFLAGS_TRACE_PARSE_END, -1, -1, 0, 0, _kgflags_g.errors_count);
+        return false;
+    }
+
+    const char *arg = NULL;
+    while ((arg = _kgflags_consume_arg()) != NULL) {
+        int flag_begin = _kgflags_g.arg_cursor - 1;
+        _kgflags_arg_kind_t arg_kind = _kgflags_get_arg_kind(arg);
+        _kgflags_flag_t *flag = NULL;
+        if (arg_kind == KGFLAGS_ARG_KIND_NON_FLAG) {
+            _KGFLAGS_TRACE(KGFLAGS_TRACE_NON_FLAG, flag_begin, -1, 0, 0, 0);
+            _kgflags_add_non_flag_arg(arg);
+            continue;
+        } else if (arg_kind == KGFLAGS_ARG_KIND_SHORT) {
+            if (_kgflags_g.pass_through && _kgflags_g.short_flags[(unsigned char)arg[1]] == 0) {
+                int arity = _kgflags_get_pass_through_arity(arg, _kgflags_g.argc - _kgflags_g.arg_cursor);
+                _KGFLAGS_TRACE(KGFLAGS_TRACE_PASS_THROUGH, flag_begin, -1, 0, _kgflags_g.arg_cursor, arity);
+                _kgflags_g.arg_cursor += arity;
+                continue;
+            }
+            flag = _kgflags_parse_short_flags(arg);
+        } else {
+            const char *flag_name = arg + _kgflags_g.flag_prefix_length;
+            const char *inline_value = strchr(flag_name, '=');
+            unsigned int name_length = inline_value ? (unsigned int)(inline_value - flag_name) : (unsigned int)strlen(flag_name);
+            bool prefix_no = false;
+            flag = _kgflags_get_flag_n(flag_name, name_length, &prefix_no);
+            if (flag == NULL && _kgflags_g.pass_through) {
+                int arity = _kgflags_get_pass_through_arity(arg, _kgflags_g.argc - _kgflags_g.arg_cursor);
+                _KGFLAGS_TRACE(KGFLAGS_TRACE_PASS_THROUGH, flag_begin, -1, 0, _kgflags_g.arg_cursor, arity);
+                _kgflags_g.arg_cursor += arity;
+                continue; // stays in argv with non-flag arguments
+            } else if (flag == NULL) {
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG, flag_name, NULL, flag_begin, -1);
+            } else {
+                _kgflags_g.inline_value = inline_value ? inline_value + 1 : NULL;
+                _kgflags_process_flag(flag, prefix_no);
+            }
+        }
+        _kgflags_move_before_non_flag_args(flag, flag_begin, _kgflags_g.arg_cursor);
+    }
 
     _kgflags_assign_default_values();
+    _kgflags_check_constraints();
+    _KGFLAGS_TRACE(KGFLAGS_TRACE_PARSE_END, -1, -1, 0, 0, _kgflags_g.errors_count);
+
+    if (_kgflags_g.errors_count > 0) {
+        return false;
+    }
+
+    return true;
+}
+
+void kgflags_reset_values(void) {
+    if (_kgflags_g.arg0 == NULL) {
+        return;
+    }
+    for (int i = 0; i < _kgflags_g.touched_count; i++) {
+        _kgflags_flag_t *flag = &_kgflags_g.flags[_kgflags_g.touched_flags[i]];
+        flag->assigned = false;
+        flag->error = false;
+        switch (flag->kind) {
+            case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+                flag->result.string_array->_items = NULL;
+                flag->result.string_array->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_INT_ARRAY:
+                flag->result.int_array->_items = NULL;
+                flag->result.int_array->_count = 0;
+                flag->result.int_array->_has_ranges = false;
+                flag->result.int_array->_terms = NULL;
+                break;
+            case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+                flag->result.double_array->_items = NULL;
+                flag->result.double_array->_count = 0;
+                flag->result.double_array->_has_ranges = false;
+                flag->result.double_array->_terms = NULL;
+                break;
+            case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+                flag->result.int64_array->_items = NULL;
+                flag->result.int64_array->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+                flag->result.uint64_array->_items = NULL;
+                flag->result.uint64_array->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+                flag->result.size_array->_items = NULL;
+                flag->result.size_array->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+                flag->result.duration_array->_items = NULL;
+                flag->result.duration_array->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_STRING_LIST:
+                flag->result.string_list->_arg = NULL;
+                flag->result.string_list->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_INT_LIST:
+                flag->result.int_list->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+                flag->result.double_list->_count = 0;
+                break;
+            case KGFLAGS_FLAG_KIND_CUSTOM_LIST:
+                flag->result.custom_list->_arg = NULL;
+                flag->result.custom_list->_count = 0;
+                break;
+            default:
+                break;
+        }
+    }
+    _kgflags_g.touched_count = 0;
+    _kgflags_g.non_flag_count = 0;
+    _kgflags_g.image_non_flags = NULL;
+    _kgflags_g.errors_count = _kgflags_g.declaration_errors_count;
+}
+
+bool kgflags_reload(int argc, char **argv, kgflags_snapshot_t *out_snapshot) {
+    memset(out_snapshot, 0, sizeof(kgflags_snapshot_t));
+    out_snapshot->_count = _kgflags_g.flags_count;
+
+    size_t storage_size = 0;
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        storage_size += _kgflags_get_storage_size(&_kgflags_g.flags[i]);
+    }
+    if (storage_size > sizeof(out_snapshot->_storage)) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_SNAPSHOT_STORAGE_FULL, NULL, NULL, -1, -1);
+        return false;
+    }
+
+    // Results and list storage are temporarily redirected to the snapshot so it goes through exactly the same
+    // path as kgflags_parse, while older snapshots keep their own items.
+    _kgflags_result_t saved_results[KGFLAGS_MAX_FLAGS];
+    void *saved_storage[KGFLAGS_MAX_FLAGS];
+    char *storage = (char*)out_snapshot->_storage;
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        saved_results[i] = flag->result;
+        saved_storage[i] = flag->list_storage;
+        _kgflags_redirect_result(flag, out_snapshot, i);
+        if (flag->list_storage != NULL) {
+            flag->list_storage = storage;
+            storage += _kgflags_get_storage_size(flag);
+        }
+    }
+
+    _kgflags_parse_state_t saved_state;
+    _kgflags_save_parse_state(&saved_state);
+    kgflags_reset_values();
+    bool ok = _kgflags_parse(argc, argv);
+    // Range terms are indexed into storage left after list items (it stays 8-byte aligned), arrays whose
+    // terms don't fit are walked from the start by get_item like before.
+    size_t spare = sizeof(out_snapshot->_storage) - (size_t)(storage - (char*)out_snapshot->_storage);
+    _kgflags_index_ranges((_kgflags_range_entry_t*)(void*)storage, (int)(spare / sizeof(_kgflags_range_entry_t)));
+
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_g.flags[i].result = saved_results[i];
+        _kgflags_g.flags[i].list_storage = saved_storage[i];
+    }
+    _kgflags_restore_parse_state(&saved_state, ok);
+    return ok;
+}
+
+static void _kgflags_save_parse_state(_kgflags_parse_state_t *state) {
+    state->argc = _kgflags_g.argc;
+    state->argv = _kgflags_g.argv;
+    state->arg0 = _kgflags_g.arg0;
+    state->image_non_flags = _kgflags_g.image_non_flags;
+    state->image_base = _kgflags_g.image_base;
+    state->arg_cursor = _kgflags_g.arg_cursor;
+    state->non_flag_start = _kgflags_g.non_flag_start;
+    state->non_flag_count = _kgflags_g.non_flag_count;
+    if (_kgflags_g.image_non_flags == NULL && _kgflags_g.non_flag_count <= KGFLAGS_MAX_NON_FLAG_ARGS) {
+        memcpy(state->non_flag_args, _kgflags_g.non_flag_args, sizeof(const char*) * (size_t)_kgflags_g.non_flag_count);
+    }
+    state->touched_count = _kgflags_g.touched_count;
+    memcpy(state->touched_flags, _kgflags_g.touched_flags, sizeof(int) * (size_t)_kgflags_g.touched_count);
+    memcpy(state->assigned_bits, _kgflags_g.assigned_bits, sizeof(state->assigned_bits));
+    memcpy(state->error_bits, _kgflags_g.error_bits, sizeof(state->error_bits));
+    memset(state->flag_assigned, 0, sizeof(state->flag_assigned));
+    memset(state->flag_error, 0, sizeof(state->flag_error));
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        state->flag_assigned[i / 64] |= (uint64_t)_kgflags_g.flags[i].assigned << (i % 64);
+        state->flag_error[i / 64] |= (uint64_t)_kgflags_g.flags[i].error << (i % 64);
+    }
+    state->errors_count = _kgflags_g.errors_count;
+    state->declaration_errors_count = _kgflags_g.declaration_errors_count;
+    memcpy(state->errors, _kgflags_g.errors, sizeof(_kgflags_error_t) * (size_t)_kgflags_g.errors_count);
+}
+
+// Errors are restored only if restore_errors is set, so a failed reload's errors can be read afterwards.
+static void _kgflags_restore_parse_state(const _kgflags_parse_state_t *state, bool restore_errors) {
+    _kgflags_g.argc = state->argc;
+    _kgflags_g.argv = state->argv;
+    _kgflags_g.arg0 = state->arg0;
+    _kgflags_g.image_non_flags = state->image_non_flags;
+    _kgflags_g.image_base = state->image_base;
+    _kgflags_g.arg_cursor = state->arg_cursor;
+    _kgflags_g.non_flag_start = state->non_flag_start;
+    _kgflags_g.non_flag_count = state->non_flag_count;
+    if (state->image_non_flags == NULL && state->non_flag_count <= KGFLAGS_MAX_NON_FLAG_ARGS) {
+        memcpy(_kgflags_g.non_flag_args, state->non_flag_args, sizeof(const char*) * (size_t)state->non_flag_count);
+    }
+    _kgflags_g.touched_count = state->touched_count;
+    memcpy(_kgflags_g.touched_flags, state->touched_flags, sizeof(int) * (size_t)state->touched_count);
+    memcpy(_kgflags_g.assigned_bits, state->assigned_bits, sizeof(_kgflags_g.assigned_bits));
+    memcpy(_kgflags_g.error_bits, state->error_bits, sizeof(_kgflags_g.error_bits));
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_g.flags[i].assigned = (state->flag_assigned[i / 64] >> (i % 64)) & 1;
+        _kgflags_g.flags[i].error = (state->flag_error[i / 64] >> (i % 64)) & 1;
+    }
+    if (restore_errors) {
+        _kgflags_g.errors_count = state->errors_count;
+        _kgflags_g.declaration_errors_count = state->declaration_errors_count;
+        memcpy(_kgflags_g.errors, state->errors, sizeof(_kgflags_error_t) * (size_t)state->errors_count);
+    }
+}
+
+int kgflags_snapshot_diff(const kgflags_snapshot_t *a, const kgflags_snapshot_t *b, int *out_ids, int cap) {
+    int changed_count = 0;
+    int count = a->_count < b->_count ? a->_count : b->_count;
+    for (int i = 0; i < count; i++) {
+        bool equal = true;
+        switch (_kgflags_g.flags[i].kind) {
+            case KGFLAGS_FLAG_KIND_STRING:
+                equal = _kgflags_strings_equal(a->_values[i].string_value, b->_values[i].string_value);
+                break;
+            case KGFLAGS_FLAG_KIND_BOOL:
+                equal = a->_values[i].bool_value == b->_values[i].bool_value;
+                break;
+            case KGFLAGS_FLAG_KIND_INT:
+            case KGFLAGS_FLAG_KIND_CHOICE:
+                equal = a->_values[i].int_value == b->_values[i].int_value;
+                break;
+            case KGFLAGS_FLAG_KIND_DOUBLE:
+                equal = memcmp(&a->_values[i].double_value, &b->_values[i].double_value, sizeof(double)) == 0;
+                break;
+            case KGFLAGS_FLAG_KIND_INT64:
+            case KGFLAGS_FLAG_KIND_DURATION:
+                equal = a->_values[i].int64_value == b->_values[i].int64_value;
+                break;
+            case KGFLAGS_FLAG_KIND_UINT64:
+            case KGFLAGS_FLAG_KIND_SIZE:
+                equal = a->_values[i].uint64_value == b->_values[i].uint64_value;
+                break;
+            case KGFLAGS_FLAG_KIND_STRING_LIST: {
+                const kgflags_string_list_t *la = &a->_values[i].string_list;
+                const kgflags_string_list_t *lb = &b->_values[i].string_list;
+                equal = la->_count == lb->_count;
+                for (int j = 0; equal && j < la->_count; j++) {
+                    equal = la->_spans[j].length == lb->_spans[j].length
+                        && memcmp(la->_arg + la->_spans[j].offset, lb->_arg + lb->_spans[j].offset, (size_t)la->_spans[j].length) == 0;
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT_LIST:
+                equal = a->_values[i].int_list._count == b->_values[i].int_list._count
+                    && memcmp(a->_values[i].int_list._items, b->_values[i].int_list._items, sizeof(int) * (size_t)a->_values[i].int_list._count) == 0;
+                break;
+            case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+                equal = a->_values[i].double_list._count == b->_values[i].double_list._count
+                    && memcmp(a->_values[i].double_list._items, b->_values[i].double_list._items, sizeof(double) * (size_t)a->_values[i].double_list._count) == 0;
+                break;
+            case KGFLAGS_FLAG_KIND_CUSTOM_LIST: {
+                size_t elem_size = _kgflags_g.custom_kinds[_kgflags_g.flags[i].custom_kind].elem_size;
+                equal = a->_values[i].custom_list._count == b->_values[i].custom_list._count
+                    && memcmp(a->_values[i].custom_list._items, b->_values[i].custom_list._items, elem_size * (size_t)a->_values[i].custom_list._count) == 0;
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+                equal = _kgflags_values_equal(a->_values[i].int64_array._items, a->_values[i].int64_array._count,
+                                              b->_values[i].int64_array._items, b->_values[i].int64_array._count, sizeof(int64_t));
+                break;
+            case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+                equal = _kgflags_values_equal(a->_values[i].uint64_array._items, a->_values[i].uint64_array._count,
+                                              b->_values[i].uint64_array._items, b->_values[i].uint64_array._count, sizeof(uint64_t));
+                break;
+            case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+                equal = _kgflags_values_equal(a->_values[i].size_array._items, a->_values[i].size_array._count,
+                                              b->_values[i].size_array._items, b->_values[i].size_array._count, sizeof(uint64_t));
+                break;
+            case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+                equal = _kgflags_values_equal(a->_values[i].duration_array._items, a->_values[i].duration_array._count,
+                                              b->_values[i].duration_array._items, b->_values[i].duration_array._count, sizeof(int64_t));
+                break;
+            case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+            case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+                equal = _kgflags_items_equal(a->_values[i].string_array._items, a->_values[i].string_array._count,
+                                             b->_values[i].string_array._items, b->_values[i].string_array._count);
+                break;
+            default:
+                break;
+        }
+        if (equal) {
+            continue;
+        }
+        if (changed_count < cap) {
+            out_ids[changed_count] = i;
+        }
+        changed_count++;
+    }
+    return changed_count;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+void kgflags_snapshot_publish(kgflags_snapshot_t **slot, kgflags_snapshot_t *snapshot) {
+    __atomic_store_n(slot, snapshot, __ATOMIC_RELEASE);
+}
+
+const kgflags_snapshot_t* kgflags_snapshot_acquire(kgflags_snapshot_t *const *slot) {
+    return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+#else
+// MSVC gives volatile accesses acquire/release semantics (/volatile:ms, default on x86 and x64).
+void kgflags_snapshot_publish(kgflags_snapshot_t **slot, kgflags_snapshot_t *snapshot) {
+    *(kgflags_snapshot_t *volatile *)slot = snapshot;
+}
+
+const kgflags_snapshot_t* kgflags_snapshot_acquire(kgflags_snapshot_t *const *slot) {
+    return *(kgflags_snapshot_t *const volatile *)slot;
+}
+#endif
+
+int kgflags_get_flag_id(const char *name) {
+    _kgflags_ensure_registered();
+    unsigned int length = 0;
+    unsigned int hash = _kgflags_hash(name, &length);
+    return _kgflags_find_flag(name, length, hash);
+}
+
+const char* kgflags_snapshot_get_string(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return snapshot->_values[id].string_value;
+}
+
+bool kgflags_snapshot_get_bool(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return false;
+    }
+    return snapshot->_values[id].bool_value;
+}
+
+int kgflags_snapshot_get_int(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return 0;
+    }
+    return snapshot->_values[id].int_value;
+}
+
+double kgflags_snapshot_get_double(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return 0.0;
+    }
+    return snapshot->_values[id].double_value;
+}
+
+const kgflags_string_array_t* kgflags_snapshot_get_string_array(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].string_array;
+}
+
+const kgflags_int_array_t* kgflags_snapshot_get_int_array(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].int_array;
+}
+
+const kgflags_double_array_t* kgflags_snapshot_get_double_array(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].double_array;
+}
+
+int64_t kgflags_snapshot_get_int64(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return 0;
+    }
+    return snapshot->_values[id].int64_value;
+}
+
+uint64_t kgflags_snapshot_get_uint64(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return 0;
+    }
+    return snapshot->_values[id].uint64_value;
+}
+
+const kgflags_int64_array_t* kgflags_snapshot_get_int64_array(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].int64_array;
+}
+
+const kgflags_uint64_array_t* kgflags_snapshot_get_uint64_array(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].uint64_array;
+}
+
+const kgflags_size_array_t* kgflags_snapshot_get_size_array(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].size_array;
+}
+
+const kgflags_duration_array_t* kgflags_snapshot_get_duration_array(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].duration_array;
+}
+
+const kgflags_string_list_t* kgflags_snapshot_get_string_list(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].string_list;
+}
+
+const kgflags_int_list_t* kgflags_snapshot_get_int_list(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].int_list;
+}
+
+const kgflags_double_list_t* kgflags_snapshot_get_double_list(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].double_list;
+}
+
+const kgflags_custom_list_t* kgflags_snapshot_get_custom_list(const kgflags_snapshot_t *snapshot, int id) {
+    if (id < 0 || id >= snapshot->_count) {
+        return NULL;
+    }
+    return &snapshot->_values[id].custom_list;
+}
+
+void kgflags_print_errors(void) {
+    for (int i = 0; i < _kgflags_g.errors_count; i++) {
+        _kgflags_error_t *err = &_kgflags_g.errors[i];
+        switch (err->kind) {
+            case KGFLAGS_ERROR_KIND_MISSING_VALUE: {
+                fprintf(stderr, "Missing value for flag: %s%s\n", _kgflags_g.flag_prefix,  err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_UNKNOWN_FLAG: {
+                fprintf(stderr, "Unrecognized flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG: {
+                fprintf(stderr, "Unassigned required flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_INT: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected integer)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_DOUBLE: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected number)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS: {
+                fprintf(stderr, "Too many flags declared.");
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_TOO_MANY_NON_FLAG_ARGS: {
+                fprintf(stderr, "Too many non-flag arguments passed to program.");
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT: {
+                fprintf(stderr, "Multiple assignment of flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_DUPLICATE_FLAG: {
+                fprintf(stderr, "Redeclaration of flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_PREFIX_NO: {
+                fprintf(stderr, "Used \"no-\" prefix when declaring boolean flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_INT64: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected 64-bit integer)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_UINT64: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected unsigned 64-bit integer)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_SIZE: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected size, e.g. 4096, 64K or 4MiB)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_DURATION: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected duration, e.g. 250us, 1.5s or 2h)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_CHOICE: {
+                _kgflags_flag_t *flag = _kgflags_get_flag(err->flag_name, NULL);
+                if (err->arg == NULL || flag == NULL) {
+                    fprintf(stderr, "Invalid default choice for flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                    break;
+                }
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected one of: ", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                _kgflags_print_choices(flag);
+                fprintf(stderr, ")\n");
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_TOO_MANY_CHOICES: {
+                fprintf(stderr, "Invalid number of choices for flag: %s%s (at most %d choices in total)\n", _kgflags_g.flag_prefix, err->flag_name, KGFLAGS_MAX_CHOICES);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS: {
+                fprintf(stderr, "Too many items for flag: %s%s (at most %d)\n", _kgflags_g.flag_prefix, err->flag_name, err->limit);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_UNEXPECTED_VALUE: {
+                fprintf(stderr, "Unexpected value for flag: %s%s (got %s)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS: {
+                fprintf(stderr, "Flags can't be used together: %s%s, %s%s\n", _kgflags_g.flag_prefix, err->flag_name, _kgflags_g.flag_prefix, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_MISSING_ONE_OF: {
+                const uint64_t *bits = _kgflags_g.constraints[err->constraint].flags;
+                fprintf(stderr, "Missing one of flags:");
+                for (int w = 0; w < _KGFLAGS_BITSET_WORDS; w++) {
+                    for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+                        int index = w * 64 + _kgflags_lowest_bit(word);
+                        fprintf(stderr, " %s%s", _kgflags_g.flag_prefix, _kgflags_g.flags[index].name);
+                    }
+                }
+                fprintf(stderr, "\n");
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_MISSING_DEPENDENCY: {
+                fprintf(stderr, "Flag %s%s requires flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name, _kgflags_g.flag_prefix, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_TOO_MANY_CONSTRAINTS: {
+                fprintf(stderr, "Too many flag constraints declared.\n");
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_UNKNOWN_SHORT_FLAG: {
+                fprintf(stderr, "Unrecognized flag: %c%c (in %s)\n", _kgflags_g.flag_prefix[0], err->arg[err->char_index], err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_SHORT_NAME: {
+                fprintf(stderr, "Invalid short name for flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_SCHEMA_FROZEN: {
+                if (err->flag_name == NULL) {
+                    fprintf(stderr, "Flag constraint declared after freezing flags.\n");
+                    break;
+                }
+                fprintf(stderr, "Flag declared after freezing flags: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_PATH_NOT_FOUND: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected existing path)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_PATH_NOT_FILE: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected regular file)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_PATH_NOT_DIRECTORY: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected directory)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_PATH_NOT_READABLE: {
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected readable path)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE: {
+                _kgflags_flag_t *flag = _kgflags_get_flag(err->flag_name, NULL);
+                if (err->arg == NULL || flag == NULL) {
+                    fprintf(stderr, "Unregistered custom kind of flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
+                    break;
+                }
+                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected %s)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg,
+                        _kgflags_g.custom_kinds[flag->custom_kind].type_name);
+                break;
+            }
+            case KGFLAGS_ERROR_KIND_SNAPSHOT_STORAGE_FULL: {
+                fprintf(stderr, "Items of list and repeatable flags don't fit into a snapshot (KGFLAGS_SNAPSHOT_STORAGE_SIZE is %d bytes).\n", KGFLAGS_SNAPSHOT_STORAGE_SIZE);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+int kgflags_get_error_count(void) {
+    return _kgflags_g.errors_count;
+}
+
+bool kgflags_get_error(int at, kgflags_error_info_t *out_info) {
+    if (at < 0 || at >= _kgflags_g.errors_count) {
+        return false;
+    }
+    const _kgflags_error_t *err = &_kgflags_g.errors[at];
+    out_info->kind = err->kind;
+    out_info->flag_name = err->flag_name;
+    out_info->value = err->arg;
+    out_info->arg_index = err->arg_index;
+    out_info->item_index = err->item_index;
+    out_info->limit = err->limit;
+    out_info->char_index = err->char_index;
+    return true;
+}
+
+int kgflags_dump(char *buf, size_t cap, kgflags_dump_format_t fmt) {
+    _kgflags_writer_t writer;
+    writer.buf = buf;
+    writer.cap = cap;
+    writer.len = 0;
+    writer.file = NULL;
+
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        const _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        const char *source = "unset";
+        if (flag->assigned) {
+            source = "argv";
+        } else if (!flag->required) {
+            source = "default";
+        }
+        if (fmt == KGFLAGS_DUMP_FORMAT_JSON_LINES) {
+            _kgflags_write_string(&writer, "{\"name\":");
+            _kgflags_write_escaped(&writer, flag->name, fmt);
+            _kgflags_write_string(&writer, ",\"source\":\"");
+            _kgflags_write_string(&writer, source);
+            _kgflags_write_string(&writer, "\",\"value\":");
+            if (flag->assigned || !flag->required) {
+                _kgflags_write_flag_value(&writer, flag, fmt);
+            } else {
+                _kgflags_write_string(&writer, "null");
+            }
+            _kgflags_write_string(&writer, "}\n");
+        } else {
+            _kgflags_write_string(&writer, source);
+            _kgflags_write_string(&writer, " ");
+            _kgflags_write_escaped(&writer, flag->name, fmt);
+            _kgflags_write_string(&writer, "=");
+            if (flag->assigned || !flag->required) {
+                _kgflags_write_flag_value(&writer, flag, fmt);
+            }
+            _kgflags_write_string(&writer, "\n");
+        }
+    }
+
+    if (cap > 0) {
+        buf[writer.len < cap ? writer.len : cap - 1] = '\0';
+    }
+    return (int)writer.len;
+}
+
+int kgflags_serialize_argv(char *buf, size_t cap, char **argv_out, int *argc_out) {
+    _kgflags_argv_writer_t argv_writer;
+    memset(&argv_writer, 0, sizeof(_kgflags_argv_writer_t));
+    argv_writer.writer.buf = buf;
+    argv_writer.writer.cap = cap;
+    argv_writer.argv = argv_out;
+    argv_writer.argv_cap = *argc_out;
+    _kgflags_writer_t *writer = &argv_writer.writer;
+    const char *prefix = _kgflags_get_prefix();
+
+    _kgflags_write_string(writer, _kgflags_g.arg0 != NULL ? _kgflags_g.arg0 : "");
+    _kgflags_end_arg(&argv_writer);
+    for (int i = 0; i < kgflags_get_non_flag_args_count(); i++) {
+        _kgflags_write_string(writer, kgflags_get_non_flag_arg(i));
+        _kgflags_end_arg(&argv_writer);
+    }
+
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        const _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        if (!flag->assigned || (!flag->required && _kgflags_equals_default(flag))) {
+            continue;
+        }
+        _kgflags_write_string(writer, prefix);
+        if (flag->kind == KGFLAGS_FLAG_KIND_BOOL) {
+            _kgflags_write_string(writer, *flag->result.bool_value ? "" : "no-");
+            _kgflags_write_string(writer, flag->name);
+            _kgflags_end_arg(&argv_writer);
+        } else if (flag->repeatable) {
+            char **items = NULL;
+            int count = 0;
+            _kgflags_get_array(flag, &items, &count);
+            for (int j = 0; j < count; j++) {
+                if (j > 0) {
+                    _kgflags_write_string(writer, prefix);
+                }
+                _kgflags_write_string(writer, flag->name);
+                _kgflags_write_string(writer, "=");
+                _kgflags_write_string(writer, items[j]);
+                _kgflags_end_arg(&argv_writer);
+            }
+        } else if (_kgflags_is_typed_array(flag->kind)) {
+            _kgflags_write_string(writer, flag->name);
+            _kgflags_end_arg(&argv_writer);
+            const void *items = NULL;
+            int count = 0;
+            _kgflags_get_typed_array(flag, &items, &count);
+            for (int j = 0; j < count; j++) {
+                _kgflags_write_typed_item(writer, flag, j);
+                _kgflags_end_arg(&argv_writer);
+            }
+        } else if (!_kgflags_takes_inline_value(flag->kind)) {
+            _kgflags_write_string(writer, flag->name);
+            _kgflags_end_arg(&argv_writer);
+            char **items = NULL;
+            int count = 0;
+            _kgflags_get_array(flag, &items, &count);
+            for (int j = 0; j < count; j++) {
+                _kgflags_write_string(writer, items[j]);
+                _kgflags_end_arg(&argv_writer);
+            }
+        } else {
+            _kgflags_write_string(writer, flag->name);
+            _kgflags_write_string(writer, "=");
+            _kgflags_write_arg_value(writer, flag);
+            _kgflags_end_arg(&argv_writer);
+        }
+    }
+
+    if (argv_writer.argc < argv_writer.argv_cap) {
+        argv_out[argv_writer.argc] = NULL;
+    }
+    *argc_out = argv_writer.argc;
+    return (int)writer->len;
+}
+
+uint64_t kgflags_get_schema_hash(void) {
+    _kgflags_ensure_registered();
+    if (_kgflags_g.frozen) {
+        return _kgflags_g.schema_hash;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        const _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        int32_t fields[7] = { (int32_t)flag->kind, flag->required, flag->list_delimiter, flag->choices_count, flag->repeatable,
+                              flag->path_checks, flag->custom_kind };
+        hash = _kgflags_hash_bytes(hash, flag->name, strlen(flag->name) + 1);
+        hash = _kgflags_hash_bytes(hash, fields, sizeof(fields));
+        for (int j = 0; j < flag->choices_count; j++) {
+            hash = _kgflags_hash_bytes(hash, flag->choices[j], strlen(flag->choices[j]) + 1);
+        }
+    }
+    return hash;
+}
+
+size_t kgflags_image_write(void *buf, size_t cap) {
+    _kgflags_writer_t writer;
+    writer.buf = (char*)buf;
+    writer.cap = cap;
+    writer.len = 0;
+    writer.file = NULL;
+
+    int non_flag_count = kgflags_get_non_flag_args_count();
+    size_t records_offset = sizeof(_kgflags_image_header_t);
+    size_t non_flags_offset = records_offset + sizeof(_kgflags_image_record_t) * (size_t)_kgflags_g.flags_count;
+    _kgflags_image_reserve(&writer, non_flags_offset + sizeof(uint32_t) * (size_t)non_flag_count, 1);
+
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_image_record_t record;
+        _kgflags_image_write_record(&writer, &_kgflags_g.flags[i], &record);
+        _kgflags_write_at(&writer, records_offset + sizeof(_kgflags_image_record_t) * (size_t)i, &record, sizeof(record));
+    }
+    for (int i = 0; i < non_flag_count; i++) {
+        uint32_t offset = _kgflags_image_append_string(&writer, kgflags_get_non_flag_arg(i));
+        _kgflags_write_at(&writer, non_flags_offset + sizeof(uint32_t) * (size_t)i, &offset, sizeof(offset));
+    }
+    uint32_t arg0_offset = _kgflags_image_append_string(&writer, _kgflags_g.arg0 != NULL ? _kgflags_g.arg0 : "");
+
+    _kgflags_image_header_t header;
+    memset(&header, 0, sizeof(_kgflags_image_header_t));
+    header.magic = _KGFLAGS_IMAGE_MAGIC;
+    header.version = _KGFLAGS_IMAGE_VERSION;
+    header.schema_hash = kgflags_get_schema_hash();
+    header.size = writer.len;
+    header.flags_count = (uint32_t)_kgflags_g.flags_count;
+    header.non_flag_count = (uint32_t)non_flag_count;
+    header.arg0_offset = arg0_offset;
+    _kgflags_write_at(&writer, 0, &header, sizeof(header));
+    return writer.len <= UINT32_MAX ? writer.len : 0;
+}
+
+bool kgflags_image_attach(const void *image, size_t size, char **items_storage, int items_capacity) {
+    return _kgflags_image_attach(image, size, items_storage, items_capacity, kgflags_get_schema_hash(), false);
+}
+
+static bool _kgflags_image_attach(const void *image, size_t size, char **items_storage, int items_capacity,
+                                  uint64_t schema_hash, bool check_paths) {
+    const char *base = (const char*)image;
+    _kgflags_image_header_t header;
+    if (size < sizeof(_kgflags_image_header_t)) {
+        return false;
+    }
+    memcpy(&header, base, sizeof(header));
+    if (header.magic != _KGFLAGS_IMAGE_MAGIC || header.version != _KGFLAGS_IMAGE_VERSION || header.size > size
+    || header.schema_hash != schema_hash || header.flags_count != (uint32_t)_kgflags_g.flags_count) {
+        return false;
+    }
+    size = (size_t)header.size;
+    const _kgflags_image_record_t *records = (const _kgflags_image_record_t*)(base + sizeof(_kgflags_image_header_t));
+    size_t non_flags_offset = sizeof(_kgflags_image_header_t) + sizeof(_kgflags_image_record_t) * header.flags_count;
+    if (non_flags_offset > size || header.non_flag_count > (size - non_flags_offset) / sizeof(uint32_t)
+    || header.arg0_offset == 0 || !_kgflags_image_string_ok(base, size, header.arg0_offset)) {
+        return false;
+    }
+    // Non-flag arguments are read through the image's offset table, so there can be more than
+    // KGFLAGS_MAX_NON_FLAG_ARGS of them (permuted parses don't have that limit either).
+    for (uint32_t i = 0; i < header.non_flag_count; i++) {
+        uint32_t offset = 0;
+        memcpy(&offset, base + non_flags_offset + sizeof(uint32_t) * i, sizeof(offset));
+        if (offset == 0 || !_kgflags_image_string_ok(base, size, offset)) {
+            return false;
+        }
+    }
+
+    // Everything is checked before binding, so a bad image leaves flags untouched.
+    int items_count = 0;
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        const _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        if (!_kgflags_image_record_ok(flag, &records[i], base, size)) {
+            return false;
+        }
+        if (check_paths && flag->path_checks && records[i].assigned && !_kgflags_image_paths_ok(flag, &records[i], base)) {
+            return false;
+        }
+        if (!_kgflags_takes_inline_value(flag->kind) && flag->kind != KGFLAGS_FLAG_KIND_BOOL && !_kgflags_is_typed_array(flag->kind)) {
+            items_count += (int)records[i].count;
+        }
+    }
+    if (items_count > items_capacity) {
+        return false;
+    }
+
+    items_count = 0;
+    _kgflags_g.touched_count = 0;
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        const _kgflags_image_record_t *record = &records[i];
+        const char *str = record->offset ? base + record->offset : NULL;
+        flag->assigned = record->assigned != 0;
+        flag->error = false;
+        if (flag->assigned) {
+            _kgflags_mark_touched(flag);
+        }
+        switch (flag->kind) {
+            case KGFLAGS_FLAG_KIND_STRING:
+                *flag->result.string_value = str;
+                break;
+            case KGFLAGS_FLAG_KIND_BOOL:
+                *flag->result.bool_value = record->value.int64_value != 0;
+                break;
+            case KGFLAGS_FLAG_KIND_INT:
+            case KGFLAGS_FLAG_KIND_CHOICE:
+                *flag->result.int_value = (int)record->value.int64_value;
+                break;
+            case KGFLAGS_FLAG_KIND_DOUBLE:
+                *flag->result.double_value = record->value.double_value;
+                break;
+            case KGFLAGS_FLAG_KIND_INT64:
+            case KGFLAGS_FLAG_KIND_DURATION:
+                *flag->result.int64_value = record->value.int64_value;
+                break;
+            case KGFLAGS_FLAG_KIND_UINT64:
+            case KGFLAGS_FLAG_KIND_SIZE:
+                *flag->result.uint64_value = record->value.uint64_value;
+                break;
+            case KGFLAGS_FLAG_KIND_STRING_LIST:
+                flag->result.string_list->_arg = str;
+                flag->result.string_list->_spans = (kgflags_span_t*)(record->spans_offset ? base + record->spans_offset : NULL);
+                flag->result.string_list->_count = (int)record->count;
+                break;
+            case KGFLAGS_FLAG_KIND_INT_LIST:
+                flag->result.int_list->_items = (int*)str;
+                flag->result.int_list->_count = (int)record->count;
+                break;
+            case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+                flag->result.double_list->_items = (double*)str;
+                flag->result.double_list->_count = (int)record->count;
+                break;
+            case KGFLAGS_FLAG_KIND_CUSTOM_LIST: {
+                kgflags_custom_list_t *list = flag->result.custom_list;
+                list->_arg = str;
+                list->_count = (int)record->count;
+                list->_items = record->spans_offset ? (void*)(base + record->spans_offset) : NULL;
+                if (flag->list_delimiter == '\0' && list->_count > 0) {
+                    // Single values are read by caller from its storage, not through the list.
+                    memcpy(flag->list_storage, list->_items, _kgflags_g.custom_kinds[flag->custom_kind].elem_size);
+                    list->_items = flag->list_storage;
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+                _kgflags_set_typed_array(flag, record->count > 0 ? (void*)str : NULL, (int)record->count);
+                break;
+            default: {
+                char **items = record->count > 0 ? items_storage + items_count : NULL;
+                for (uint32_t j = 0; j < record->count; j++) {
+                    uint32_t offset = 0;
+                    memcpy(&offset, str + sizeof(uint32_t) * j, sizeof(offset));
+                    items[j] = (char*)(base + offset);
+                }
+                items_count += (int)record->count;
+                _kgflags_set_array(flag, items, (int)record->count);
+                _kgflags_set_ranges_length(flag, (int)record->value.int64_value);
+                break;
+            }
+        }
+    }
+
+    _kgflags_g.argv = NULL; // non-flag arguments are read from the image even with permute_argv
+    _kgflags_g.arg0 = base + header.arg0_offset;
+    _kgflags_g.non_flag_count = (int)header.non_flag_count;
+    _kgflags_g.image_base = base;
+    _kgflags_g.image_non_flags = base + non_flags_offset;
+    _kgflags_index_ranges(_kgflags_g.range_terms, KGFLAGS_MAX_RANGE_TERMS);
+    return true;
+}
+
+uint64_t kgflags_get_cache_key(int argc, char **argv) {
+    return _kgflags_get_cache_key(kgflags_get_schema_hash(), argc, argv);
+}
+
+static uint64_t _kgflags_get_cache_key(uint64_t schema_hash, int argc, char **argv) {
+    uint64_t hash = schema_hash;
+    const char *prefix = _kgflags_get_prefix();
+    bool modes[2] = { _kgflags_g.permute_argv, _kgflags_g.pass_through };
+    hash = _kgflags_hash_bytes(hash, prefix, strlen(prefix) + 1);
+    hash = _kgflags_hash_bytes(hash, modes, sizeof(modes));
+    char short_names[KGFLAGS_MAX_FLAGS];
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        short_names[i] = _kgflags_g.flag_colds[i].short_name;
+    }
+    hash = _kgflags_hash_bytes(hash, short_names, (size_t)_kgflags_g.flags_count);
+    for (int i = 1; i < argc; i++) {
+        hash = _kgflags_hash_bytes(hash, argv[i], strlen(argv[i]) + 1);
+    }
+    return hash;
+}
+
+size_t kgflags_cache_write(void *buf, size_t cap, int argc, char **argv) {
+    size_t header_size = sizeof(_kgflags_cache_header_t);
+    bool header_fits = cap >= header_size;
+    size_t image_size = kgflags_image_write(header_fits ? (char*)buf + header_size : NULL, header_fits ? cap - header_size : 0);
+    if (image_size == 0) {
+        return 0;
+    }
+    if (header_size + image_size <= cap) {
+        _kgflags_cache_header_t header;
+        memset(&header, 0, sizeof(_kgflags_cache_header_t));
+        header.magic = _KGFLAGS_CACHE_MAGIC;
+        header.version = _KGFLAGS_CACHE_VERSION;
+        header.key = kgflags_get_cache_key(argc, argv);
+        header.checksum = _kgflags_hash_bytes(14695981039346656037ull, (char*)buf + header_size, image_size);
+        header.image_size = image_size;
+        memcpy(buf, &header, sizeof(header));
+    }
+    return header_size + image_size;
+}
+
+bool kgflags_cache_attach(const void *cache, size_t size, int argc, char **argv, char **items_storage, int items_capacity) {
+    const char *base = (const char*)cache;
+    size_t header_size = sizeof(_kgflags_cache_header_t);
+    _kgflags_cache_header_t header;
+    if (size < header_size) {
+        return false;
+    }
+    memcpy(&header, base, sizeof(header));
+    // Schema hash is computed once, it's needed both for the key and by the image check.
+    uint64_t schema_hash = kgflags_get_schema_hash();
+    if (header.magic != _KGFLAGS_CACHE_MAGIC || header.version != _KGFLAGS_CACHE_VERSION
+    || header.image_size != size - header_size || header.key != _kgflags_get_cache_key(schema_hash, argc, argv)) {
+        return false;
+    }
+    if (header.checksum != _kgflags_hash_bytes(14695981039346656037ull, base + header_size, header.image_size)) {
+        return false;
+    }
+    return _kgflags_image_attach(base + header_size, header.image_size, items_storage, items_capacity, schema_hash, true);
+}
+
+bool kgflags_cache_save(const char *path, int argc, char **argv, void *buf, size_t cap) {
+    size_t size = kgflags_cache_write(buf, cap, argc, argv);
+    char tmp_path[FILENAME_MAX];
+    if (size == 0 || size > cap || strlen(path) + sizeof(".tmp") > sizeof(tmp_path)) {
+        return false;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(buf, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+#if defined(_WIN32)
+    // rename doesn't replace existing files on Windows, removing path first would let readers miss the cache.
+    ok = ok && MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    ok = ok && rename(tmp_path, path) == 0;
+#endif
+    if (!ok) {
+        remove(tmp_path);
+    }
+    return ok;
+}
+
+bool kgflags_cache_load(const char *path, int argc, char **argv, void *buf, size_t cap, char **items_storage, int items_capacity) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    size_t size = fread(buf, 1, cap, file);
+    bool whole_file = size < cap || fgetc(file) == EOF;
+    fclose(file);
+    return whole_file && kgflags_cache_attach(buf, size, argc, argv, items_storage, items_capacity);
+}
+
+#ifdef KGFLAGS_TRACE
+int kgflags_trace_get_count(void) {
+    return _kgflags_g.trace_total < KGFLAGS_TRACE_CAPACITY ? (int)_kgflags_g.trace_total : KGFLAGS_TRACE_CAPACITY;
+}
+
+void kgflags_trace_get_event(int at, kgflags_trace_event_t *out_event) {
+    uint64_t first = _kgflags_g.trace_total - (uint64_t)kgflags_trace_get_count();
+    *out_event = _kgflags_g.trace[(first + (uint64_t)at) % KGFLAGS_TRACE_CAPACITY];
+}
+
+void kgflags_trace_clear(void) {
+    _kgflags_g.trace_total = 0;
+}
+
+int kgflags_trace_decode(char *buf, size_t cap) {
+    _kgflags_writer_t writer;
+    writer.buf = buf;
+    writer.cap = cap;
+    writer.len = 0;
+    writer.file = NULL;
+
+    char line[128];
+    if (_kgflags_g.trace_total > KGFLAGS_TRACE_CAPACITY) {
+        sprintf(line, "dropped %llu\n", (unsigned long long)(_kgflags_g.trace_total - KGFLAGS_TRACE_CAPACITY));
+        _kgflags_write_string(&writer, line);
+    }
+    for (int i = 0; i < kgflags_trace_get_count(); i++) {
+        kgflags_trace_event_t event;
+        kgflags_trace_get_event(i, &event);
+        switch (event.kind) {
+            case KGFLAGS_TRACE_PARSE_BEGIN:
+                sprintf(line, "begin argc=%d", (int)event.span_length);
+                break;
+            case KGFLAGS_TRACE_FLAG:
+                if (event.detail) {
+                    sprintf(line, "flag arg=%d value=inline", (int)event.arg_index);
+                } else {
+                    sprintf(line, "flag arg=%d values=%d+%d", (int)event.arg_index, (int)event.span_start, (int)event.span_length);
+                }
+                break;
+            case KGFLAGS_TRACE_NON_FLAG:
+                sprintf(line, "non-flag arg=%d", (int)event.arg_index);
+                break;
+            case KGFLAGS_TRACE_PASS_THROUGH:
+                sprintf(line, "pass-through arg=%d values=%d+%d", (int)event.arg_index, (int)event.span_start, (int)event.span_length);
+                break;
+            case KGFLAGS_TRACE_ERROR:
+                sprintf(line, "error kind=%d arg=%d item=%d", (int)event.detail, (int)event.arg_index, (int)event.span_start);
+                break;
+            case KGFLAGS_TRACE_PARSE_END:
+                sprintf(line, "end errors=%d", (int)event.span_length);
+                break;
+            default:
+                sprintf(line, "unknown kind=%d", (int)event.kind);
+                break;
+        }
+        _kgflags_write_string(&writer, line);
+        if (event.flag_id >= 0 && event.flag_id < _kgflags_g.flags_count) {
+            _kgflags_write_string(&writer, " name=");
+            _kgflags_write_string(&writer, _kgflags_g.flags[event.flag_id].name);
+        }
+        _kgflags_write_string(&writer, "\n");
+    }
+
+    if (cap > 0) {
+        buf[writer.len < cap ? writer.len : cap - 1] = '\0';
+    }
+    return (int)writer.len;
+}
+#endif
+
+void kgflags_print_usage() {
+    if (_kgflags_g.custom_description == NULL) {
+        fprintf(stderr, "Usage of %s:\n", _kgflags_g.arg0 != NULL ? _kgflags_g.arg0 : "program");
+    } else {
+        fprintf(stderr, "%s\n", _kgflags_g.custom_description);
+    }
+
+    fprintf(stderr, "Flags:\n");
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        const _kgflags_flag_cold_t *cold = &_kgflags_g.flag_colds[i];
+        char alias[8] = "";
+        if (cold->short_name != '\0') {
+            sprintf(alias, "%c%c, ", _kgflags_g.flag_prefix[0], cold->short_name);
+        }
+        switch (flag->kind) {
+            case KGFLAGS_FLAG_KIND_STRING:
+                fprintf(stderr, "\t%s%s%s\t(%s%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->path_checks ? "path" : "string",
+                    flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %s\n", cold->default_value.string_value);
+                }
+                break;
+            case KGFLAGS_FLAG_KIND_BOOL: {
+                fprintf(stderr, "\t%s%s%s, %sno-%s\t(boolean%s\n", alias, _kgflags_g.flag_prefix, flag->name, _kgflags_g.flag_prefix, flag->name,
+                    flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %s\n", cold->default_value.bool_value ? "True" : "False");
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT: {
+                fprintf(stderr, "\t%s%s%s\t(integer%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %d\n", cold->default_value.int_value);
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_DOUBLE: {
+                fprintf(stderr, "\t%s%s%s\t(float%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %1.4g\n", cold->default_value.double_value);
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_STRING_ARRAY: {
+                fprintf(stderr, "\t%s%s%s\t(%s%s\n", alias, _kgflags_g.flag_prefix, flag->name,
+                    flag->repeatable ? "string, repeatable" : flag->path_checks ? "array of paths" : "array of strings",
+                    flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT_ARRAY: {
+                fprintf(stderr, "\t%s%s%s\t(%s%s\n", alias, _kgflags_g.flag_prefix, flag->name,
+                    flag->repeatable ? "integer, repeatable" : "array of integers", flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY: {
+                fprintf(stderr, "\t%s%s%s\t(%s%s\n", alias, _kgflags_g.flag_prefix, flag->name,
+                    flag->repeatable ? "float, repeatable" : "array of floats", flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT64: {
+                fprintf(stderr, "\t%s%s%s\t(64-bit integer%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %lld\n", (long long)cold->default_value.int64_value);
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_UINT64: {
+                fprintf(stderr, "\t%s%s%s\t(unsigned 64-bit integer%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %llu\n", (unsigned long long)cold->default_value.uint64_value);
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_SIZE: {
+                fprintf(stderr, "\t%s%s%s\t(size%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %lluB\n", (unsigned long long)cold->default_value.uint64_value);
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_DURATION: {
+                fprintf(stderr, "\t%s%s%s\t(duration%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                if (!flag->required) {
+                    fprintf(stderr, "\t\tDefault: %lldns\n", (long long)cold->default_value.int64_value);
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT64_ARRAY: {
+                fprintf(stderr, "\t%s%s%s\t(array of 64-bit integers%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_UINT64_ARRAY: {
+                fprintf(stderr, "\t%s%s%s\t(array of unsigned 64-bit integers%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_SIZE_ARRAY: {
+                fprintf(stderr, "\t%s%s%s\t(array of sizes%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_DURATION_ARRAY: {
+                fprintf(stderr, "\t%s%s%s\t(array of durations%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_STRING_LIST: {
+                fprintf(stderr, "\t%s%s%s\t(list of strings separated by '%c'%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->list_delimiter, flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT_LIST: {
+                fprintf(stderr, "\t%s%s%s\t(list of integers separated by '%c'%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->list_delimiter, flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_DOUBLE_LIST: {
+                fprintf(stderr, "\t%s%s%s\t(list of floats separated by '%c'%s\n", alias, _kgflags_g.flag_prefix, flag->name, flag->list_delimiter, flag->required ? ")" : ", optional)");
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_CUSTOM_LIST: {
+                const char *type_name = _kgflags_g.custom_kinds[flag->custom_kind].type_name;
+                if (flag->list_delimiter == '\0') {
+                    fprintf(stderr, "\t%s%s%s\t(%s%s\n", alias, _kgflags_g.flag_prefix, flag->name, type_name, flag->required ? ")" : ", optional)");
+                } else {
+                    fprintf(stderr, "\t%s%s%s\t(list of %s separated by '%c'%s\n", alias, _kgflags_g.flag_prefix, flag->name, type_name, flag->list_delimiter, flag->required ? ")" : ", optional)");
+                }
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_CHOICE: {
+                fprintf(stderr, "\t%s%s%s\t(one of: ", alias, _kgflags_g.flag_prefix, flag->name);
+                _kgflags_print_choices(flag);
+                fprintf(stderr, "%s\n", flag->required ? ")" : ", optional)");
+                if (!flag->required && cold->default_value.int_value >= 0) {
+                    fprintf(stderr, "\t\tDefault: %s\n", flag->choices[cold->default_value.int_value]);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        if (cold->description) {
+            fprintf(stderr, "\t\t%s\n", cold->description);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+void kgflags_set_custom_description(const char *description) {
+    _kgflags_g.custom_description = description;
+}
+
+bool kgflags_complete(int argc, char **argv) {
+    const char *prefix = _kgflags_get_prefix();
+    size_t prefix_len = strlen(prefix);
+    if (argc != 3 || strncmp(argv[1], prefix, prefix_len) != 0 || strcmp(argv[1] + prefix_len, "__complete") != 0) {
+        return false;
+    }
+    char buf[4096];
+    _kgflags_writer_t writer;
+    writer.buf = buf;
+    writer.cap = sizeof(buf);
+    writer.len = 0;
+    writer.file = stdout;
+    _kgflags_write_completions(&writer, argv[2]);
+    _kgflags_flush(&writer);
+    return true;
+}
+
+int kgflags_get_completions(const char *partial, char *buf, size_t cap) {
+    _kgflags_writer_t writer;
+    writer.buf = buf;
+    writer.cap = cap;
+    writer.len = 0;
+    writer.file = NULL;
+    _kgflags_write_completions(&writer, partial);
+    if (cap > 0) {
+        buf[writer.len < cap ? writer.len : cap - 1] = '\0';
+    }
+    return (int)writer.len;
+}
+
+void kgflags_print_completion_script(kgflags_shell_t shell, const char *app_name) {
+    const char *prefix = _kgflags_get_prefix();
+    const char *base_name = strrchr(app_name, '/');
+    base_name = base_name ? base_name + 1 : app_name;
+    char func_name[128];
+    int len = 0;
+    for (const char *c = base_name; *c != '\0' && len < (int)sizeof(func_name) - 1; c++) {
+        bool alnum = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9');
+        func_name[len] = alnum ? *c : '_';
+        len++;
+    }
+    func_name[len] = '\0';
+
+    switch (shell) {
+        case KGFLAGS_SHELL_BASH: {
+            printf("_kgflags_%s() {\n", func_name);
+            printf("    local cur=\"${COMP_WORDS[COMP_CWORD]}\"\n");
+            printf("    if [[ \"$cur\" == \"%c\"* ]]; then\n", prefix[0]);
+            printf("        COMPREPLY=( $(\"${COMP_WORDS[0]}\" %s__complete \"$cur\" 2>/dev/null) )\n", prefix);
+            printf("    fi\n");
+            printf("}\n");
+            printf("complete -o default -F _kgflags_%s %s\n", func_name, base_name);
+            break;
+        }
+        case KGFLAGS_SHELL_ZSH: {
+            printf("#compdef %s\n", base_name);
+            printf("_kgflags_%s() {\n", func_name);
+            printf("    if [[ \"${words[CURRENT]}\" == \"%c\"* ]]; then\n", prefix[0]);
+            printf("        local -a candidates\n");
+            printf("        candidates=(${(f)\"$(\"${words[1]}\" %s__complete \"${words[CURRENT]}\" 2>/dev/null)\"})\n", prefix);
+            printf("        compadd -- $candidates\n");
+            printf("    else\n");
+            printf("        _files\n");
+            printf("    fi\n");
+            printf("}\n");
+            printf("compdef _kgflags_%s %s\n", func_name, base_name);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+int kgflags_string_array_get_count(const kgflags_string_array_t *arr) {
+    return arr->_count;
+}
+
+const char* kgflags_string_array_get_item(const kgflags_string_array_t *arr, int at) {
+    if (at < 0 || at >= arr->_count) {
+        return NULL;
+    }
+    return arr->_items[at];
+}
+
+int kgflags_int_array_get_count(const kgflags_int_array_t *arr) {
+    return arr->_has_ranges ? arr->_length : arr->_count;
+}
+
+int kgflags_int_array_get_item(const kgflags_int_array_t *arr, int at) {
+    if (at < 0 || at >= kgflags_int_array_get_count(arr)) {
+        return 0;
+    }
+    if (arr->_terms != NULL) {
+        int res = 0;
+        _kgflags_fill_indexed(arr->_terms, arr->_terms_count, arr->_length, at, &res, NULL, 1);
+        return res;
+    }
+    if (arr->_has_ranges) {
+        int res = 0;
+        _kgflags_fill_array(KGFLAGS_FLAG_KIND_INT_ARRAY, arr->_items, arr->_count, true, at, &res, NULL, 1);
+        return res;
+    }
+    const char *str = arr->_items[at];
+    bool ok = false;
+    int res = _kgflags_parse_int(str, &ok);
+    if (!ok) {
+        return 0;
+    }
+    return res;
+}
+
+int kgflags_int_array_fill(const kgflags_int_array_t *arr, int offset, int *out, int cap) {
+    if (offset < 0) {
+        return 0;
+    }
+    if (arr->_terms != NULL) {
+        return _kgflags_fill_indexed(arr->_terms, arr->_terms_count, arr->_length, offset, out, NULL, cap);
+    }
+    return _kgflags_fill_array(KGFLAGS_FLAG_KIND_INT_ARRAY, arr->_items, arr->_count, arr->_has_ranges, offset, out, NULL, cap);
+}
+
+int kgflags_double_array_get_count(const kgflags_double_array_t *arr) {
+    return arr->_has_ranges ? arr->_length : arr->_count;
+}
+
+double kgflags_double_array_get_item(const kgflags_double_array_t *arr, int at) {
+    if (at < 0 || at >= kgflags_double_array_get_count(arr)) {
+        return 0.0;
+    }
+    if (arr->_terms != NULL) {
+        double res = 0.0;
+        _kgflags_fill_indexed(arr->_terms, arr->_terms_count, arr->_length, at, NULL, &res, 1);
+        return res;
+    }
+    if (arr->_has_ranges) {
+        double res = 0.0;
+        _kgflags_fill_array(KGFLAGS_FLAG_KIND_DOUBLE_ARRAY, arr->_items, arr->_count, true, at, NULL, &res, 1);
+        return res;
+    }
+    const char *str = arr->_items[at];
+    bool ok = false;
+    double res = _kgflags_parse_double(str, &ok);
+    if (!ok) {
+        return 0.0;
+    }
+    return res;
+}
+
+int kgflags_double_array_fill(const kgflags_double_array_t *arr, int offset, double *out, int cap) {
+    if (offset < 0) {
+        return 0;
+    }
+    if (arr->_terms != NULL) {
+        return _kgflags_fill_indexed(arr->_terms, arr->_terms_count, arr->_length, offset, NULL, out, cap);
+    }
+    return _kgflags_fill_array(KGFLAGS_FLAG_KIND_DOUBLE_ARRAY, arr->_items, arr->_count, arr->_has_ranges, offset, NULL, out, cap);
+}
+
+int kgflags_int64_array_get_count(const kgflags_int64_array_t *arr) {
+    return arr->_count;
+}
+
+int64_t kgflags_int64_array_get_item(const kgflags_int64_array_t *arr, int at) {
+    if (at < 0 || at >= arr->_count) {
+        return 0;
+    }
+    return arr->_items[at];
+}
+
+const int64_t* kgflags_int64_array_get_items(const kgflags_int64_array_t *arr) {
+    return arr->_items;
+}
+
+int kgflags_uint64_array_get_count(const kgflags_uint64_array_t *arr) {
+    return arr->_count;
+}
+
+uint64_t kgflags_uint64_array_get_item(const kgflags_uint64_array_t *arr, int at) {
+    if (at < 0 || at >= arr->_count) {
+        return 0;
+    }
+    return arr->_items[at];
+}
+
+const uint64_t* kgflags_uint64_array_get_items(const kgflags_uint64_array_t *arr) {
+    return arr->_items;
+}
+
+int kgflags_size_array_get_count(const kgflags_size_array_t *arr) {
+    return arr->_count;
+}
+
+uint64_t kgflags_size_array_get_item(const kgflags_size_array_t *arr, int at) {
+    if (at < 0 || at >= arr->_count) {
+        return 0;
+    }
+    return arr->_items[at];
+}
+
+const uint64_t* kgflags_size_array_get_items(const kgflags_size_array_t *arr) {
+    return arr->_items;
+}
+
+int kgflags_duration_array_get_count(const kgflags_duration_array_t *arr) {
+    return arr->_count;
+}
+
+int64_t kgflags_duration_array_get_item(const kgflags_duration_array_t *arr, int at) {
+    if (at < 0 || at >= arr->_count) {
+        return 0;
+    }
+    return arr->_items[at];
+}
+
+const int64_t* kgflags_duration_array_get_items(const kgflags_duration_array_t *arr) {
+    return arr->_items;
+}
+
+int kgflags_string_list_get_count(const kgflags_string_list_t *list) {
+    return list->_count;
+}
+
+const char* kgflags_string_list_get_arg(const kgflags_string_list_t *list) {
+    return list->_arg;
+}
+
+kgflags_span_t kgflags_string_list_get_span(const kgflags_string_list_t *list, int at) {
+    if (at < 0 || at >= list->_count) {
+        kgflags_span_t empty = { 0, 0 };
+        return empty;
+    }
+    return list->_spans[at];
+}
+
+int kgflags_int_list_get_count(const kgflags_int_list_t *list) {
+    return list->_count;
+}
+
+const int* kgflags_int_list_get_items(const kgflags_int_list_t *list) {
+    return list->_items;
+}
+
+int kgflags_double_list_get_count(const kgflags_double_list_t *list) {
+    return list->_count;
+}
+
+const double* kgflags_double_list_get_items(const kgflags_double_list_t *list) {
+    return list->_items;
+}
+
+int kgflags_custom_list_get_count(const kgflags_custom_list_t *list) {
+    return list->_count;
+}
+
+const void* kgflags_custom_list_get_items(const kgflags_custom_list_t *list) {
+    return list->_items;
+}
+
+const char* kgflags_file_get_path(const kgflags_file_t *file) {
+    return file->_path;
+}
+
+kgflags_bytes_t kgflags_file_get_contents(kgflags_file_t *file) {
+    kgflags_bytes_t contents;
+    contents.data = NULL;
+    contents.length = 0;
+    if (file->_path == NULL) {
+        return contents;
+    }
+    if (file->_data == NULL || file->_mapped_path != file->_path) {
+        kgflags_file_release(file);
+        if (!_kgflags_map_file(file, SIZE_MAX)) {
+            return contents;
+        }
+    }
+    contents.data = file->_data;
+    contents.length = file->_length;
+    return contents;
+}
+
+void kgflags_file_release(kgflags_file_t *file) {
+#if !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+    if (file->_data != NULL && file->_length > 0) {
+        munmap((void*)file->_data, file->_length);
+    }
+#endif
+    file->_data = NULL;
+    file->_length = 0;
+    file->_mapped_path = NULL;
+}
+
+int kgflags_get_non_flag_args_count(void) {
+    if (_kgflags_g.permute_argv && _kgflags_g.argv != NULL) {
+        return _kgflags_g.argc - _kgflags_g.non_flag_start;
+    }
+    return _kgflags_g.non_flag_count;
+}
+
+const char* kgflags_get_non_flag_arg(int at) {
+    if (_kgflags_g.permute_argv && _kgflags_g.argv != NULL) {
+        if (at < 0 || at >= _kgflags_g.argc - _kgflags_g.non_flag_start) {
+            return NULL;
+        }
+        return _kgflags_g.argv[_kgflags_g.non_flag_start + at];
+    }
+    if (at < 0 || at >= _kgflags_g.non_flag_count) {
+        return NULL;
+    }
+    if (_kgflags_g.image_non_flags != NULL) {
+        uint32_t offset = 0;
+        memcpy(&offset, _kgflags_g.image_non_flags + sizeof(uint32_t) * (size_t)at, sizeof(offset));
+        return _kgflags_g.image_base + offset;
+    }
+    return _kgflags_g.non_flag_args[at];
+}
+
+/**************************************************************/
+/* INTERNAL FUNCTIONS */
+/**************************************************************/
+
+static bool _kgflags_is_flag(const char *arg) {
+    return _kgflags_get_arg_kind(arg) != KGFLAGS_ARG_KIND_NON_FLAG;
+}
+
+// Dispatches on the first byte, so most non-flag arguments are rejected without a string compare. Single
+// prefix character starts a short alias cluster only if it's followed by a registered alias, so words
+// like "-foo" stay non-flag arguments (or array items). With pass-through, other clusters are unknown flags.
+static _kgflags_arg_kind_t _kgflags_get_arg_kind(const char* arg) {
+    const char *prefix = _kgflags_g.flag_prefix;
+    size_t prefix_len = _kgflags_g.flag_prefix_length;
+    if (prefix_len == 0) {
+        return KGFLAGS_ARG_KIND_LONG;
+    }
+    if (arg[0] != prefix[0]) {
+        return KGFLAGS_ARG_KIND_NON_FLAG;
+    }
+    if (prefix_len == 1 || strncmp(arg + 1, prefix + 1, prefix_len - 1) == 0) {
+        return KGFLAGS_ARG_KIND_LONG;
+    }
+    unsigned char c = (unsigned char)arg[1];
+    if (c == '\0') {
+        return KGFLAGS_ARG_KIND_NON_FLAG;
+    }
+    if (_kgflags_g.short_flags[c] != 0) {
+        return KGFLAGS_ARG_KIND_SHORT;
+    }
+    if (_kgflags_g.pass_through && !((c >= '0' && c <= '9') || c == '.')) {
+        return KGFLAGS_ARG_KIND_SHORT; // passed through, negative numbers aren't flags
+    }
+    return KGFLAGS_ARG_KIND_NON_FLAG;
+}
+
+// Aliases are resolved through short_flags table, returns last parsed flag (the only one that can consume
+// following arguments).
+static _kgflags_flag_t* _kgflags_parse_short_flags(const char *arg) {
+    _kgflags_flag_t *last = NULL;
+    for (const char *c = arg + 1; *c != '\0'; c++) {
+        int index = _kgflags_g.short_flags[(unsigned char)*c] - 1;
+        if (index < 0) {
+            _kgflags_report_unknown_short_flag(NULL, arg, _kgflags_g.arg_cursor - 1, (int)(c - arg));
+            break;
+        }
+        _kgflags_flag_t *flag = &_kgflags_g.flags[index];
+        bool is_bool = flag->kind == KGFLAGS_FLAG_KIND_BOOL;
+        _kgflags_g.inline_value = !is_bool && c[1] != '\0' ? c + 1 : NULL;
+        _kgflags_process_flag(flag, false);
+        last = flag;
+        if (!is_bool) {
+            break;
+        }
+    }
+    return last;
+}
+
+static void _kgflags_process_flag(_kgflags_flag_t *flag, bool prefix_no) {
+    if (flag->assigned && !flag->repeatable) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+    } else if (!flag->assigned && !flag->error) {
+        _kgflags_mark_touched(flag);
+    }
+    _kgflags_parse_flag(flag, prefix_no);
+    _kgflags_g.inline_value = NULL;
+}
+
+static void _kgflags_add_flag(_kgflags_flag_t flag, _kgflags_flag_cold_t cold) {
+    if (_kgflags_g.frozen) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_SCHEMA_FROZEN, flag.name, NULL, -1, -1);
+        return;
+    }
+    // Also resolves "no-" names, so e.g. "no-verbose" can't be added next to bool "verbose".
+    if (_kgflags_get_flag(flag.name, NULL) != NULL) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_DUPLICATE_FLAG, flag.name, NULL, -1, -1);
+        return;
+    }
+    if (_kgflags_g.flags_count >= KGFLAGS_MAX_FLAGS) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS, NULL, NULL, -1, -1);
+        return;
+    }
+    unsigned int length = 0;
+    unsigned int hash = _kgflags_hash(flag.name, &length);
+    int index = _kgflags_g.flags_count;
+    _kgflags_g.flags[index] = flag;
+    _kgflags_g.flag_colds[index] = cold;
+    _kgflags_g.flag_keys[index].name = flag.name;
+    _kgflags_g.flag_keys[index].hash = hash;
+    _kgflags_g.flag_keys[index].length = length;
+    _kgflags_g.flag_keys[index].kind = flag.kind;
+    unsigned int slot = hash % _KGFLAGS_INDEX_SIZE;
+    while (_kgflags_g.flag_index[slot] != 0) {
+        slot = (slot + 1) % _KGFLAGS_INDEX_SIZE;
+    }
+    _kgflags_g.flag_index[slot] = index + 1;
+    if (flag.required) {
+        _kgflags_g.required_bits[index / 64] |= (uint64_t)1 << (index % 64);
+    }
+    _kgflags_g.flags_count++;
+}
+
+static _kgflags_flag_cold_t* _kgflags_get_cold(const _kgflags_flag_t *flag) {
+    return &_kgflags_g.flag_colds[flag - _kgflags_g.flags];
+}
+
+static _kgflags_flag_t* _kgflags_get_flag(const char* name, bool *out_prefix_no) {
+    return _kgflags_get_flag_n(name, (unsigned int)strlen(name), out_prefix_no);
+}
+
+// Name doesn't have to be null-terminated, e.g. it can be followed by "=value".
+static _kgflags_flag_t* _kgflags_get_flag_n(const char* name, unsigned int length, bool *out_prefix_no) {
+    if (out_prefix_no) {
+        *out_prefix_no = false;
+    }
+    unsigned int hash = _kgflags_hash_n(name, length);
+    int index = _kgflags_find_flag(name, length, hash);
+    if (index >= 0) {
+        return &_kgflags_g.flags[index];
+    }
+    if (length < 3 || strncmp(name, "no-", 3) != 0) {
+        return NULL;
+    }
+    length -= 3;
+    hash = _kgflags_hash_n(name + 3, length);
+    index = _kgflags_find_flag(name + 3, length, hash);
+    if (index < 0 || _kgflags_g.flag_keys[index].kind != KGFLAGS_FLAG_KIND_BOOL) {
+        return NULL;
+    }
+    if (out_prefix_no) {
+        *out_prefix_no = true;
+    }
+    return &_kgflags_g.flags[index];
+}
+
+// FNV-1a, computes length in the same pass.
+static unsigned int _kgflags_hash(const char *str, unsigned int *out_length) {
+    unsigned int hash = 2166136261u;
+    unsigned int length = 0;
+    while (str[length] != '\0') {
+        hash ^= (unsigned char)str[length];
+        hash *= 16777619u;
+        length++;
+    }
+    *out_length = length;
+    return hash;
+}
+
+static unsigned int _kgflags_hash_n(const char *str, unsigned int length) {
+    unsigned int hash = 2166136261u;
+    for (unsigned int i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Only hashes and lengths are compared until a candidate is found, names are touched once per lookup and
+// the probe never leaves flag_keys.
+static int _kgflags_find_flag(const char *name, unsigned int length, unsigned int hash) {
+    unsigned int slot = hash % _KGFLAGS_INDEX_SIZE;
+    while (_kgflags_g.flag_index[slot] != 0) {
+        int index = _kgflags_g.flag_index[slot] - 1;
+        const _kgflags_flag_key_t *key = &_kgflags_g.flag_keys[index];
+        if (key->hash == hash && key->length == length && memcmp(key->name, name, length) == 0) {
+            return index;
+        }
+        slot = (slot + 1) % _KGFLAGS_INDEX_SIZE;
+    }
+    return -1;
+}
+
+static int _kgflags_parse_int(const char *str, bool *out_ok) {
+    *out_ok = false;
+    char *end = NULL;
+    long res_l = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || res_l > INT_MAX || res_l < INT_MIN
+    || ((res_l == LONG_MIN || res_l == LONG_MAX) && ERANGE == errno)) {
+        *out_ok = false;
+        return 0;
+    }
+    *out_ok = true;
+    return (int)res_l;
+}
+
+static double _kgflags_parse_double(const char *str, bool *out_ok) {
+    *out_ok = false;
+    char *end = NULL;
+    double res = strtod(str, &end);
+    if (end == str || *end != '\0'
+    || ((res == -HUGE_VAL || res == +HUGE_VAL) && ERANGE == errno)) {
+        *out_ok = false;
+        return 0.0;
+    }
+    *out_ok = true;
+    return res;
+}
+
+// Like _kgflags_parse_int but item ends at str + length (usually at a delimiter) instead of at '\0'. Item is
+// copied out first, strtol would otherwise read on past a delimiter that can continue a number.
+static int _kgflags_parse_int_span(const char *str, size_t length, bool *out_ok) {
+    char item[64];
+    *out_ok = false;
+    if (length == 0 || length >= sizeof(item)) {
+        return 0;
+    }
+    memcpy(item, str, length);
+    item[length] = '\0';
+    return _kgflags_parse_int(item, out_ok);
+}
+
+// Same as _kgflags_parse_int_span, e.g. with delimiter 'e' "1e2" is items 1 and 2, not 100.
+static double _kgflags_parse_double_span(const char *str, size_t length, bool *out_ok) {
+    char item[64];
+    *out_ok = false;
+    if (length == 0 || length >= sizeof(item)) {
+        return 0.0;
+    }
+    memcpy(item, str, length);
+    item[length] = '\0';
+    return _kgflags_parse_double(item, out_ok);
+}
+
+// Dotted decimal, exactly 4 parts. Bytes are written to out_bytes (if not NULL) only if str is valid.
+static bool _kgflags_parse_ipv4_bytes(const char *str, size_t length, uint8_t *out_bytes) {
+    uint8_t bytes[4];
+    size_t i = 0;
+    for (int part = 0; part < 4; part++) {
+        if (part > 0) {
+            if (i >= length || str[i] != '.') {
+                return false;
+            }
+            i++;
+        }
+        size_t start = i;
+        unsigned int value = 0;
+        while (i < length && i - start < 3 && str[i] >= '0' && str[i] <= '9') {
+            value = value * 10 + (unsigned int)(str[i] - '0');
+            i++;
+        }
+        if (i == start || value > 255 || (i - start > 1 && str[start] == '0')) {
+            return false;
+        }
+        bytes[part] = (uint8_t)value;
+    }
+    if (i != length) {
+        return false;
+    }
+    if (out_bytes != NULL) {
+        memcpy(out_bytes, bytes, sizeof(bytes));
+    }
+    return true;
+}
+
+// Groups of up to 4 hex digits, at most one "::" and optionally an IPv4 address in place of the last two groups.
+static bool _kgflags_parse_ipv6_bytes(const char *str, size_t length, uint8_t *out_bytes) {
+    uint8_t bytes[16];
+    int count = 0;
+    int gap = -1; // where "::" is, in bytes
+    size_t i = 0;
+    if (length >= 2 && str[0] == ':' && str[1] == ':') {
+        gap = 0;
+        i = 2;
+    } else if (length > 0 && str[0] == ':') {
+        return false;
+    }
+    while (i < length) {
+        size_t end = i;
+        while (end < length && str[end] != ':') {
+            end++;
+        }
+        if (memchr(str + i, '.', end - i) != NULL) {
+            if (end != length || count > 12 || !_kgflags_parse_ipv4_bytes(str + i, end - i, bytes + count)) {
+                return false;
+            }
+            count += 4;
+            break;
+        }
+        if (end == i || end - i > 4 || count > 14) {
+            return false;
+        }
+        unsigned int group = 0;
+        for (; i < end; i++) {
+            char c = str[i];
+            unsigned int digit = 0;
+            if (c >= '0' && c <= '9') {
+                digit = (unsigned int)(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                digit = (unsigned int)(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                digit = (unsigned int)(c - 'A' + 10);
+            } else {
+                return false;
+            }
+            group = group * 16 + digit;
+        }
+        bytes[count++] = (uint8_t)(group >> 8);
+        bytes[count++] = (uint8_t)(group & 0xff);
+        if (i == length) {
+            break;
+        }
+        i++; // ':'
+        if (i < length && str[i] == ':') {
+            if (gap >= 0) {
+                return false;
+            }
+            gap = count;
+            i++;
+        } else if (i == length) {
+            return false;
+        }
+    }
+    if (gap < 0 ? count != 16 : count > 14) { // "::" stands for at least one group
+        return false;
+    }
+    if (gap >= 0) {
+        int tail = count - gap;
+        memmove(bytes + 16 - tail, bytes + gap, (size_t)tail);
+        memset(bytes + gap, 0, (size_t)(16 - tail - gap));
+    }
+    if (out_bytes != NULL) {
+        memcpy(out_bytes, bytes, sizeof(bytes));
+    }
+    return true;
+}
+
+// Parses decimal digits without going through strtol/strtod, returns number of digits or -1 on overflow.
+static int _kgflags_parse_digits(const char **str, uint64_t *out_val) {
+    const char *c = *str;
+    uint64_t val = 0;
+    int count = 0;
+    while (true) {
+        unsigned int digit = (unsigned int)(unsigned char)*c - '0';
+        if (digit > 9) {
+            break;
+        }
+        if (val > (UINT64_MAX - digit) / 10) {
+            return -1;
+        }
+        val = val * 10 + digit;
+        c++;
+        count++;
+    }
+    *str = c;
+    *out_val = val;
+    return count;
+}
+
+static bool _kgflags_to_int64(uint64_t magnitude, bool negative, int64_t *out_val) {
+    if (negative) {
+        if (magnitude > (uint64_t)INT64_MAX + 1) {
+            return false;
+        }
+        *out_val = magnitude == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)magnitude;
+    } else {
+        if (magnitude > (uint64_t)INT64_MAX) {
+            return false;
+        }
+        *out_val = (int64_t)magnitude;
+    }
+    return true;
+}
+
+// Parses "<digits>[.<digits>]<unit>" to value * unit multiplier, fraction is truncated.
+// Fraction has at most 9 digits, so frac * (multiplier % denominator) fits in 64 bits.
+static bool _kgflags_parse_with_unit(const char *str, const _kgflags_unit_t *units, int units_count, uint64_t *out_val) {
+    const char *c = str;
+    uint64_t int_part = 0;
+    int int_digits = _kgflags_parse_digits(&c, &int_part);
+    if (int_digits < 0) {
+        return false;
+    }
+    uint64_t frac_part = 0;
+    uint64_t denominator = 1;
+    int frac_digits = 0;
+    if (*c == '.') {
+        c++;
+        frac_digits = _kgflags_parse_digits(&c, &frac_part);
+        if (frac_digits < 0 || frac_digits > 9) {
+            return false;
+        }
+        for (int i = 0; i < frac_digits; i++) {
+            denominator *= 10;
+        }
+    }
+    if (int_digits == 0 && frac_digits == 0) {
+        return false;
+    }
+    uint64_t multiplier = 0;
+    for (int i = 0; i < units_count; i++) {
+        if (strcmp(c, units[i].suffix) == 0) {
+            multiplier = units[i].multiplier;
+            break;
+        }
+    }
+    if (multiplier == 0) {
+        return false;
+    }
+    if (int_part > UINT64_MAX / multiplier) {
+        return false;
+    }
+    uint64_t val = int_part * multiplier;
+    uint64_t frac_val = frac_part * (multiplier / denominator) + frac_part * (multiplier % denominator) / denominator;
+    if (val > UINT64_MAX - frac_val) {
+        return false;
+    }
+    *out_val = val + frac_val;
+    return true;
+}
+
+static int64_t _kgflags_parse_int64(const char *str, bool *out_ok) {
+    *out_ok = false;
+    bool negative = *str == '-';
+    if (*str == '-' || *str == '+') {
+        str++;
+    }
+    uint64_t magnitude = 0;
+    int64_t res = 0;
+    if (_kgflags_parse_digits(&str, &magnitude) <= 0 || *str != '\0' || !_kgflags_to_int64(magnitude, negative, &res)) {
+        return 0;
+    }
+    *out_ok = true;
+    return res;
+}
+
+static uint64_t _kgflags_parse_uint64(const char *str, bool *out_ok) {
+    *out_ok = false;
+    if (*str == '+') {
+        str++;
+    }
+    uint64_t res = 0;
+    if (_kgflags_parse_digits(&str, &res) <= 0 || *str != '\0') {
+        return 0;
+    }
+    *out_ok = true;
+    return res;
+}
+
+static uint64_t _kgflags_parse_size(const char *str, bool *out_ok) {
+    *out_ok = false;
+    uint64_t res = 0;
+    int units_count = (int)(sizeof(_kgflags_size_units) / sizeof(_kgflags_size_units[0]));
+    if (!_kgflags_parse_with_unit(str, _kgflags_size_units, units_count, &res)) {
+        return 0;
+    }
+    *out_ok = true;
+    return res;
+}
+
+static int64_t _kgflags_parse_duration(const char *str, bool *out_ok) {
+    *out_ok = false;
+    if (strcmp(str, "0") == 0) {
+        *out_ok = true;
+        return 0;
+    }
+    bool negative = *str == '-';
+    if (*str == '-' || *str == '+') {
+        str++;
+    }
+    uint64_t magnitude = 0;
+    int64_t res = 0;
+    int units_count = (int)(sizeof(_kgflags_duration_units) / sizeof(_kgflags_duration_units[0]));
+    if (!_kgflags_parse_with_unit(str, _kgflags_duration_units, units_count, &magnitude)
+    || !_kgflags_to_int64(magnitude, negative, &res)) {
+        return 0;
+    }
+    *out_ok = true;
+    return res;
+}
+
+static kgflags_error_kind_t _kgflags_get_invalid_value_error(_kgflags_flag_kind_t kind) {
+    switch (kind) {
+        case KGFLAGS_FLAG_KIND_INT:
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            return KGFLAGS_ERROR_KIND_INVALID_INT;
+        case KGFLAGS_FLAG_KIND_DOUBLE:
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            return KGFLAGS_ERROR_KIND_INVALID_DOUBLE;
+        case KGFLAGS_FLAG_KIND_INT64:
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            return KGFLAGS_ERROR_KIND_INVALID_INT64;
+        case KGFLAGS_FLAG_KIND_UINT64:
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            return KGFLAGS_ERROR_KIND_INVALID_UINT64;
+        case KGFLAGS_FLAG_KIND_SIZE:
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            return KGFLAGS_ERROR_KIND_INVALID_SIZE;
+        case KGFLAGS_FLAG_KIND_DURATION:
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            return KGFLAGS_ERROR_KIND_INVALID_DURATION;
+        default:
+            return KGFLAGS_ERROR_KIND_NONE;
+    }
+}
+
+static void _kgflags_add_error(kgflags_error_kind_t kind, const char *flag_name, const char *arg, int arg_index, int item_index) {
+    _kgflags_report_error(NULL, kind, flag_name, arg, arg_index, item_index);
+}
+
+#ifdef KGFLAGS_TRACE
+// Events are written in place, so recording is a few stores and no branches besides the ring wrap.
+static void _kgflags_trace_record(kgflags_trace_kind_t kind, int arg_index, int flag_id, int detail, int span_start, int span_length) {
+    kgflags_trace_event_t *event = &_kgflags_g.trace[_kgflags_g.trace_total % KGFLAGS_TRACE_CAPACITY];
+    event->arg_index = arg_index;
+    event->span_start = span_start;
+    event->span_length = span_length;
+    event->flag_id = flag_id;
+    event->kind = (uint8_t)kind;
+    event->detail = (uint8_t)detail;
+    _kgflags_g.trace_total++;
+}
+
+// Only used for errors, which report flags by name.
+static int _kgflags_trace_flag_id(const char *flag_name) {
+    if (flag_name == NULL) {
+        return -1;
+    }
+    bool prefix_no = false;
+    const _kgflags_flag_t *flag = _kgflags_get_flag_n(flag_name, (unsigned int)strlen(flag_name), &prefix_no);
+    return flag != NULL ? (int)(flag - _kgflags_g.flags) : -1;
+}
+#endif
+
+static void _kgflags_report_error(_kgflags_validator_t *validator, kgflags_error_kind_t kind, const char *flag_name, const char *arg, int arg_index, int item_index) {
+    kgflags_error_info_t info;
+    info.kind = kind;
+    info.flag_name = flag_name;
+    info.value = arg;
+    info.arg_index = arg_index;
+    info.item_index = item_index;
+    info.limit = -1;
+    info.char_index = -1;
+    _kgflags_store_error(validator, &info);
+}
+
+// Limit is capacity of a list or repeatable flag, or INT_MAX when range expressions expand to too many values.
+static void _kgflags_report_too_many_items(_kgflags_validator_t *validator, const char *flag_name, const char *arg, int arg_index, int item_index, int limit) {
+    kgflags_error_info_t info;
+    info.kind = KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS;
+    info.flag_name = flag_name;
+    info.value = arg;
+    info.arg_index = arg_index;
+    info.item_index = item_index;
+    info.limit = limit;
+    info.char_index = -1;
+    _kgflags_store_error(validator, &info);
+}
+
+static void _kgflags_report_unknown_short_flag(_kgflags_validator_t *validator, const char *arg, int arg_index, int char_index) {
+    kgflags_error_info_t info;
+    info.kind = KGFLAGS_ERROR_KIND_UNKNOWN_SHORT_FLAG;
+    info.flag_name = NULL;
+    info.value = arg;
+    info.arg_index = arg_index;
+    info.item_index = -1;
+    info.limit = -1;
+    info.char_index = char_index;
+    _kgflags_store_error(validator, &info);
+}
+
+// Errors found by kgflags_validate are only counted in its result, everything else goes to the error list.
+static void _kgflags_store_error(_kgflags_validator_t *validator, const kgflags_error_info_t *info) {
+    if (validator == NULL) {
+        _KGFLAGS_TRACE(KGFLAGS_TRACE_ERROR, info->arg_index, _kgflags_trace_flag_id(info->flag_name), (int)info->kind, info->item_index, 0);
+        if (_kgflags_g.errors_count >= KGFLAGS_MAX_ERRORS) {
+            return;
+        }
+        _kgflags_error_t *err = &_kgflags_g.errors[_kgflags_g.errors_count];
+        err->kind = info->kind;
+        err->flag_name = info->flag_name;
+        err->arg = info->value;
+        err->arg_index = info->arg_index;
+        err->item_index = info->item_index;
+        err->limit = info->limit;
+        err->char_index = info->char_index;
+        err->constraint = -1;
+        _kgflags_g.errors_count++;
+        return;
+    }
+    kgflags_validation_t *result = validator->result;
+    if (result->errors_count > 0 && validator->stop_at_first_error) {
+        return;
+    }
+    if (result->errors_count == 0) {
+        result->first_error = *info;
+    }
+    result->errors_count++;
+}
+
+
+static void _kgflags_add_constraint(_kgflags_constraint_kind_t kind, const char *const *names, int names_count, const char *required_name) {
+    if (_kgflags_g.frozen) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_SCHEMA_FROZEN, NULL, NULL, -1, -1);
+        return;
+    }
+    if (_kgflags_g.constraints_count >= KGFLAGS_MAX_CONSTRAINTS) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_TOO_MANY_CONSTRAINTS, NULL, NULL, -1, -1);
+        return;
+    }
+    _kgflags_constraint_t constraint;
+    memset(&constraint, 0, sizeof(_kgflags_constraint_t));
+    constraint.kind = kind;
+    constraint.required_flag = -1;
+    bool ok = true;
+    for (int i = 0; i < names_count; i++) {
+        _kgflags_flag_t *flag = _kgflags_get_flag(names[i], NULL);
+        if (flag == NULL) {
+            _kgflags_add_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG, names[i], NULL, -1, -1);
+            ok = false;
+            continue;
+        }
+        int index = (int)(flag - _kgflags_g.flags);
+        constraint.flags[index / 64] |= (uint64_t)1 << (index % 64);
+    }
+    if (required_name != NULL) {
+        _kgflags_flag_t *flag = _kgflags_get_flag(required_name, NULL);
+        if (flag == NULL) {
+            _kgflags_add_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG, required_name, NULL, -1, -1);
+            ok = false;
+        } else {
+            constraint.required_flag = (int)(flag - _kgflags_g.flags);
+        }
+    }
+    if (!ok) {
+        return;
+    }
+    _kgflags_g.constraints[_kgflags_g.constraints_count] = constraint;
+    _kgflags_g.constraints_count++;
+}
+
+// Builds assigned and error bitsets from flags touched by this parse, then checks required flags and
+// constraints with whole-word operations. Flags with invalid values already have an error, so they're
+// treated as passed.
+static void _kgflags_check_constraints() {
+    uint64_t *assigned = _kgflags_g.assigned_bits;
+    uint64_t *errors = _kgflags_g.error_bits;
+    memset(assigned, 0, sizeof(_kgflags_g.assigned_bits));
+    memset(errors, 0, sizeof(_kgflags_g.error_bits));
+    for (int i = 0; i < _kgflags_g.touched_count; i++) {
+        int index = _kgflags_g.touched_flags[i];
+        uint64_t bit = (uint64_t)1 << (index % 64);
+        if (_kgflags_g.flags[index].assigned) {
+            assigned[index / 64] |= bit;
+        }
+        if (_kgflags_g.flags[index].error) {
+            errors[index / 64] |= bit;
+        }
+    }
+
+    _kgflags_check_constraint_bits(assigned, errors, NULL);
+}
+
+// Shared by kgflags_parse and kgflags_validate, validator is NULL for kgflags_parse.
+static void _kgflags_check_constraint_bits(const uint64_t *assigned, const uint64_t *errors, _kgflags_validator_t *validator) {
+    for (int w = 0; w < _KGFLAGS_BITSET_WORDS; w++) {
+        for (uint64_t word = _kgflags_g.required_bits[w] & ~(assigned[w] | errors[w]); word != 0; word &= word - 1) {
+            int index = w * 64 + _kgflags_lowest_bit(word);
+            _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG, _kgflags_g.flags[index].name, NULL, -1, -1);
+        }
+    }
+
+    for (int i = 0; i < _kgflags_g.constraints_count; i++) {
+        const _kgflags_constraint_t *constraint = &_kgflags_g.constraints[i];
+        uint64_t passed[_KGFLAGS_BITSET_WORDS];
+        int passed_count = 0;
+        bool any_error = false;
+        for (int w = 0; w < _KGFLAGS_BITSET_WORDS; w++) {
+            passed[w] = constraint->flags[w] & assigned[w];
+            passed_count += _kgflags_popcount(passed[w]);
+            any_error = any_error || (constraint->flags[w] & errors[w]) != 0;
+        }
+        switch (constraint->kind) {
+            case KGFLAGS_CONSTRAINT_KIND_EXACTLY_ONE:
+            case KGFLAGS_CONSTRAINT_KIND_AT_MOST_ONE: {
+                if (passed_count > 1) {
+                    int first = _kgflags_first_flag(passed);
+                    passed[first / 64] &= ~((uint64_t)1 << (first % 64));
+                    int second = _kgflags_first_flag(passed);
+                    _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS, _kgflags_g.flags[first].name, _kgflags_g.flags[second].name, -1, -1);
+                } else if (passed_count == 0 && !any_error && constraint->kind == KGFLAGS_CONSTRAINT_KIND_EXACTLY_ONE) {
+                    _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_MISSING_ONE_OF, NULL, NULL, -1, -1);
+                    if (validator == NULL && _kgflags_g.errors_count > 0) {
+                        _kgflags_g.errors[_kgflags_g.errors_count - 1].constraint = i;
+                    }
+                }
+                break;
+            }
+            case KGFLAGS_CONSTRAINT_KIND_REQUIRES: {
+                int required = constraint->required_flag;
+                uint64_t required_bit = (uint64_t)1 << (required % 64);
+                if (passed_count > 0 && ((assigned[required / 64] | errors[required / 64]) & required_bit) == 0) {
+                    int dependent = _kgflags_first_flag(passed);
+                    _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_MISSING_DEPENDENCY, _kgflags_g.flags[dependent].name, _kgflags_g.flags[required].name, -1, -1);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+static int _kgflags_popcount(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word != 0; word &= word - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+static int _kgflags_lowest_bit(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int index = 0;
+    while ((word & 1) == 0) {
+        word >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Returns -1 if no bit is set.
+static int _kgflags_first_flag(const uint64_t *bits) {
+    for (int w = 0; w < _KGFLAGS_BITSET_WORDS; w++) {
+        if (bits[w] != 0) {
+            return w * 64 + _kgflags_lowest_bit(bits[w]);
+        }
+    }
+    return -1;
+}
+
+#ifdef KGFLAGS_HAS_SECTION_REGISTRATION
+#ifdef __cplusplus
+extern "C" {
+#endif
+// Defined by the linker if any module put a spec into the section, weak so linking works without any.
+extern const kgflags_spec_t __start_kgflags_specs[] __attribute__((weak));
+extern const kgflags_spec_t __stop_kgflags_specs[] __attribute__((weak));
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+static void _kgflags_ensure_registered() {
+    if (_kgflags_g.specs_registered) {
+        return;
+    }
+    _kgflags_g.specs_registered = true;
+#ifdef KGFLAGS_HAS_SECTION_REGISTRATION
+    static const _kgflags_flag_kind_t kinds[] = {
+        KGFLAGS_FLAG_KIND_STRING, KGFLAGS_FLAG_KIND_BOOL, KGFLAGS_FLAG_KIND_INT, KGFLAGS_FLAG_KIND_DOUBLE,
+        KGFLAGS_FLAG_KIND_INT64, KGFLAGS_FLAG_KIND_UINT64, KGFLAGS_FLAG_KIND_SIZE, KGFLAGS_FLAG_KIND_DURATION,
+        KGFLAGS_FLAG_KIND_STRING_ARRAY, KGFLAGS_FLAG_KIND_INT_ARRAY, KGFLAGS_FLAG_KIND_DOUBLE_ARRAY,
+    };
+    if (__start_kgflags_specs == NULL || __stop_kgflags_specs == NULL) {
+        return;
+    }
+    for (const kgflags_spec_t *spec = __start_kgflags_specs; spec < __stop_kgflags_specs; spec++) {
+        _kgflags_flag_t flag;
+        memset(&flag, 0, sizeof(_kgflags_flag_t));
+        _kgflags_flag_cold_t cold;
+        memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+        flag.kind = kinds[spec->kind];
+        flag.name = spec->name;
+        cold.description = spec->description;
+        flag.required = spec->required;
+        switch (spec->kind) {
+            case KGFLAGS_SPEC_KIND_STRING:
+                cold.default_value.string_value = spec->default_string;
+                flag.result.string_value = (const char**)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_BOOL:
+                cold.default_value.bool_value = spec->default_bool;
+                flag.result.bool_value = (bool*)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_INT:
+                cold.default_value.int_value = spec->default_int;
+                flag.result.int_value = (int*)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_DOUBLE:
+                cold.default_value.double_value = spec->default_double;
+                flag.result.double_value = (double*)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_INT64:
+            case KGFLAGS_SPEC_KIND_DURATION:
+                cold.default_value.int64_value = spec->default_int64;
+                flag.result.int64_value = (int64_t*)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_UINT64:
+            case KGFLAGS_SPEC_KIND_SIZE:
+                cold.default_value.uint64_value = spec->default_uint64;
+                flag.result.uint64_value = (uint64_t*)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_STRING_ARRAY:
+                flag.result.string_array = (kgflags_string_array_t*)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_INT_ARRAY:
+                flag.result.int_array = (kgflags_int_array_t*)spec->out;
+                break;
+            case KGFLAGS_SPEC_KIND_DOUBLE_ARRAY:
+                flag.result.double_array = (kgflags_double_array_t*)spec->out;
+                break;
+            default:
+                break;
+        }
+        _kgflags_add_flag(flag, cold);
+    }
+#endif
+}
+
+static void _kgflags_assign_default_values() {
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
+        const _kgflags_flag_cold_t *cold = &_kgflags_g.flag_colds[i];
+        if (flag->assigned || flag->required) {
+            continue;
+        }
+        switch (flag->kind) {
+            case KGFLAGS_FLAG_KIND_STRING: {
+                *flag->result.string_value = cold->default_value.string_value;
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_BOOL: {
+                *flag->result.bool_value = cold->default_value.bool_value;
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT:
+            case KGFLAGS_FLAG_KIND_CHOICE: {
+                *flag->result.int_value = cold->default_value.int_value;
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_DOUBLE: {
+                *flag->result.double_value = cold->default_value.double_value;
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT64:
+            case KGFLAGS_FLAG_KIND_DURATION: {
+                *flag->result.int64_value = cold->default_value.int64_value;
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_UINT64:
+            case KGFLAGS_FLAG_KIND_SIZE: {
+                *flag->result.uint64_value = cold->default_value.uint64_value;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+static void _kgflags_mark_touched(_kgflags_flag_t *flag) {
+    _kgflags_g.touched_flags[_kgflags_g.touched_count] = (int)(flag - _kgflags_g.flags);
+    _kgflags_g.touched_count++;
+}
+
+static void _kgflags_redirect_result(_kgflags_flag_t *flag, kgflags_snapshot_t *snapshot, int id) {
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING:
+            flag->result.string_value = &snapshot->_values[id].string_value;
+            break;
+        case KGFLAGS_FLAG_KIND_BOOL:
+            flag->result.bool_value = &snapshot->_values[id].bool_value;
+            break;
+        case KGFLAGS_FLAG_KIND_INT:
+        case KGFLAGS_FLAG_KIND_CHOICE:
+            flag->result.int_value = &snapshot->_values[id].int_value;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE:
+            flag->result.double_value = &snapshot->_values[id].double_value;
+            break;
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+            flag->result.string_array = &snapshot->_values[id].string_array;
+            break;
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            flag->result.int_array = &snapshot->_values[id].int_array;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            flag->result.double_array = &snapshot->_values[id].double_array;
+            break;
+        case KGFLAGS_FLAG_KIND_INT64:
+        case KGFLAGS_FLAG_KIND_DURATION:
+            flag->result.int64_value = &snapshot->_values[id].int64_value;
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64:
+        case KGFLAGS_FLAG_KIND_SIZE:
+            flag->result.uint64_value = &snapshot->_values[id].uint64_value;
+            break;
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            flag->result.int64_array = &snapshot->_values[id].int64_array;
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            flag->result.uint64_array = &snapshot->_values[id].uint64_array;
+            break;
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            flag->result.size_array = &snapshot->_values[id].size_array;
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            flag->result.duration_array = &snapshot->_values[id].duration_array;
+            break;
+        case KGFLAGS_FLAG_KIND_STRING_LIST:
+            flag->result.string_list = &snapshot->_values[id].string_list;
+            break;
+        case KGFLAGS_FLAG_KIND_INT_LIST:
+            flag->result.int_list = &snapshot->_values[id].int_list;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+            flag->result.double_list = &snapshot->_values[id].double_list;
+            break;
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST:
+            flag->result.custom_list = &snapshot->_values[id].custom_list;
+            break;
+        default:
+            break;
+    }
+}
+
+// Bytes needed for items of a list or repeatable flag, rounded up so the next flag's items stay aligned.
+static size_t _kgflags_get_storage_size(const _kgflags_flag_t *flag) {
+    if (flag->list_storage == NULL) {
+        return 0;
+    }
+    size_t elem_size = 0;
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            elem_size = sizeof(char*);
+            break;
+        case KGFLAGS_FLAG_KIND_STRING_LIST:
+            elem_size = sizeof(kgflags_span_t);
+            break;
+        case KGFLAGS_FLAG_KIND_INT_LIST:
+            elem_size = sizeof(int);
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+            elem_size = sizeof(double);
+            break;
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            elem_size = sizeof(int64_t);
+            break;
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST:
+            elem_size = _kgflags_g.custom_kinds[flag->custom_kind].elem_size;
+            break;
+        default:
+            break;
+    }
+    return (elem_size * (size_t)flag->list_capacity + 7) & ~(size_t)7;
+}
+
+static bool _kgflags_strings_equal(const char *a, const char *b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return a == b || strcmp(a, b) == 0;
+}
+
+static bool _kgflags_items_equal(char **a, int a_count, char **b, int b_count) {
+    if (a_count != b_count) {
+        return false;
+    }
+    for (int i = 0; i < a_count; i++) {
+        if (!_kgflags_strings_equal(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool _kgflags_values_equal(const void *a, int a_count, const void *b, int b_count, size_t elem_size) {
+    if (a_count != b_count) {
+        return false;
+    }
+    return a_count == 0 || memcmp(a, b, elem_size * (size_t)a_count) == 0;
+}
+
+static bool _kgflags_add_non_flag_arg(const char* arg) {
+    if (_kgflags_g.permute_argv) {
+        return true; // stays in argv, it's moved behind flags that follow it
+    }
+    if (_kgflags_g.non_flag_count >= KGFLAGS_MAX_NON_FLAG_ARGS) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_TOO_MANY_NON_FLAG_ARGS, NULL, NULL, _kgflags_g.arg_cursor - 1, -1);
+        return false;
+    }
+    _kgflags_g.non_flag_args[_kgflags_g.non_flag_count] = arg;
+    _kgflags_g.non_flag_count++;
+    return true;
+}
+
+static void _kgflags_reverse_args(int begin, int end) {
+    char **argv = _kgflags_g.argv;
+    for (int i = begin, j = end - 1; i < j; i++, j--) {
+        char *tmp = argv[i];
+        argv[i] = argv[j];
+        argv[j] = tmp;
+    }
+}
+
+// Rotates argv[begin, end) of the flag just parsed in front of non-flag arguments preceding it
+// (three reversals, no extra memory), so they stay contiguous and in order. Array items point
+// into the rotated range, so they're moved along with it.
+static void _kgflags_move_before_non_flag_args(_kgflags_flag_t *flag, int begin, int end) {
+    if (!_kgflags_g.permute_argv) {
+        return;
+    }
+    int non_flag_start = _kgflags_g.non_flag_start;
+    int shift = begin - non_flag_start;
+    if (shift > 0) {
+        _kgflags_reverse_args(non_flag_start, begin);
+        _kgflags_reverse_args(begin, end);
+        _kgflags_reverse_args(non_flag_start, end);
+        char ***items = flag ? _kgflags_get_array_items(flag) : NULL;
+        if (items != NULL && *items >= _kgflags_g.argv + begin && *items < _kgflags_g.argv + end) {
+            *items -= shift;
+        }
+    }
+    _kgflags_g.non_flag_start += end - begin;
+}
+
+// Clamped to remaining arguments, so a bad arity callback can't move cursor past argc.
+static int _kgflags_get_pass_through_arity(const char *arg, int remaining) {
+    if (_kgflags_g.pass_through_arity == NULL) {
+        return 0;
+    }
+    int arity = _kgflags_g.pass_through_arity(arg, _kgflags_g.pass_through_arity_ctx);
+    if (arity < 0) {
+        return 0;
+    }
+    return arity < remaining ? arity : remaining;
+}
+
+static char*** _kgflags_get_array_items(_kgflags_flag_t *flag) {
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+            return &flag->result.string_array->_items;
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            return &flag->result.int_array->_items;
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            return &flag->result.double_array->_items;
+        default:
+            return NULL;
+    }
+}
+
+static const char* _kgflags_consume_arg() {
+    if (_kgflags_g.arg_cursor >= _kgflags_g.argc) {
+        return NULL;
+    }
+    const char *res = _kgflags_g.argv[_kgflags_g.arg_cursor];
+    _kgflags_g.arg_cursor++;
+    return res;
+}
+
+// Value of a flag is either inline ("--name=value") or the next argument.
+static const char* _kgflags_consume_value() {
+    if (_kgflags_g.inline_value != NULL) {
+        const char *res = _kgflags_g.inline_value;
+        _kgflags_g.inline_value = NULL;
+        return res;
+    }
+    return _kgflags_consume_arg();
+}
+
+static const char* _kgflags_peek_arg() {
+    if (_kgflags_g.arg_cursor >= _kgflags_g.argc) {
+        return NULL;
+    }
+    return _kgflags_g.argv[_kgflags_g.arg_cursor];
+}
+
+static void _kgflags_parse_flag(_kgflags_flag_t *flag, bool prefix_no) {
+    if (_kgflags_g.inline_value != NULL && !flag->repeatable && !_kgflags_takes_inline_value(flag->kind)) {
+        flag->error = true;
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_UNEXPECTED_VALUE, flag->name, _kgflags_g.inline_value, _kgflags_g.arg_cursor - 1, -1);
+        return;
+    }
+#ifdef KGFLAGS_TRACE
+    int flag_arg = _kgflags_g.arg_cursor - 1;
+    bool inline_value = _kgflags_g.inline_value != NULL;
+#endif
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING: {
+            const char *val = _kgflags_consume_value();
+            if (!val) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            kgflags_error_kind_t path_error = flag->path_checks ? _kgflags_check_path(val, flag->path_checks) : KGFLAGS_ERROR_KIND_NONE;
+            if (path_error != KGFLAGS_ERROR_KIND_NONE) {
+                flag->error = true;
+                _kgflags_add_error(path_error, flag->name, val, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            *flag->result.string_value = val;
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_BOOL: {
+            *flag->result.bool_value = !prefix_no;
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT: {
+            const char *val = _kgflags_consume_value();
+            if (!val) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            bool ok = false;
+            int int_val = _kgflags_parse_int(val, &ok);
+            if (!ok) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_INT, flag->name, val, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            *flag->result.int_value = int_val;
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_DOUBLE: {
+            const char *val = _kgflags_consume_value();
+            if (!val) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            bool ok = false;
+            double double_val = _kgflags_parse_double(val, &ok);
+            if (!ok) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_DOUBLE, flag->name, val, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            *flag->result.double_value = double_val;
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY: {
+            if (flag->repeatable) {
+                _kgflags_parse_occurrence(flag);
+                break;
+            }
+            int initial_cursor = _kgflags_g.arg_cursor;
+            int count = _kgflags_consume_array_args();
+            bool all_args_ok = flag->path_checks == 0 || _kgflags_validate_array(flag, _kgflags_g.argv + initial_cursor, count, NULL);
+            kgflags_string_array_t *arr = flag->result.string_array;
+            if (all_args_ok) {
+                arr->_items = _kgflags_g.argv + initial_cursor;
+                arr->_count = count;
+            }
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT_ARRAY: {
+            if (flag->repeatable) {
+                _kgflags_parse_occurrence(flag);
+                break;
+            }
+            int initial_cursor = _kgflags_g.arg_cursor;
+            int count = _kgflags_consume_array_args();
+            int ranges_length = -1;
+            bool all_args_ok = _kgflags_validate_array(flag, _kgflags_g.argv + initial_cursor, count, &ranges_length);
+            kgflags_int_array_t *arr = flag->result.int_array;
+            if (all_args_ok) {
+                arr->_items = _kgflags_g.argv + initial_cursor;
+                arr->_count = count;
+                _kgflags_set_ranges_length(flag, ranges_length);
+            }
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY: {
+            if (flag->repeatable) {
+                _kgflags_parse_occurrence(flag);
+                break;
+            }
+            int initial_cursor = _kgflags_g.arg_cursor;
+            int count = _kgflags_consume_array_args();
+            int ranges_length = -1;
+            bool all_args_ok = _kgflags_validate_array(flag, _kgflags_g.argv + initial_cursor, count, &ranges_length);
+            kgflags_double_array_t *arr = flag->result.double_array;
+            if (all_args_ok) {
+                arr->_items = _kgflags_g.argv + initial_cursor;
+                arr->_count = count;
+                _kgflags_set_ranges_length(flag, ranges_length);
+            }
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_STRING_LIST:
+        case KGFLAGS_FLAG_KIND_INT_LIST:
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST: {
+            const char *val = _kgflags_consume_value();
+            if (!val) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            _kgflags_parse_list(flag, val);
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_CHOICE: {
+            const char *val = _kgflags_consume_value();
+            if (!val) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            int choice = _kgflags_find_choice(flag, val);
+            if (choice < 0) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_CHOICE, flag->name, val, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            *flag->result.int_value = choice;
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT64:
+        case KGFLAGS_FLAG_KIND_UINT64:
+        case KGFLAGS_FLAG_KIND_SIZE:
+        case KGFLAGS_FLAG_KIND_DURATION: {
+            const char *val = _kgflags_consume_value();
+            if (!val) {
+                flag->error = true;
+                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            bool ok = false;
+            if (flag->kind == KGFLAGS_FLAG_KIND_INT64) {
+                int64_t int64_val = _kgflags_parse_int64(val, &ok);
+                if (ok) {
+                    *flag->result.int64_value = int64_val;
+                }
+            } else if (flag->kind == KGFLAGS_FLAG_KIND_DURATION) {
+                int64_t duration_val = _kgflags_parse_duration(val, &ok);
+                if (ok) {
+                    *flag->result.int64_value = duration_val;
+                }
+            } else if (flag->kind == KGFLAGS_FLAG_KIND_UINT64) {
+                uint64_t uint64_val = _kgflags_parse_uint64(val, &ok);
+                if (ok) {
+                    *flag->result.uint64_value = uint64_val;
+                }
+            } else {
+                uint64_t size_val = _kgflags_parse_size(val, &ok);
+                if (ok) {
+                    *flag->result.uint64_value = size_val;
+                }
+            }
+            if (!ok) {
+                flag->error = true;
+                _kgflags_add_error(_kgflags_get_invalid_value_error(flag->kind), flag->name, val, _kgflags_g.arg_cursor - 1, -1);
+                return;
+            }
+            flag->assigned = true;
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY: {
+            int initial_cursor = _kgflags_g.arg_cursor;
+            int count = _kgflags_consume_array_args();
+            bool all_args_ok = _kgflags_validate_array(flag, _kgflags_g.argv + initial_cursor, count, NULL);
+            if (all_args_ok && count > flag->list_capacity) {
+                int arg_index = initial_cursor + flag->list_capacity;
+                flag->error = true;
+                all_args_ok = false;
+                _kgflags_report_too_many_items(NULL, flag->name, _kgflags_g.argv[arg_index], arg_index, flag->list_capacity, flag->list_capacity);
+            }
+            if (all_args_ok) {
+                _kgflags_set_typed_array(flag, count > 0 ? flag->list_storage : NULL, count);
+            }
+            flag->assigned = true;
+            break;
+        }
+        default:
+            break;
+    }
+    _KGFLAGS_TRACE(KGFLAGS_TRACE_FLAG, flag_arg, (int)(flag - _kgflags_g.flags), inline_value,
+                   inline_value ? flag_arg : flag_arg + 1, inline_value ? 1 : _kgflags_g.arg_cursor - flag_arg - 1);
+}
+
+static void _kgflags_write(_kgflags_writer_t *writer, const char *str, size_t len) {
+    if (writer->file != NULL && writer->len + len > writer->cap) {
+        _kgflags_flush(writer);
+        if (len > writer->cap) {
+            fwrite(str, 1, len, writer->file);
+            return;
+        }
+    }
+    if (writer->len < writer->cap) {
+        size_t available = writer->cap - writer->len;
+        memcpy(writer->buf + writer->len, str, len < available ? len : available);
+    }
+    writer->len += len;
+}
+
+static void _kgflags_flush(_kgflags_writer_t *writer) {
+    if (writer->file != NULL && writer->len > 0) {
+        fwrite(writer->buf, 1, writer->len, writer->file);
+        writer->len = 0;
+    }
+}
+
+// Entries are compared as if "no-" forms were separate names, without building them.
+static char _kgflags_completion_char(const _kgflags_completion_entry_t *entry, unsigned int at) {
+    unsigned int length = _kgflags_g.flag_keys[entry->flag].length;
+    if (entry->prefix_no) {
+        if (at < 3) {
+            return "no-"[at];
+        }
+        at -= 3;
+    }
+    return at < length ? _kgflags_g.flags[entry->flag].name[at] : '\0';
+}
+
+static int _kgflags_compare_completion_entries(const void *a, const void *b) {
+    const _kgflags_completion_entry_t *entry_a = (const _kgflags_completion_entry_t*)a;
+    const _kgflags_completion_entry_t *entry_b = (const _kgflags_completion_entry_t*)b;
+    for (unsigned int i = 0; ; i++) {
+        unsigned char char_a = (unsigned char)_kgflags_completion_char(entry_a, i);
+        unsigned char char_b = (unsigned char)_kgflags_completion_char(entry_b, i);
+        if (char_a != char_b || char_a == '\0') {
+            return (int)char_a - (int)char_b;
+        }
+    }
+}
+
+// Returns 0 if entry starts with partial, otherwise its order relative to partial.
+static int _kgflags_compare_completion_partial(const _kgflags_completion_entry_t *entry, const char *partial) {
+    for (unsigned int i = 0; partial[i] != '\0'; i++) {
+        unsigned char entry_char = (unsigned char)_kgflags_completion_char(entry, i);
+        if (entry_char != (unsigned char)partial[i]) {
+            return (int)entry_char - (int)(unsigned char)partial[i];
+        }
+    }
+    return 0;
+}
+
+static void _kgflags_build_completion_index() {
+    if (_kgflags_g.completion_flags_count == _kgflags_g.flags_count && _kgflags_g.completion_count > 0) {
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < _kgflags_g.flags_count; i++) {
+        _kgflags_g.completion_index[count].flag = i;
+        _kgflags_g.completion_index[count].prefix_no = false;
+        count++;
+        if (_kgflags_g.flags[i].kind == KGFLAGS_FLAG_KIND_BOOL) {
+            _kgflags_g.completion_index[count].flag = i;
+            _kgflags_g.completion_index[count].prefix_no = true;
+            count++;
+        }
+    }
+    qsort(_kgflags_g.completion_index, (size_t)count, sizeof(_kgflags_completion_entry_t), _kgflags_compare_completion_entries);
+    _kgflags_g.completion_count = count;
+    _kgflags_g.completion_flags_count = _kgflags_g.flags_count;
+}
+
+static void _kgflags_write_completions(_kgflags_writer_t *writer, const char *partial) {
+    _kgflags_ensure_registered();
+    const char *prefix = _kgflags_get_prefix();
+    size_t prefix_len = strlen(prefix);
+    size_t partial_len = strlen(partial);
+    if (partial_len <= prefix_len) {
+        if (strncmp(prefix, partial, partial_len) != 0) {
+            return;
+        }
+        partial = "";
+    } else {
+        if (strncmp(prefix, partial, prefix_len) != 0) {
+            return;
+        }
+        partial += prefix_len;
+    }
+
+    _kgflags_build_completion_index();
+
+    int lo = 0;
+    int hi = _kgflags_g.completion_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (_kgflags_compare_completion_partial(&_kgflags_g.completion_index[mid], partial) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (int i = lo; i < _kgflags_g.completion_count; i++) {
+        const _kgflags_completion_entry_t *entry = &_kgflags_g.completion_index[i];
+        if (_kgflags_compare_completion_partial(entry, partial) != 0) {
+            break;
+        }
+        _kgflags_write_string(writer, prefix);
+        if (entry->prefix_no) {
+            _kgflags_write_string(writer, "no-");
+        }
+        _kgflags_write_string(writer, _kgflags_g.flags[entry->flag].name);
+        _kgflags_write_string(writer, "\n");
+    }
+}
+
+static const char* _kgflags_get_prefix() {
+    if (_kgflags_g.flag_prefix == NULL) {
+        _kgflags_g.flag_prefix = "--";
+    }
+    _kgflags_g.flag_prefix_length = strlen(_kgflags_g.flag_prefix);
+    return _kgflags_g.flag_prefix;
+}
+
+static void _kgflags_write_string(_kgflags_writer_t *writer, const char *str) {
+    _kgflags_write(writer, str, strlen(str));
+}
+
+// JSON strings are quoted, key=value strings are written as is with backslash, new line and comma
+// (array item separator) escaped with a backslash.
+static void _kgflags_write_escaped(_kgflags_writer_t *writer, const char *str, kgflags_dump_format_t fmt) {
+    if (str == NULL) {
+        _kgflags_write_string(writer, fmt == KGFLAGS_DUMP_FORMAT_JSON_LINES ? "null" : "");
+        return;
+    }
+    _kgflags_write_escaped_n(writer, str, strlen(str), fmt);
+}
+
+static void _kgflags_write_escaped_n(_kgflags_writer_t *writer, const char *str, size_t length, kgflags_dump_format_t fmt) {
+    if (fmt == KGFLAGS_DUMP_FORMAT_JSON_LINES) {
+        _kgflags_write_string(writer, "\"");
+    }
+    const char *run = str;
+    for (const char *c = str; c < str + length; c++) {
+        char escaped[8];
+        escaped[0] = '\0';
+        if (fmt == KGFLAGS_DUMP_FORMAT_JSON_LINES) {
+            if (*c == '"' || *c == '\\') {
+                sprintf(escaped, "\\%c", *c);
+            } else if ((unsigned char)*c < 0x20) {
+                sprintf(escaped, "\\u%04x", (unsigned char)*c);
+            }
+        } else {
+            if (*c == '\\' || *c == ',') {
+                sprintf(escaped, "\\%c", *c);
+            } else if (*c == '\n') {
+                sprintf(escaped, "\\n");
+            }
+        }
+        if (escaped[0] != '\0') {
+            _kgflags_write(writer, run, (size_t)(c - run));
+            _kgflags_write_string(writer, escaped);
+            run = c + 1;
+        }
+    }
+    _kgflags_write(writer, run, (size_t)(str + length - run));
+    if (fmt == KGFLAGS_DUMP_FORMAT_JSON_LINES) {
+        _kgflags_write_string(writer, "\"");
+    }
+}
+
+// NaN and infinities aren't valid JSON numbers so they're written as strings.
+static void _kgflags_write_double(_kgflags_writer_t *writer, double val, kgflags_dump_format_t fmt) {
+    char num[64];
+    sprintf(num, "%.17g", val);
+    if (fmt == KGFLAGS_DUMP_FORMAT_JSON_LINES && (isnan(val) || isinf(val))) {
+        _kgflags_write_escaped(writer, num, fmt);
+    } else {
+        _kgflags_write_string(writer, num);
+    }
+}
+
+static void _kgflags_write_flag_value(_kgflags_writer_t *writer, const _kgflags_flag_t *flag, kgflags_dump_format_t fmt) {
+    char num[64];
+    bool json = fmt == KGFLAGS_DUMP_FORMAT_JSON_LINES;
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING: {
+            _kgflags_write_escaped(writer, *flag->result.string_value, fmt);
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_BOOL: {
+            _kgflags_write_string(writer, *flag->result.bool_value ? "true" : "false");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT: {
+            sprintf(num, "%d", *flag->result.int_value);
+            _kgflags_write_string(writer, num);
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_STRING_LIST: {
+            const kgflags_string_list_t *list = flag->result.string_list;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < list->_count; i++) {
+                _kgflags_write_string(writer, i > 0 ? "," : "");
+                _kgflags_write_escaped_n(writer, list->_arg + list->_spans[i].offset, (size_t)list->_spans[i].length, fmt);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT_LIST: {
+            const kgflags_int_list_t *list = flag->result.int_list;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < list->_count; i++) {
+                sprintf(num, "%s%d", i > 0 ? "," : "", list->_items[i]);
+                _kgflags_write_string(writer, num);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST: {
+            const kgflags_double_list_t *list = flag->result.double_list;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < list->_count; i++) {
+                _kgflags_write_string(writer, i > 0 ? "," : "");
+                _kgflags_write_double(writer, list->_items[i], fmt);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST: {
+            // Values are opaque, so the argument they were parsed from is written instead.
+            _kgflags_write_escaped(writer, flag->result.custom_list->_arg, fmt);
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_CHOICE: {
+            int choice = *flag->result.int_value;
+            _kgflags_write_escaped(writer, choice >= 0 ? flag->choices[choice] : NULL, fmt);
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_DOUBLE: {
+            _kgflags_write_double(writer, *flag->result.double_value, fmt);
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT64:
+        case KGFLAGS_FLAG_KIND_DURATION: {
+            sprintf(num, "%lld", (long long)*flag->result.int64_value);
+            _kgflags_write_string(writer, num);
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_UINT64:
+        case KGFLAGS_FLAG_KIND_SIZE: {
+            sprintf(num, "%llu", (unsigned long long)*flag->result.uint64_value);
+            _kgflags_write_string(writer, num);
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY: {
+            const kgflags_string_array_t *arr = flag->result.string_array;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < arr->_count; i++) {
+                _kgflags_write_string(writer, i > 0 ? "," : "");
+                _kgflags_write_escaped(writer, kgflags_string_array_get_item(arr, i), fmt);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT_ARRAY: {
+            const kgflags_int_array_t *arr = flag->result.int_array;
+            int values[64];
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < kgflags_int_array_get_count(arr); i += 64) {
+                int filled = kgflags_int_array_fill(arr, i, values, 64);
+                for (int j = 0; j < filled; j++) {
+                    sprintf(num, "%s%d", i + j > 0 ? "," : "", values[j]);
+                    _kgflags_write_string(writer, num);
+                }
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY: {
+            const kgflags_double_array_t *arr = flag->result.double_array;
+            double values[64];
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < kgflags_double_array_get_count(arr); i += 64) {
+                int filled = kgflags_double_array_fill(arr, i, values, 64);
+                for (int j = 0; j < filled; j++) {
+                    _kgflags_write_string(writer, i + j > 0 ? "," : "");
+                    _kgflags_write_double(writer, values[j], fmt);
+                }
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY: {
+            const kgflags_int64_array_t *arr = flag->result.int64_array;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < arr->_count; i++) {
+                sprintf(num, "%s%lld", i > 0 ? "," : "", (long long)kgflags_int64_array_get_item(arr, i));
+                _kgflags_write_string(writer, num);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY: {
+            const kgflags_uint64_array_t *arr = flag->result.uint64_array;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < arr->_count; i++) {
+                sprintf(num, "%s%llu", i > 0 ? "," : "", (unsigned long long)kgflags_uint64_array_get_item(arr, i));
+                _kgflags_write_string(writer, num);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY: {
+            const kgflags_size_array_t *arr = flag->result.size_array;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < arr->_count; i++) {
+                sprintf(num, "%s%llu", i > 0 ? "," : "", (unsigned long long)kgflags_size_array_get_item(arr, i));
+                _kgflags_write_string(writer, num);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY: {
+            const kgflags_duration_array_t *arr = flag->result.duration_array;
+            _kgflags_write_string(writer, json ? "[" : "");
+            for (int i = 0; i < arr->_count; i++) {
+                sprintf(num, "%s%lld", i > 0 ? "," : "", (long long)kgflags_duration_array_get_item(arr, i));
+                _kgflags_write_string(writer, num);
+            }
+            _kgflags_write_string(writer, json ? "]" : "");
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static int _kgflags_consume_array_args() {
+    int count = 0;
+    while (true) {
+        const char *val = _kgflags_peek_arg();
+        if (val == NULL || _kgflags_is_flag(val)) {
+            break;
+        }
+        _kgflags_consume_arg();
+        count++;
+    }
+    return count;
+}
+
+static void _kgflags_declare_repeatable(_kgflags_flag_kind_t kind, const char *name, char **storage, int capacity,
+                                        const char *description, bool required, void *out_arr) {
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = kind;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.list_storage = storage;
+    flag.list_capacity = capacity;
+    flag.repeatable = true;
+    switch (kind) {
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+            flag.result.string_array = (kgflags_string_array_t*)out_arr;
+            break;
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            flag.result.int_array = (kgflags_int_array_t*)out_arr;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            flag.result.double_array = (kgflags_double_array_t*)out_arr;
+            break;
+        default:
+            break;
+    }
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+// Appends value of a single occurrence of a repeatable flag. Just like arrays, flag is assigned even if
+// the value is invalid.
+static void _kgflags_parse_occurrence(_kgflags_flag_t *flag) {
+    const char *val = _kgflags_consume_value();
+    if (!val) {
+        flag->error = true;
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, _kgflags_g.arg_cursor - 1, -1);
+        return;
+    }
+    char **items = NULL;
+    int count = 0;
+    _kgflags_get_array(flag, &items, &count);
+    flag->assigned = true;
+    if (count >= flag->list_capacity) {
+        flag->error = true;
+        _kgflags_report_too_many_items(NULL, flag->name, val, _kgflags_g.arg_cursor - 1, count, flag->list_capacity);
+        return;
+    }
+    int64_t values = 0;
+    bool range = false;
+    kgflags_error_kind_t error_kind = _kgflags_check_item(flag->kind, 0, val, &values, &range);
+    if (error_kind != KGFLAGS_ERROR_KIND_NONE) {
+        flag->error = true;
+        _kgflags_add_error(error_kind, flag->name, val, _kgflags_g.arg_cursor - 1, count);
+        return;
+    }
+    int ranges_length = _kgflags_get_ranges_length(flag);
+    if (range || ranges_length >= 0) {
+        values += ranges_length >= 0 ? ranges_length : count;
+        if (values > INT_MAX) {
+            flag->error = true;
+            _kgflags_report_too_many_items(NULL, flag->name, val, _kgflags_g.arg_cursor - 1, count, INT_MAX);
+            return;
+        }
+    }
+    char **storage = (char**)flag->list_storage;
+    storage[count] = (char*)val;
+    _kgflags_set_array(flag, storage, count + 1);
+    if (range || ranges_length >= 0) {
+        _kgflags_set_ranges_length(flag, (int)values);
+    }
+}
+
+static void _kgflags_declare_list(_kgflags_flag_kind_t kind, const char *name, char delimiter, void *storage, int capacity,
+                                  const char *description, bool required, void *out_list) {
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = kind;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.list_storage = storage;
+    flag.list_capacity = capacity;
+    flag.list_delimiter = delimiter;
+    switch (kind) {
+        case KGFLAGS_FLAG_KIND_STRING_LIST:
+            flag.result.string_list = (kgflags_string_list_t*)out_list;
+            break;
+        case KGFLAGS_FLAG_KIND_INT_LIST:
+            flag.result.int_list = (kgflags_int_list_t*)out_list;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+            flag.result.double_list = (kgflags_double_list_t*)out_list;
+            break;
+        default:
+            break;
+    }
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+static void _kgflags_declare_custom(const char *name, int kind, char delimiter, void *storage, int capacity,
+                                    const char *description, bool required, kgflags_custom_list_t *out_list) {
+    if (kind < 0 || kind >= _kgflags_g.custom_kinds_count) {
+        _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE, name, NULL, -1, -1);
+        return;
+    }
+    if (out_list != NULL) {
+        out_list->_items = NULL;
+        out_list->_arg = NULL;
+        out_list->_count = 0;
+    }
+
+    _kgflags_flag_t flag;
+    memset(&flag, 0, sizeof(_kgflags_flag_t));
+    _kgflags_flag_cold_t cold;
+    memset(&cold, 0, sizeof(_kgflags_flag_cold_t));
+    flag.kind = KGFLAGS_FLAG_KIND_CUSTOM_LIST;
+    flag.name = name;
+    cold.description = description;
+    flag.required = required;
+    flag.list_storage = storage;
+    flag.list_capacity = capacity;
+    flag.list_delimiter = delimiter;
+    flag.custom_kind = kind;
+    flag.result.custom_list = out_list;
+    flag.assigned = false;
+    _kgflags_add_flag(flag, cold);
+}
+
+// Delimiters are found with memchr, which libc implementations vectorize. The whole argument is validated
+// before any item is written, so list storage (and with it the result) is only changed if all items are valid.
+static void _kgflags_parse_list(_kgflags_flag_t *flag, const char *val) {
+    if (!_kgflags_validate_list(NULL, flag, val, _kgflags_g.arg_cursor - 1)) {
+        flag->error = true;
+        return;
+    }
+    size_t length = strlen(val);
+    size_t offset = 0;
+    int count = 0;
+    bool single = flag->list_delimiter == '\0'; // single custom values are parsed even if empty
+    while (length > 0 || (single && count == 0)) {
+        const char *item = val + offset;
+        const char *delimiter = (const char*)memchr(item, flag->list_delimiter, length - offset);
+        size_t item_length = delimiter ? (size_t)(delimiter - item) : length - offset;
+        bool ok = true;
+        switch (flag->kind) {
+            case KGFLAGS_FLAG_KIND_STRING_LIST: {
+                kgflags_span_t *spans = (kgflags_span_t*)flag->list_storage;
+                spans[count].offset = (int)offset;
+                spans[count].length = (int)item_length;
+                break;
+            }
+            case KGFLAGS_FLAG_KIND_INT_LIST:
+                ((int*)flag->list_storage)[count] = _kgflags_parse_int_span(item, item_length, &ok);
+                break;
+            case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+                ((double*)flag->list_storage)[count] = _kgflags_parse_double_span(item, item_length, &ok);
+                break;
+            case KGFLAGS_FLAG_KIND_CUSTOM_LIST: {
+                const _kgflags_custom_kind_t *custom = &_kgflags_g.custom_kinds[flag->custom_kind];
+                custom->parse(item, item_length, (char*)flag->list_storage + custom->elem_size * (size_t)count, custom->ctx);
+                break;
+            }
+            default:
+                break;
+        }
+        count++;
+        if (delimiter == NULL) {
+            break;
+        }
+        offset += item_length + 1;
+    }
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING_LIST:
+            flag->result.string_list->_arg = val;
+            flag->result.string_list->_spans = (kgflags_span_t*)flag->list_storage;
+            flag->result.string_list->_count = count;
+            break;
+        case KGFLAGS_FLAG_KIND_INT_LIST:
+            flag->result.int_list->_items = (int*)flag->list_storage;
+            flag->result.int_list->_count = count;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+            flag->result.double_list->_items = (double*)flag->list_storage;
+            flag->result.double_list->_count = count;
+            break;
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST:
+            flag->result.custom_list->_items = flag->list_storage;
+            flag->result.custom_list->_arg = val;
+            flag->result.custom_list->_count = count;
+            break;
+        default:
+            break;
+    }
+}
+
+static bool _kgflags_takes_inline_value(_kgflags_flag_kind_t kind) {
+    switch (kind) {
+        case KGFLAGS_FLAG_KIND_BOOL:
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static int _kgflags_find_choice(const _kgflags_flag_t *flag, const char *value) {
+    const _kgflags_flag_key_t *keys = _kgflags_g.choice_keys + flag->choices_offset;
+    const int *table = _kgflags_g.choice_index + flag->choices_offset * 2;
+    unsigned int table_size = (unsigned int)flag->choices_count * 2;
+    unsigned int length = 0;
+    unsigned int hash = _kgflags_hash(value, &length);
+    unsigned int slot = hash % table_size;
+    while (table[slot] != 0) {
+        int index = table[slot] - 1;
+        if (keys[index].hash == hash && keys[index].length == length && memcmp(keys[index].name, value, length) == 0) {
+            return index;
+        }
+        slot = (slot + 1) % table_size;
+    }
+    return -1;
+}
+
+static void _kgflags_print_choices(const _kgflags_flag_t *flag) {
+    for (int i = 0; i < flag->choices_count; i++) {
+        fprintf(stderr, "%s%s", i > 0 ? ", " : "", flag->choices[i]);
+    }
+}
+
+static bool _kgflags_is_valid_array_item(_kgflags_flag_kind_t kind, const char *item) {
+    bool ok = false;
+    bool range = false;
+    switch (kind) {
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            ok = _kgflags_get_item_values(kind, item, &range) >= 0;
+            break;
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            _kgflags_parse_int64(item, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            _kgflags_parse_uint64(item, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            _kgflags_parse_size(item, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            _kgflags_parse_duration(item, &ok);
+            break;
+        default:
+            ok = true;
+            break;
+    }
+    return ok;
+}
+
+// KGFLAGS_ERROR_KIND_NONE if item is valid. Number of values item stands for is written to out_values, see
+// _kgflags_get_item_values.
+static kgflags_error_kind_t _kgflags_check_item(_kgflags_flag_kind_t kind, int path_checks, const char *item,
+                                                int64_t *out_values, bool *out_range) {
+    *out_values = 1;
+    *out_range = false;
+    if (kind == KGFLAGS_FLAG_KIND_INT_ARRAY || kind == KGFLAGS_FLAG_KIND_DOUBLE_ARRAY) {
+        *out_values = _kgflags_get_item_values(kind, item, out_range);
+        return *out_values < 0 ? _kgflags_get_invalid_value_error(kind) : KGFLAGS_ERROR_KIND_NONE;
+    }
+    if (!_kgflags_is_valid_array_item(kind, item)) {
+        return _kgflags_get_invalid_value_error(kind);
+    }
+    return path_checks ? _kgflags_check_path(item, path_checks) : KGFLAGS_ERROR_KIND_NONE;
+}
+
+static bool _kgflags_is_typed_array(_kgflags_flag_kind_t kind) {
+    return kind == KGFLAGS_FLAG_KIND_INT64_ARRAY || kind == KGFLAGS_FLAG_KIND_UINT64_ARRAY
+        || kind == KGFLAGS_FLAG_KIND_SIZE_ARRAY || kind == KGFLAGS_FLAG_KIND_DURATION_ARRAY;
+}
+
+// Same as _kgflags_check_item for int64, uint64, size and duration arrays, but value is also written to
+// storage[index], so items are parsed only once.
+static kgflags_error_kind_t _kgflags_convert_item(_kgflags_flag_kind_t kind, const char *item, void *storage, int index) {
+    bool ok = false;
+    switch (kind) {
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            ((int64_t*)storage)[index] = _kgflags_parse_int64(item, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            ((uint64_t*)storage)[index] = _kgflags_parse_uint64(item, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            ((uint64_t*)storage)[index] = _kgflags_parse_size(item, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            ((int64_t*)storage)[index] = _kgflags_parse_duration(item, &ok);
+            break;
+        default:
+            break;
+    }
+    return ok ? KGFLAGS_ERROR_KIND_NONE : _kgflags_get_invalid_value_error(kind);
+}
+
+// Bounds are copied out first so that separators next to them can't be parsed as their part, strtod would
+// read "1." of "1..5". Int bounds can also be written with an exponent, e.g. "0:1e6:250".
+static double _kgflags_parse_range_bound(_kgflags_flag_kind_t kind, const char *str, size_t length, bool *out_ok) {
+    char bound[64];
+    *out_ok = false;
+    if (length == 0 || length >= sizeof(bound)) {
+        return 0.0;
+    }
+    memcpy(bound, str, length);
+    bound[length] = '\0';
+    if (kind == KGFLAGS_FLAG_KIND_INT_ARRAY) {
+        int int_res = _kgflags_parse_int(bound, out_ok);
+        if (*out_ok) {
+            return int_res;
+        }
+    }
+    double res = _kgflags_parse_double(bound, out_ok);
+    if (kind == KGFLAGS_FLAG_KIND_INT_ARRAY) {
+        *out_ok = *out_ok && res >= INT_MIN && res <= INT_MAX && res == (double)(int)res;
+    } else {
+        *out_ok = *out_ok && res - res == 0.0; // rejects inf and nan
+    }
+    return res;
+}
 
-    for (int i = 0; i < _kgflags_g.flags_count; i++) {
-        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
-        if (flag->required && !flag->assigned && !flag->error) {
-            _kgflags_add_error(KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG, flag->name, NULL);
+// Term is one of "a", "a..b", "a:b", "a:b:step" and, for int arrays, "a-b". Counts are computed from
+// bounds, so terms take the same time to parse whatever number of values they stand for.
+static bool _kgflags_parse_range_term(_kgflags_flag_kind_t kind, const char *term, size_t length, _kgflags_range_term_t *out_term) {
+    const char *end = term + length;
+    const char *dots = NULL;
+    for (const char *c = term; c + 1 < end; c++) {
+        if (c[0] == '.' && c[1] == '.') {
+            dots = c;
+            break;
         }
     }
+    const char *colon = (const char*)memchr(term, ':', length);
+    const char *dash = NULL;
+    if (kind == KGFLAGS_FLAG_KIND_INT_ARRAY && length > 1) {
+        dash = (const char*)memchr(term + 1, '-', length - 1); // first character may be sign of a
+    }
 
-    if (_kgflags_g.errors_count > 0) {
+    bool start_ok = false;
+    bool stop_ok = false;
+    bool step_ok = true;
+    double step = 1.0;
+    double count = 0.0;
+    out_term->start = 0.0;
+    if (dots != NULL || (colon == NULL && dash == NULL)) {
+        const char *stop = dots != NULL ? dots + 2 : end;
+        out_term->start = _kgflags_parse_range_bound(kind, term, (size_t)((dots != NULL ? dots : end) - term), &start_ok);
+        double stop_value = dots != NULL ? _kgflags_parse_range_bound(kind, stop, (size_t)(end - stop), &stop_ok) : 0.0;
+        if (dots == NULL) {
+            stop_ok = true;
+            step = 0.0;
+            count = 1.0;
+        } else {
+            count = stop_value - out_term->start;
+        }
+    } else if (colon != NULL) {
+        const char *stop = colon + 1;
+        const char *colon2 = (const char*)memchr(stop, ':', (size_t)(end - stop));
+        out_term->start = _kgflags_parse_range_bound(kind, term, (size_t)(colon - term), &start_ok);
+        double stop_value = _kgflags_parse_range_bound(kind, stop, (size_t)((colon2 != NULL ? colon2 : end) - stop), &stop_ok);
+        if (colon2 != NULL) {
+            step = _kgflags_parse_range_bound(kind, colon2 + 1, (size_t)(end - colon2 - 1), &step_ok);
+            step_ok = step_ok && step != 0.0;
+        }
+        count = step_ok ? (stop_value - out_term->start) / step : 0.0;
+    } else {
+        out_term->start = _kgflags_parse_range_bound(kind, term, (size_t)(dash - term), &start_ok);
+        double stop_value = _kgflags_parse_range_bound(kind, dash + 1, (size_t)(end - dash - 1), &stop_ok);
+        count = stop_value - out_term->start + 1.0;
+        step_ok = count >= 0.0; // "5-1" is more likely a mistake than an empty range
+    }
+    if (!start_ok || !stop_ok || !step_ok || !(count <= (double)INT_MAX)) {
         return false;
     }
-
+    out_term->step = step;
+    out_term->count = count > 0.0 ? (int64_t)count : 0;
+    if ((double)out_term->count < count) {
+        out_term->count++; // partial step still starts a value, like ceil without libm
+    }
     return true;
 }
 
-void kgflags_print_errors(void) {
-    for (int i = 0; i < _kgflags_g.errors_count; i++) {
-        _kgflags_error_t *err = &_kgflags_g.errors[i];
-        switch (err->kind) {
-            case KGFLAGS_ERROR_KIND_MISSING_VALUE: {
-                fprintf(stderr, "Missing value for flag: %s%s\n", _kgflags_g.flag_prefix,  err->flag_name);
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_UNKNOWN_FLAG: {
-                fprintf(stderr, "Unrecognized flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG: {
-                fprintf(stderr, "Unassigned required flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_INVALID_INT: {
-                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected integer)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_INVALID_DOUBLE: {
-                fprintf(stderr, "Invalid value for flag: %s%s (got %s, expected number)\n", _kgflags_g.flag_prefix, err->flag_name, err->arg);
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS: {
-                fprintf(stderr, "Too many flags declared.");
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_TOO_MANY_NON_FLAG_ARGS: {
-                fprintf(stderr, "Too many non-flag arguments passed to program.");
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT: {
-                fprintf(stderr, "Multiple assignment of flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
-                break;
-            }
-            case KGFLAGS_ERROR_KIND_DUPLICATE_FLAG: {
-                fprintf(stderr, "Redeclaration of flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
-                break;
+// Walks comma separated terms of expr, skips first skip values and writes at most cap following ones to
+// out_ints or out_doubles. Returns number of values expr stands for, -1 if it's invalid.
+static int64_t _kgflags_expand_range(_kgflags_flag_kind_t kind, const char *expr, int64_t skip, int cap,
+                                     int *out_ints, double *out_doubles, int *out_written) {
+    int64_t values = 0;
+    int written = 0;
+    const char *term = expr;
+    while (true) {
+        const char *comma = strchr(term, ',');
+        size_t length = comma != NULL ? (size_t)(comma - term) : strlen(term);
+        _kgflags_range_term_t range;
+        if (!_kgflags_parse_range_term(kind, term, length, &range)) {
+            return -1;
+        }
+        int64_t first = skip > values ? skip - values : 0;
+        int64_t last = range.count;
+        if (last - first > cap - written) {
+            last = first + (cap - written);
+        }
+        // Values are computed from the index rather than accumulated, so long double ranges don't drift.
+        if (out_ints != NULL) {
+            for (int64_t i = first; i < last; i++) {
+                out_ints[written++] = (int)(range.start + (double)i * range.step);
             }
-            case KGFLAGS_ERROR_KIND_PREFIX_NO: {
-                fprintf(stderr, "Used \"no-\" prefix when declaring boolean flag: %s%s\n", _kgflags_g.flag_prefix, err->flag_name);
-                break;
+        } else if (out_doubles != NULL) {
+            for (int64_t i = first; i < last; i++) {
+                out_doubles[written++] = range.start + (double)i * range.step;
             }
-            default:
-                break;
         }
+        values += range.count;
+        if (values > INT_MAX) {
+            return -1;
+        }
+        if (comma == NULL) {
+            break;
+        }
+        term = comma + 1;
     }
+    if (out_written != NULL) {
+        *out_written = written;
+    }
+    return values;
 }
 
-void kgflags_print_usage() {
-    if (_kgflags_g.custom_description == NULL) {
-        fprintf(stderr, "Usage of %s:\n", _kgflags_g.argv[0]);
+// Number of values an int or double array item stands for, -1 if it's invalid. Plain numbers are tried
+// first, out_range is set for range expressions.
+static int64_t _kgflags_get_item_values(_kgflags_flag_kind_t kind, const char *item, bool *out_range) {
+    bool ok = false;
+    *out_range = false;
+    if (kind == KGFLAGS_FLAG_KIND_INT_ARRAY) {
+        _kgflags_parse_int(item, &ok);
     } else {
-        fprintf(stderr, "%s\n", _kgflags_g.custom_description);
+        _kgflags_parse_double(item, &ok);
+    }
+    if (ok) {
+        return 1;
     }
+    int64_t values = _kgflags_expand_range(kind, item, 0, 0, NULL, NULL, NULL);
+    *out_range = values >= 0;
+    return values;
+}
 
-    fprintf(stderr, "Flags:\n");
+// Writes up to cap values starting at value offset, items are expected to be validated already.
+static int _kgflags_fill_array(_kgflags_flag_kind_t kind, char **items, int count, bool has_ranges, int offset,
+                               int *out_ints, double *out_doubles, int cap) {
+    int written = 0;
+    if (!has_ranges) {
+        bool ok = false;
+        for (int i = offset; i < count && written < cap; i++) {
+            if (out_ints != NULL) {
+                out_ints[written++] = _kgflags_parse_int(items[i], &ok);
+            } else {
+                out_doubles[written++] = _kgflags_parse_double(items[i], &ok);
+            }
+        }
+        return written;
+    }
+    int64_t skip = offset;
+    for (int i = 0; i < count && written < cap; i++) {
+        int item_written = 0;
+        int64_t values = _kgflags_expand_range(kind, items[i], skip, cap - written,
+                                               out_ints != NULL ? out_ints + written : NULL,
+                                               out_doubles != NULL ? out_doubles + written : NULL, &item_written);
+        if (values < 0) {
+            break;
+        }
+        written += item_written;
+        skip = skip > values ? skip - values : 0;
+    }
+    return written;
+}
+
+// Indexes terms of every int and double array with range expressions into entries. An array whose terms
+// don't all fit keeps a NULL index and stays readable through _kgflags_fill_array.
+static void _kgflags_index_ranges(_kgflags_range_entry_t *entries, int capacity) {
+    int used = 0;
     for (int i = 0; i < _kgflags_g.flags_count; i++) {
         _kgflags_flag_t *flag = &_kgflags_g.flags[i];
-        switch (flag->kind) {
-            case KGFLAGS_FLAG_KIND_STRING:
-                fprintf(stderr, "\t%s%s\t(string%s\n", _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
-                if (!flag->required) {
-                    fprintf(stderr, "\t\tDefault: %s\n", flag->default_value.string_value);
-                }
-                break;
-            case KGFLAGS_FLAG_KIND_BOOL: {
-                fprintf(stderr, "\t%s%s, %sno-%s\t(boolean%s\n", _kgflags_g.flag_prefix, flag->name, _kgflags_g.flag_prefix, flag->name,
-                    flag->required ? ")" : ", optional)");
-                if (!flag->required) {
-                    fprintf(stderr, "\t\tDefault: %s\n", flag->default_value.bool_value ? "True" : "False");
-                }
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_INT: {
-                fprintf(stderr, "\t%s%s\t(integer%s\n", _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
-                if (!flag->required) {
-                    fprintf(stderr, "\t\tDefault: %d\n", flag->default_value.int_value);
+        char **items = NULL;
+        int count = 0;
+        const _kgflags_range_entry_t **out_terms = NULL;
+        int *out_terms_count = NULL;
+        if (flag->kind == KGFLAGS_FLAG_KIND_INT_ARRAY && flag->result.int_array->_has_ranges) {
+            items = flag->result.int_array->_items;
+            count = flag->result.int_array->_count;
+            out_terms = &flag->result.int_array->_terms;
+            out_terms_count = &flag->result.int_array->_terms_count;
+        } else if (flag->kind == KGFLAGS_FLAG_KIND_DOUBLE_ARRAY && flag->result.double_array->_has_ranges) {
+            items = flag->result.double_array->_items;
+            count = flag->result.double_array->_count;
+            out_terms = &flag->result.double_array->_terms;
+            out_terms_count = &flag->result.double_array->_terms_count;
+        } else {
+            continue;
+        }
+        *out_terms = NULL;
+        *out_terms_count = 0;
+        int start = used;
+        int64_t first = 0;
+        bool ok = true;
+        for (int j = 0; ok && j < count; j++) {
+            const char *term = items[j];
+            while (true) {
+                const char *comma = strchr(term, ',');
+                size_t length = comma != NULL ? (size_t)(comma - term) : strlen(term);
+                _kgflags_range_term_t range;
+                if (used == capacity || first > INT_MAX || !_kgflags_parse_range_term(flag->kind, term, length, &range)) {
+                    ok = false;
+                    break;
                 }
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_DOUBLE: {
-                fprintf(stderr, "\t%s%s\t(float%s\n", _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
-                if (!flag->required) {
-                    fprintf(stderr, "\t\tDefault: %1.4g\n", flag->default_value.double_value);
+                entries[used].start = range.start;
+                entries[used].step = range.step;
+                entries[used].first = (int)first;
+                used++;
+                first += range.count;
+                if (comma == NULL) {
+                    break;
                 }
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_STRING_ARRAY: {
-                fprintf(stderr, "\t%s%s\t(array of strings%s\n", _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_INT_ARRAY: {
-                fprintf(stderr, "\t%s%s\t(array of integers%s\n", _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY: {
-                fprintf(stderr, "\t%s%s\t(array of floats%s\n", _kgflags_g.flag_prefix, flag->name, flag->required ? ")" : ", optional)");
-                break;
+                term = comma + 1;
             }
-            default:
-                break;
         }
-        if (flag->description) {
-            fprintf(stderr, "\t\t%s\n", flag->description);
+        if (!ok) {
+            used = start;
+            continue;
         }
-        fprintf(stderr, "\n");
+        *out_terms = entries + start;
+        *out_terms_count = used - start;
     }
 }
 
-void kgflags_set_custom_description(const char *description) {
-    _kgflags_g.custom_description = description;
+// Same as _kgflags_fill_array for an array of length values, but the term containing value offset is found
+// by binary search. Each term ends where the next one starts.
+static int _kgflags_fill_indexed(const _kgflags_range_entry_t *terms, int terms_count, int length, int offset,
+                                 int *out_ints, double *out_doubles, int cap) {
+    if (terms_count == 0) {
+        return 0;
+    }
+    int lo = 0;
+    int hi = terms_count;
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        if (terms[mid].first <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    int written = 0;
+    int index = offset - terms[lo].first;
+    for (int t = lo; t < terms_count && written < cap; t++) {
+        int end = t + 1 < terms_count ? terms[t + 1].first : length;
+        for (int i = index; terms[t].first + i < end && written < cap; i++) {
+            double value = terms[t].start + (double)i * terms[t].step;
+            if (out_ints != NULL) {
+                out_ints[written++] = (int)value;
+            } else {
+                out_doubles[written++] = value;
+            }
+        }
+        index = 0;
+    }
+    return written;
 }
 
-int kgflags_string_array_get_count(const kgflags_string_array_t *arr) {
-    return arr->_count;
+// Only stat and access are used, so paths can be checked from parallel-for workers. Without them (neither
+// POSIX nor Windows) a path exists if it can be opened and it's assumed to be a readable file.
+static kgflags_error_kind_t _kgflags_check_path(const char *path, int checks) {
+#if defined(_WIN32)
+    struct _stat st;
+    if (_stat(path, &st) != 0) {
+        return KGFLAGS_ERROR_KIND_PATH_NOT_FOUND;
+    }
+    bool is_file = (st.st_mode & _S_IFREG) != 0;
+    bool is_directory = (st.st_mode & _S_IFDIR) != 0;
+    bool readable = (checks & KGFLAGS_PATH_READABLE) == 0 || _access(path, 4) == 0;
+#elif defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return KGFLAGS_ERROR_KIND_PATH_NOT_FOUND;
+    }
+    bool is_file = S_ISREG(st.st_mode);
+    bool is_directory = S_ISDIR(st.st_mode);
+    bool readable = (checks & KGFLAGS_PATH_READABLE) == 0 || access(path, R_OK) == 0;
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return KGFLAGS_ERROR_KIND_PATH_NOT_FOUND;
+    }
+    fclose(file);
+    bool is_file = true;
+    bool is_directory = false;
+    bool readable = true;
+#endif
+    if ((checks & KGFLAGS_PATH_FILE) && !is_file) {
+        return KGFLAGS_ERROR_KIND_PATH_NOT_FILE;
+    }
+    if ((checks & KGFLAGS_PATH_DIRECTORY) && !is_directory) {
+        return KGFLAGS_ERROR_KIND_PATH_NOT_DIRECTORY;
+    }
+    if (!readable) {
+        return KGFLAGS_ERROR_KIND_PATH_NOT_READABLE;
+    }
+    return KGFLAGS_ERROR_KIND_NONE;
 }
 
-const char* kgflags_string_array_get_item(const kgflags_string_array_t *arr, int at) {
-    if (at < 0 || at >= arr->_count) {
-        return NULL;
+// Empty files aren't mapped (mmap doesn't allow it), their contents point to an empty string.
+static bool _kgflags_map_file(kgflags_file_t *file, size_t max_size) {
+#if !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+    int fd = open(file->_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
     }
-    return arr->_items[at];
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size <= (uint64_t)max_size
+        && (uint64_t)st.st_size <= (uint64_t)SIZE_MAX;
+    const void *data = "";
+    if (ok && st.st_size > 0) {
+        void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = mapped != MAP_FAILED;
+        data = mapped;
+    }
+    close(fd);
+    if (!ok) {
+        return false;
+    }
+    file->_data = data;
+    file->_length = (size_t)st.st_size;
+    file->_mapped_path = file->_path;
+    return true;
+#else
+    (void)file;
+    (void)max_size;
+    return false;
+#endif
 }
 
-int kgflags_int_array_get_count(const kgflags_int_array_t *arr) {
-    return arr->_count;
+// Every file flag is mapped by exactly one job, so jobs don't share any state.
+static void _kgflags_preload_file_job(void *job_ctx, int index) {
+    _kgflags_preload_job_t *job = (_kgflags_preload_job_t*)job_ctx;
+    kgflags_file_t *file = _kgflags_g.flags[job->flags[index]].file;
+    if (file->_data != NULL && file->_mapped_path == file->_path) {
+        return;
+    }
+    kgflags_file_release(file);
+    job->failed[index] = !_kgflags_map_file(file, job->max_size);
 }
 
-int kgflags_int_array_get_item(const kgflags_int_array_t *arr, int at) {
-    if (at < 0 || at >= arr->_count) {
-        return 0;
+static void _kgflags_validate_array_job(void *job_ctx, int chunk) {
+    _kgflags_array_job_t *job = (_kgflags_array_job_t*)job_ctx;
+    int begin = chunk * job->chunk_size;
+    int end = begin + job->chunk_size;
+    if (end > job->count) {
+        end = job->count;
     }
-    const char *str = arr->_items[at];
-    bool ok = false;
-    int res = _kgflags_parse_int(str, &ok);
-    if (!ok) {
-        return 0;
+    // Totals are kept in locals and stored once, neighbouring chunks share cache lines of the job arrays.
+    int64_t chunk_values = 0;
+    bool chunk_ranges = false;
+    for (int i = begin; i < end; i++) {
+        int64_t values = 1;
+        bool range = false;
+        kgflags_error_kind_t error_kind = job->storage != NULL
+            ? _kgflags_convert_item(job->kind, job->items[i], job->storage, i)
+            : _kgflags_check_item(job->kind, job->path_checks, job->items[i], &values, &range);
+        if (error_kind != KGFLAGS_ERROR_KIND_NONE) {
+            job->chunk_failed[chunk] = true;
+            return;
+        }
+        chunk_values += values;
+        chunk_ranges = chunk_ranges || range;
     }
-    return res;
+    job->chunk_values[chunk] = chunk_values;
+    job->chunk_ranges[chunk] = chunk_ranges;
 }
 
-int kgflags_double_array_get_count(const kgflags_double_array_t *arr) {
-    return arr->_count;
+// Chunks are validated (possibly in parallel) without touching shared state, then failed chunks are
+// walked again sequentially so errors end up in the same order as without a parallel-for hook. If any item
+// is a range expression, total number of values is written to out_ranges_length, -1 otherwise.
+static bool _kgflags_validate_array(_kgflags_flag_t *flag, char **items, int count, int *out_ranges_length) {
+    _kgflags_array_job_t job;
+    memset(&job, 0, sizeof(_kgflags_array_job_t));
+    job.items = items;
+    job.count = count;
+    job.kind = flag->kind;
+    job.path_checks = flag->path_checks;
+    if (_kgflags_is_typed_array(flag->kind) && count <= flag->list_capacity) {
+        job.storage = flag->list_storage;
+    }
+
+    int chunks_count = 1;
+    job.chunk_size = count;
+    if (_kgflags_g.parallel_for != NULL && count > 1 && count >= _kgflags_g.parallel_min_items) {
+        chunks_count = count < KGFLAGS_MAX_PARALLEL_CHUNKS ? count : KGFLAGS_MAX_PARALLEL_CHUNKS;
+        job.chunk_size = (count + chunks_count - 1) / chunks_count;
+        chunks_count = (count + job.chunk_size - 1) / job.chunk_size;
+        _kgflags_g.parallel_for(chunks_count, _kgflags_validate_array_job, &job, _kgflags_g.parallel_for_ctx);
+    } else {
+        job.chunk_failed[0] = true;
+    }
+
+    bool all_args_ok = true;
+    for (int chunk = 0; chunk < chunks_count; chunk++) {
+        if (!job.chunk_failed[chunk]) {
+            continue;
+        }
+        int begin = chunk * job.chunk_size;
+        int end = begin + job.chunk_size;
+        if (end > count) {
+            end = count;
+        }
+        job.chunk_values[chunk] = 0;
+        job.chunk_ranges[chunk] = false;
+        for (int i = begin; i < end; i++) {
+            int64_t values = 1;
+            bool range = false;
+            kgflags_error_kind_t error_kind = job.storage != NULL
+                ? _kgflags_convert_item(job.kind, items[i], job.storage, i)
+                : _kgflags_check_item(job.kind, job.path_checks, items[i], &values, &range);
+            if (error_kind == KGFLAGS_ERROR_KIND_NONE) {
+                job.chunk_values[chunk] += values;
+                job.chunk_ranges[chunk] = job.chunk_ranges[chunk] || range;
+                continue;
+            }
+            flag->error = true;
+            all_args_ok = false;
+            int arg_index = (int)(items + i - _kgflags_g.argv);
+            _kgflags_add_error(error_kind, flag->name, items[i], arg_index, i);
+        }
+    }
+
+    int64_t total_values = 0;
+    bool has_ranges = false;
+    for (int chunk = 0; chunk < chunks_count; chunk++) {
+        total_values += job.chunk_values[chunk];
+        has_ranges = has_ranges || job.chunk_ranges[chunk];
+    }
+    if (all_args_ok && has_ranges && total_values > INT_MAX) {
+        flag->error = true;
+        all_args_ok = false;
+        _kgflags_report_too_many_items(NULL, flag->name, NULL, (int)(items - _kgflags_g.argv) - 1, -1, INT_MAX);
+    }
+    if (out_ranges_length != NULL) {
+        *out_ranges_length = has_ranges ? (int)total_values : -1;
+    }
+    return all_args_ok;
 }
 
-double kgflags_double_array_get_item(const kgflags_double_array_t *arr, int at) {
-    if (at < 0 || at >= arr->_count) {
-        return 0.0;
+// Mirrors the main loop of kgflags_parse, with parse state kept in validator.
+static void _kgflags_validate_argv(_kgflags_validator_t *validator) {
+    kgflags_validation_t *result = validator->result;
+    while (validator->arg_cursor < validator->argc) {
+        if (validator->stop_at_first_error && result->errors_count > 0) {
+            return;
+        }
+        const char *arg = validator->argv[validator->arg_cursor];
+        int arg_index = validator->arg_cursor;
+        validator->arg_cursor++;
+        _kgflags_arg_kind_t arg_kind = _kgflags_get_arg_kind(arg);
+        if (arg_kind == KGFLAGS_ARG_KIND_NON_FLAG) {
+            if (!_kgflags_g.permute_argv && validator->non_flag_count >= KGFLAGS_MAX_NON_FLAG_ARGS) {
+                _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_TOO_MANY_NON_FLAG_ARGS, NULL, NULL, arg_index, -1);
+            }
+            validator->non_flag_count++;
+        } else if (arg_kind == KGFLAGS_ARG_KIND_SHORT) {
+            if (_kgflags_g.pass_through && _kgflags_g.short_flags[(unsigned char)arg[1]] == 0) {
+                validator->arg_cursor += _kgflags_get_pass_through_arity(arg, validator->argc - validator->arg_cursor);
+                continue;
+            }
+            for (const char *c = arg + 1; *c != '\0'; c++) {
+                int index = _kgflags_g.short_flags[(unsigned char)*c] - 1;
+                if (index < 0) {
+                    _kgflags_report_unknown_short_flag(validator, arg, arg_index, (int)(c - arg));
+                    break;
+                }
+                bool is_bool = _kgflags_g.flags[index].kind == KGFLAGS_FLAG_KIND_BOOL;
+                validator->inline_value = !is_bool && c[1] != '\0' ? c + 1 : NULL;
+                _kgflags_validate_flag(validator, index);
+                if (!is_bool) {
+                    break;
+                }
+            }
+        } else {
+            const char *flag_name = arg + _kgflags_g.flag_prefix_length;
+            const char *inline_value = strchr(flag_name, '=');
+            unsigned int name_length = inline_value ? (unsigned int)(inline_value - flag_name) : (unsigned int)strlen(flag_name);
+            _kgflags_flag_t *flag = _kgflags_get_flag_n(flag_name, name_length, NULL);
+            if (flag == NULL && _kgflags_g.pass_through) {
+                validator->arg_cursor += _kgflags_get_pass_through_arity(arg, validator->argc - validator->arg_cursor);
+                continue;
+            } else if (flag == NULL) {
+                _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_UNKNOWN_FLAG, flag_name, NULL, arg_index, -1);
+                continue;
+            }
+            validator->inline_value = inline_value ? inline_value + 1 : NULL;
+            _kgflags_validate_flag(validator, (int)(flag - _kgflags_g.flags));
+        }
+    }
+    if (validator->stop_at_first_error && result->errors_count > 0) {
+        return;
+    }
+    _kgflags_check_constraint_bits(validator->assigned_bits, validator->error_bits, validator);
+}
+
+// Same outcome as _kgflags_process_flag, but only assigned/error bits are recorded.
+static void _kgflags_validate_flag(_kgflags_validator_t *validator, int index) {
+    const _kgflags_flag_t *flag = &_kgflags_g.flags[index];
+    uint64_t *assigned = &validator->assigned_bits[index / 64];
+    uint64_t *errors = &validator->error_bits[index / 64];
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    if ((*assigned & bit) && !flag->repeatable) {
+        _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT, flag->name, NULL, validator->arg_cursor - 1, -1);
+    }
+
+    const char *inline_value = validator->inline_value;
+    validator->inline_value = NULL;
+    if (inline_value != NULL && !flag->repeatable && !_kgflags_takes_inline_value(flag->kind)) {
+        *errors |= bit;
+        _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_UNEXPECTED_VALUE, flag->name, inline_value, validator->arg_cursor - 1, -1);
+        return;
+    }
+    if (flag->kind == KGFLAGS_FLAG_KIND_BOOL) {
+        *assigned |= bit;
+        return;
+    }
+    if (!flag->repeatable && !_kgflags_takes_inline_value(flag->kind)) {
+        // Array flags are assigned even if some items are invalid, just like in kgflags_parse.
+        int flag_arg = validator->arg_cursor - 1;
+        int64_t total_values = 0;
+        bool has_ranges = false;
+        bool items_ok = true;
+        for (int i = 0; validator->arg_cursor < validator->argc; i++) {
+            const char *item = validator->argv[validator->arg_cursor];
+            if (_kgflags_is_flag(item)) {
+                break;
+            }
+            int64_t values = 0;
+            bool range = false;
+            kgflags_error_kind_t error_kind = _kgflags_check_item(flag->kind, flag->path_checks, item, &values, &range);
+            if (error_kind != KGFLAGS_ERROR_KIND_NONE) {
+                *errors |= bit;
+                items_ok = false;
+                _kgflags_report_error(validator, error_kind, flag->name, item, validator->arg_cursor, i);
+            } else {
+                total_values += values;
+                has_ranges = has_ranges || range;
+            }
+            validator->arg_cursor++;
+        }
+        int count = validator->arg_cursor - flag_arg - 1;
+        if (items_ok && has_ranges && total_values > INT_MAX) {
+            *errors |= bit;
+            _kgflags_report_too_many_items(validator, flag->name, NULL, flag_arg, -1, INT_MAX);
+        } else if (items_ok && _kgflags_is_typed_array(flag->kind) && count > flag->list_capacity) {
+            int arg_index = flag_arg + 1 + flag->list_capacity;
+            *errors |= bit;
+            _kgflags_report_too_many_items(validator, flag->name, validator->argv[arg_index], arg_index, flag->list_capacity, flag->list_capacity);
+        }
+        *assigned |= bit;
+        return;
+    }
+
+    const char *val = inline_value;
+    if (val == NULL && validator->arg_cursor < validator->argc) {
+        val = validator->argv[validator->arg_cursor];
+        validator->arg_cursor++;
+    }
+    if (val == NULL) {
+        *errors |= bit;
+        _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL, validator->arg_cursor - 1, -1);
+        return;
+    }
+    if (flag->repeatable) {
+        // Occurrences are only counted, checks are the same as in _kgflags_parse_occurrence.
+        int count = validator->occurrences[index];
+        *assigned |= bit;
+        if (count >= flag->list_capacity) {
+            *errors |= bit;
+            _kgflags_report_too_many_items(validator, flag->name, val, validator->arg_cursor - 1, count, flag->list_capacity);
+            return;
+        }
+        int64_t values = 0;
+        bool range = false;
+        kgflags_error_kind_t error_kind = _kgflags_check_item(flag->kind, 0, val, &values, &range);
+        if (error_kind != KGFLAGS_ERROR_KIND_NONE) {
+            *errors |= bit;
+            _kgflags_report_error(validator, error_kind, flag->name, val, validator->arg_cursor - 1, count);
+            return;
+        }
+        bool has_ranges = validator->has_ranges[index];
+        if (range || has_ranges) {
+            values += has_ranges ? validator->ranges_lengths[index] : count;
+            if (values > INT_MAX) {
+                *errors |= bit;
+                _kgflags_report_too_many_items(validator, flag->name, val, validator->arg_cursor - 1, count, INT_MAX);
+                return;
+            }
+            validator->has_ranges[index] = true;
+            validator->ranges_lengths[index] = (int)values;
+        }
+        validator->occurrences[index]++;
+        return;
+    }
+    if (_kgflags_validate_value(validator, flag, val)) {
+        *assigned |= bit;
+    } else {
+        *errors |= bit;
+    }
+}
+
+static bool _kgflags_validate_value(_kgflags_validator_t *validator, const _kgflags_flag_t *flag, const char *val) {
+    bool ok = true;
+    kgflags_error_kind_t error_kind = _kgflags_get_invalid_value_error(flag->kind);
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING:
+            if (flag->path_checks) {
+                error_kind = _kgflags_check_path(val, flag->path_checks);
+                ok = error_kind == KGFLAGS_ERROR_KIND_NONE;
+            }
+            break;
+        case KGFLAGS_FLAG_KIND_INT:
+            _kgflags_parse_int(val, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE:
+            _kgflags_parse_double(val, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_INT64:
+            _kgflags_parse_int64(val, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64:
+            _kgflags_parse_uint64(val, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_SIZE:
+            _kgflags_parse_size(val, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION:
+            _kgflags_parse_duration(val, &ok);
+            break;
+        case KGFLAGS_FLAG_KIND_CHOICE:
+            ok = _kgflags_find_choice(flag, val) >= 0;
+            error_kind = KGFLAGS_ERROR_KIND_INVALID_CHOICE;
+            break;
+        case KGFLAGS_FLAG_KIND_STRING_LIST:
+        case KGFLAGS_FLAG_KIND_INT_LIST:
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST:
+            return _kgflags_validate_list(validator, flag, val, validator->arg_cursor - 1);
+        default:
+            break;
     }
-    const char *str = arr->_items[at];
-    bool ok = false;
-    double res = _kgflags_parse_double(str, &ok);
     if (!ok) {
-        return 0.0;
+        _kgflags_report_error(validator, error_kind, flag->name, val, validator->arg_cursor - 1, -1);
+    }
+    return ok;
+}
+
+// Checks all items of a list argument without writing them to list storage (which is shared), errors go to
+// validator or, if it's NULL, to the parse errors.
+static bool _kgflags_validate_list(_kgflags_validator_t *validator, const _kgflags_flag_t *flag, const char *val, int arg_index) {
+    size_t length = strlen(val);
+    size_t offset = 0;
+    int count = 0;
+    bool all_items_ok = true;
+    bool single = flag->list_delimiter == '\0';
+    while (length > 0 || (single && count == 0)) {
+        const char *item = val + offset;
+        const char *delimiter = (const char*)memchr(item, flag->list_delimiter, length - offset);
+        size_t item_length = delimiter ? (size_t)(delimiter - item) : length - offset;
+        if (count >= flag->list_capacity) {
+            _kgflags_report_too_many_items(validator, flag->name, val, arg_index, count, flag->list_capacity);
+            return false;
+        }
+        bool ok = true;
+        if (flag->kind == KGFLAGS_FLAG_KIND_INT_LIST) {
+            _kgflags_parse_int_span(item, item_length, &ok);
+            if (!ok) {
+                _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_INVALID_INT, flag->name, val, arg_index, count);
+            }
+        } else if (flag->kind == KGFLAGS_FLAG_KIND_DOUBLE_LIST) {
+            _kgflags_parse_double_span(item, item_length, &ok);
+            if (!ok) {
+                _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_INVALID_DOUBLE, flag->name, val, arg_index, count);
+            }
+        } else if (flag->kind == KGFLAGS_FLAG_KIND_CUSTOM_LIST) {
+            const _kgflags_custom_kind_t *custom = &_kgflags_g.custom_kinds[flag->custom_kind];
+            ok = custom->parse(item, item_length, NULL, custom->ctx);
+            if (!ok) {
+                _kgflags_report_error(validator, KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE, flag->name, val, arg_index, single ? -1 : count);
+            }
+        }
+        all_items_ok = all_items_ok && ok;
+        count++;
+        if (delimiter == NULL) {
+            break;
+        }
+        offset += item_length + 1;
     }
-    return res;
+    return all_items_ok;
 }
 
-int kgflags_get_non_flag_args_count(void) {
-    return _kgflags_g.non_flag_count;
+static void _kgflags_validate_batch_job(void *job_ctx, int chunk) {
+    _kgflags_batch_job_t *job = (_kgflags_batch_job_t*)job_ctx;
+    int begin = chunk * job->chunk_size;
+    int end = begin + job->chunk_size;
+    if (end > job->count) {
+        end = job->count;
+    }
+    for (int i = begin; i < end; i++) {
+        if (!kgflags_validate(job->argcs[i], job->argvs[i], job->stop_at_first_error, &job->results[i])) {
+            job->chunk_invalid_count[chunk]++;
+        }
+    }
 }
 
-const char* kgflags_get_non_flag_arg(int at) {
-    if (at < 0 || at >= _kgflags_g.non_flag_count) {
-        return NULL;
+// Pointer to an argument is stored only if the whole argument (with its NUL) fit into the buffer.
+static void _kgflags_end_arg(_kgflags_argv_writer_t *argv_writer) {
+    _kgflags_write(&argv_writer->writer, "", 1);
+    if (argv_writer->writer.len <= argv_writer->writer.cap && argv_writer->argc < argv_writer->argv_cap) {
+        argv_writer->argv[argv_writer->argc] = argv_writer->writer.buf + argv_writer->arg_start;
     }
-    return _kgflags_g.non_flag_args[at];
+    argv_writer->arg_start = argv_writer->writer.len;
+    argv_writer->argc++;
 }
 
-/**************************************************************/
-/* INTERNAL FUNCTIONS */
-/**************************************************************/
-
-static bool _kgflags_is_flag(const char *arg) {
-    return _kgflags_get_flag_name(arg) != NULL;
+// Arrays and lists don't have default values.
+static bool _kgflags_equals_default(const _kgflags_flag_t *flag) {
+    const _kgflags_flag_cold_t *cold = _kgflags_get_cold(flag);
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING:
+            return _kgflags_strings_equal(*flag->result.string_value, cold->default_value.string_value);
+        case KGFLAGS_FLAG_KIND_BOOL:
+            return *flag->result.bool_value == cold->default_value.bool_value;
+        case KGFLAGS_FLAG_KIND_INT:
+        case KGFLAGS_FLAG_KIND_CHOICE:
+            return *flag->result.int_value == cold->default_value.int_value;
+        case KGFLAGS_FLAG_KIND_DOUBLE:
+            return *flag->result.double_value == cold->default_value.double_value;
+        case KGFLAGS_FLAG_KIND_INT64:
+        case KGFLAGS_FLAG_KIND_DURATION:
+            return *flag->result.int64_value == cold->default_value.int64_value;
+        case KGFLAGS_FLAG_KIND_UINT64:
+        case KGFLAGS_FLAG_KIND_SIZE:
+            return *flag->result.uint64_value == cold->default_value.uint64_value;
+        default:
+            return false;
+    }
 }
 
-static const char* _kgflags_get_flag_name(const char* arg) {
-    unsigned long prefix_len = strlen(_kgflags_g.flag_prefix);
-    if (strlen(arg) < prefix_len) {
-        return NULL;
-    }
-    if (strncmp(arg, _kgflags_g.flag_prefix, prefix_len) != 0) {
-        return NULL;
+// Unlike _kgflags_write_flag_value values aren't escaped, they're written so kgflags_parse reads them back exactly.
+static void _kgflags_write_arg_value(_kgflags_writer_t *writer, const _kgflags_flag_t *flag) {
+    char num[64];
+    char delimiter[2] = { flag->list_delimiter, '\0' };
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING:
+            _kgflags_write_string(writer, *flag->result.string_value);
+            break;
+        case KGFLAGS_FLAG_KIND_INT:
+            sprintf(num, "%d", *flag->result.int_value);
+            _kgflags_write_string(writer, num);
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE:
+            sprintf(num, "%.17g", *flag->result.double_value);
+            _kgflags_write_string(writer, num);
+            break;
+        case KGFLAGS_FLAG_KIND_INT64:
+            sprintf(num, "%lld", (long long)*flag->result.int64_value);
+            _kgflags_write_string(writer, num);
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION:
+            sprintf(num, "%lldns", (long long)*flag->result.int64_value);
+            _kgflags_write_string(writer, num);
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64:
+        case KGFLAGS_FLAG_KIND_SIZE:
+            sprintf(num, "%llu", (unsigned long long)*flag->result.uint64_value);
+            _kgflags_write_string(writer, num);
+            break;
+        case KGFLAGS_FLAG_KIND_CHOICE:
+            _kgflags_write_string(writer, flag->choices[*flag->result.int_value]);
+            break;
+        case KGFLAGS_FLAG_KIND_STRING_LIST:
+            _kgflags_write_string(writer, flag->result.string_list->_arg);
+            break;
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST:
+            _kgflags_write_string(writer, flag->result.custom_list->_arg);
+            break;
+        case KGFLAGS_FLAG_KIND_INT_LIST: {
+            const kgflags_int_list_t *list = flag->result.int_list;
+            for (int i = 0; i < list->_count; i++) {
+                _kgflags_write_string(writer, i > 0 ? delimiter : "");
+                sprintf(num, "%d", list->_items[i]);
+                _kgflags_write_string(writer, num);
+            }
+            break;
+        }
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST: {
+            const kgflags_double_list_t *list = flag->result.double_list;
+            for (int i = 0; i < list->_count; i++) {
+                _kgflags_write_string(writer, i > 0 ? delimiter : "");
+                sprintf(num, "%.17g", list->_items[i]);
+                _kgflags_write_string(writer, num);
+            }
+            break;
+        }
+        default:
+            break;
     }
-    return arg + prefix_len;
 }
 
-static void _kgflags_add_flag(_kgflags_flag_t flag) {
-    if (_kgflags_get_flag(flag.name, NULL) != NULL) {
-        _kgflags_add_error(KGFLAGS_ERROR_KIND_DUPLICATE_FLAG, flag.name, NULL);
-        return;
-    }
-    if (_kgflags_g.flags_count >= KGFLAGS_MAX_FLAGS) {
-        _kgflags_add_error(KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS, NULL, NULL);
-        return;
+// Formatted so that parsing it again gives the same value.
+static void _kgflags_write_typed_item(_kgflags_writer_t *writer, const _kgflags_flag_t *flag, int index) {
+    char num[64];
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            sprintf(num, "%lld", (long long)flag->result.int64_array->_items[index]);
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            sprintf(num, "%lldns", (long long)flag->result.duration_array->_items[index]);
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            sprintf(num, "%llu", (unsigned long long)flag->result.uint64_array->_items[index]);
+            break;
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            sprintf(num, "%llu", (unsigned long long)flag->result.size_array->_items[index]);
+            break;
+        default:
+            num[0] = '\0';
+            break;
     }
-    _kgflags_g.flags[_kgflags_g.flags_count] = flag;
-    _kgflags_g.flags_count++;
+    _kgflags_write_string(writer, num);
 }
 
-static _kgflags_flag_t* _kgflags_get_flag(const char* name, bool *out_prefix_no) {
-    if (out_prefix_no) {
-        *out_prefix_no = false;
+static void _kgflags_get_array(const _kgflags_flag_t *flag, char ***out_items, int *out_count) {
+    *out_items = NULL;
+    *out_count = 0;
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+            *out_items = flag->result.string_array->_items;
+            *out_count = flag->result.string_array->_count;
+            break;
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            *out_items = flag->result.int_array->_items;
+            *out_count = flag->result.int_array->_count;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            *out_items = flag->result.double_array->_items;
+            *out_count = flag->result.double_array->_count;
+            break;
+        default:
+            break;
     }
-    for (int i = 0; i < _kgflags_g.flags_count; i++) {
-        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
-        if (strcmp(name, flag->name) == 0) {
-            return flag;
-        }
-        if (flag->kind == KGFLAGS_FLAG_KIND_BOOL && strstr(name, "no-") == name) {
-            if (strcmp(name + 3, flag->name) == 0) {
-                if (out_prefix_no) {
-                    *out_prefix_no = true;
-                }
-                return flag;
-            }
-        }
+}
+
+static void _kgflags_get_typed_array(const _kgflags_flag_t *flag, const void **out_items, int *out_count) {
+    *out_items = NULL;
+    *out_count = 0;
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            *out_items = flag->result.int64_array->_items;
+            *out_count = flag->result.int64_array->_count;
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            *out_items = flag->result.uint64_array->_items;
+            *out_count = flag->result.uint64_array->_count;
+            break;
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            *out_items = flag->result.size_array->_items;
+            *out_count = flag->result.size_array->_count;
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            *out_items = flag->result.duration_array->_items;
+            *out_count = flag->result.duration_array->_count;
+            break;
+        default:
+            break;
     }
-    return NULL;
 }
 
-static int _kgflags_parse_int(const char *str, bool *out_ok) {
-    *out_ok = false;
-    char *end = NULL;
-    long res_l = strtol(str, &end, 10);
-    if (end == str || *end != '\0' || res_l > INT_MAX || res_l < INT_MIN
-    || ((res_l == LONG_MIN || res_l == LONG_MAX) && ERANGE == errno)) {
-        *out_ok = false;
-        return 0;
+static void _kgflags_set_array(_kgflags_flag_t *flag, char **items, int count) {
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING_ARRAY:
+            flag->result.string_array->_items = items;
+            flag->result.string_array->_count = count;
+            break;
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            flag->result.int_array->_items = items;
+            flag->result.int_array->_count = count;
+            flag->result.int_array->_has_ranges = false;
+            flag->result.int_array->_terms = NULL;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            flag->result.double_array->_items = items;
+            flag->result.double_array->_count = count;
+            flag->result.double_array->_has_ranges = false;
+            flag->result.double_array->_terms = NULL;
+            break;
+        default:
+            break;
     }
-    *out_ok = true;
-    return (int)res_l;
 }
 
-static double _kgflags_parse_double(const char *str, bool *out_ok) {
-    *out_ok = false;
-    char *end = NULL;
-    double res = strtod(str, &end);
-    if (end == str || *end != '\0'
-    || ((res == -HUGE_VAL || res == +HUGE_VAL) && ERANGE == errno)) {
-        *out_ok = false;
-        return 0.0;
+static void _kgflags_set_typed_array(_kgflags_flag_t *flag, void *items, int count) {
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+            flag->result.int64_array->_items = (int64_t*)items;
+            flag->result.int64_array->_count = count;
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+            flag->result.uint64_array->_items = (uint64_t*)items;
+            flag->result.uint64_array->_count = count;
+            break;
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+            flag->result.size_array->_items = (uint64_t*)items;
+            flag->result.size_array->_count = count;
+            break;
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            flag->result.duration_array->_items = (int64_t*)items;
+            flag->result.duration_array->_count = count;
+            break;
+        default:
+            break;
     }
-    *out_ok = true;
-    return res;
 }
 
-static void _kgflags_add_error(_kgflags_error_kind_t kind, const char *flag_name, const char *arg) {
-    _kgflags_error_t err;
-    err.kind = kind;
-    err.flag_name = flag_name;
-    err.arg = arg;
-    if (_kgflags_g.errors_count >= KGFLAGS_MAX_ERRORS) {
-        return;
+// -1 unless flag is an int or double array with range expressions among its items.
+static int _kgflags_get_ranges_length(const _kgflags_flag_t *flag) {
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            return flag->result.int_array->_has_ranges ? flag->result.int_array->_length : -1;
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            return flag->result.double_array->_has_ranges ? flag->result.double_array->_length : -1;
+        default:
+            return -1;
     }
-    _kgflags_g.errors[_kgflags_g.errors_count] = err;
-    _kgflags_g.errors_count++;
 }
 
+static void _kgflags_set_ranges_length(_kgflags_flag_t *flag, int length) {
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_INT_ARRAY:
+            flag->result.int_array->_has_ranges = length >= 0;
+            flag->result.int_array->_length = length >= 0 ? length : 0;
+            flag->result.int_array->_terms = NULL;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY:
+            flag->result.double_array->_has_ranges = length >= 0;
+            flag->result.double_array->_length = length >= 0 ? length : 0;
+            flag->result.double_array->_terms = NULL;
+            break;
+        default:
+            break;
+    }
+}
 
-static void _kgflags_assign_default_values() {
-    for (int i = 0; i < _kgflags_g.flags_count; i++) {
-        _kgflags_flag_t *flag = &_kgflags_g.flags[i];
-        if (flag->assigned || flag->required) {
-            continue;
-        }
-        switch (flag->kind) {
-            case KGFLAGS_FLAG_KIND_STRING: {
-                *flag->result.string_value = flag->default_value.string_value;
-                flag->assigned = true;
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_BOOL: {
-                *flag->result.bool_value = flag->default_value.bool_value;
-                flag->assigned = true;
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_INT: {
-                *flag->result.int_value = flag->default_value.int_value;
-                flag->assigned = true;
-                break;
-            }
-            case KGFLAGS_FLAG_KIND_DOUBLE: {
-                *flag->result.double_value = flag->default_value.double_value;
-                flag->assigned = true;
-                break;
-            }
-            default:
-                break;
+// FNV-1a, 64-bit variant for hashes that are stored or compared across processes. It takes 8 bytes per step
+// (little-endian words, tail byte by byte), cache attach hashes schema, arguments and the whole image and byte
+// steps dominated its time. Each step is a bijection of hash, so inputs of equal length that differ in a single
+// word never collide.
+static uint64_t _kgflags_hash_bytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word = 0;
+        for (int j = 0; j < 8; j++) {
+            word |= (uint64_t)bytes[i + j] << (8 * j);
         }
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+    for (; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
     }
+    return hash;
 }
 
-static bool _kgflags_add_non_flag_arg(const char* arg) {
-    if (_kgflags_g.non_flag_count >= KGFLAGS_MAX_NON_FLAG_ARGS) {
-        _kgflags_add_error(KGFLAGS_ERROR_KIND_TOO_MANY_NON_FLAG_ARGS, NULL, NULL);
-        return false;
+// Overwrites already reserved part of output, does nothing for parts that didn't fit.
+static void _kgflags_write_at(_kgflags_writer_t *writer, size_t offset, const void *data, size_t length) {
+    if (offset + length <= writer->cap) {
+        memcpy(writer->buf + offset, data, length);
     }
-    _kgflags_g.non_flag_args[_kgflags_g.non_flag_count] = arg;
-    _kgflags_g.non_flag_count++;
-    return true;
 }
 
-static const char* _kgflags_consume_arg() {
-    if (_kgflags_g.arg_cursor >= _kgflags_g.argc) {
-        return NULL;
+// Padding and reserved bytes are zeroed, so images of the same values are byte for byte identical.
+static size_t _kgflags_image_reserve(_kgflags_writer_t *writer, size_t length, size_t align) {
+    static const char zeros[64] = { 0 };
+    size_t padding = (align - writer->len % align) % align;
+    _kgflags_write(writer, zeros, padding);
+    size_t offset = writer->len;
+    while (length > 0) {
+        size_t chunk = length < sizeof(zeros) ? length : sizeof(zeros);
+        _kgflags_write(writer, zeros, chunk);
+        length -= chunk;
     }
-    const char *res = _kgflags_g.argv[_kgflags_g.arg_cursor];
-    _kgflags_g.arg_cursor++;
-    return res;
+    return offset;
 }
 
-static const char* _kgflags_peek_arg() {
-    if (_kgflags_g.arg_cursor >= _kgflags_g.argc) {
-        return NULL;
+static uint32_t _kgflags_image_append(_kgflags_writer_t *writer, const void *data, size_t length, size_t align) {
+    size_t offset = _kgflags_image_reserve(writer, 0, align);
+    _kgflags_write(writer, (const char*)data, length);
+    return (uint32_t)offset;
+}
+
+static uint32_t _kgflags_image_append_string(_kgflags_writer_t *writer, const char *str) {
+    if (str == NULL) {
+        return 0;
     }
-    return _kgflags_g.argv[_kgflags_g.arg_cursor];
+    return _kgflags_image_append(writer, str, strlen(str) + 1, 1);
 }
 
-static void _kgflags_parse_flag(_kgflags_flag_t *flag, bool prefix_no) {
+static void _kgflags_image_write_record(_kgflags_writer_t *writer, const _kgflags_flag_t *flag, _kgflags_image_record_t *record) {
+    memset(record, 0, sizeof(_kgflags_image_record_t));
+    record->assigned = flag->assigned;
     switch (flag->kind) {
-        case KGFLAGS_FLAG_KIND_STRING: {
-            const char *val = _kgflags_consume_arg();
-            if (!val) {
-                flag->error = true;
-                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL);
-                return;
+        case KGFLAGS_FLAG_KIND_STRING:
+            record->offset = _kgflags_image_append_string(writer, *flag->result.string_value);
+            break;
+        case KGFLAGS_FLAG_KIND_BOOL:
+            record->value.int64_value = *flag->result.bool_value;
+            break;
+        case KGFLAGS_FLAG_KIND_INT:
+        case KGFLAGS_FLAG_KIND_CHOICE:
+            record->value.int64_value = *flag->result.int_value;
+            break;
+        case KGFLAGS_FLAG_KIND_DOUBLE:
+            record->value.double_value = *flag->result.double_value;
+            break;
+        case KGFLAGS_FLAG_KIND_INT64:
+        case KGFLAGS_FLAG_KIND_DURATION:
+            record->value.int64_value = *flag->result.int64_value;
+            break;
+        case KGFLAGS_FLAG_KIND_UINT64:
+        case KGFLAGS_FLAG_KIND_SIZE:
+            record->value.uint64_value = *flag->result.uint64_value;
+            break;
+        case KGFLAGS_FLAG_KIND_STRING_LIST: {
+            const kgflags_string_list_t *list = flag->result.string_list;
+            record->count = (uint32_t)list->_count;
+            record->offset = _kgflags_image_append_string(writer, list->_arg);
+            if (list->_count > 0) {
+                record->spans_offset = _kgflags_image_append(writer, list->_spans, sizeof(kgflags_span_t) * (size_t)list->_count, sizeof(int));
             }
-            *flag->result.string_value = val;
-            flag->assigned = true;
             break;
         }
-        case KGFLAGS_FLAG_KIND_BOOL: {
-            *flag->result.bool_value = !prefix_no;
-            flag->assigned = true;
+        case KGFLAGS_FLAG_KIND_INT_LIST: {
+            const kgflags_int_list_t *list = flag->result.int_list;
+            record->count = (uint32_t)list->_count;
+            if (list->_count > 0) {
+                record->offset = _kgflags_image_append(writer, list->_items, sizeof(int) * (size_t)list->_count, sizeof(int));
+            }
             break;
         }
-        case KGFLAGS_FLAG_KIND_INT: {
-            const char *val = _kgflags_consume_arg();
-            if (!val) {
-                flag->error = true;
-                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL);
-                return;
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST: {
+            const kgflags_double_list_t *list = flag->result.double_list;
+            record->count = (uint32_t)list->_count;
+            if (list->_count > 0) {
+                record->offset = _kgflags_image_append(writer, list->_items, sizeof(double) * (size_t)list->_count, sizeof(double));
             }
-            bool ok = false;
-            int int_val = _kgflags_parse_int(val, &ok);
-            if (!ok) {
-                flag->error = true;
-                _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_INT, flag->name, val);
-                return;
-            }
-            *flag->result.int_value = int_val;
-            flag->assigned = true;
             break;
         }
-        case KGFLAGS_FLAG_KIND_DOUBLE: {
-            const char *val = _kgflags_consume_arg();
-            if (!val) {
-                flag->error = true;
-                _kgflags_add_error(KGFLAGS_ERROR_KIND_MISSING_VALUE, flag->name, NULL);
-                return;
-            }
-            bool ok = false;
-            double double_val = _kgflags_parse_double(val, &ok);
-            if (!ok) {
-                flag->error = true;
-                _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_DOUBLE, flag->name, val);
-                return;
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST: {
+            const kgflags_custom_list_t *list = flag->result.custom_list;
+            size_t elem_size = _kgflags_g.custom_kinds[flag->custom_kind].elem_size;
+            record->count = (uint32_t)list->_count;
+            record->offset = _kgflags_image_append_string(writer, list->_arg);
+            if (list->_count > 0) {
+                record->spans_offset = _kgflags_image_append(writer, list->_items, elem_size * (size_t)list->_count, sizeof(double));
             }
-            *flag->result.double_value = double_val;
-            flag->assigned = true;
             break;
         }
-        case KGFLAGS_FLAG_KIND_STRING_ARRAY: {
-            int initial_cursor = _kgflags_g.arg_cursor;
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY: {
+            const void *items = NULL;
             int count = 0;
-            while (true) {
-                const char *val = _kgflags_peek_arg();
-                if (val == NULL || _kgflags_is_flag(val)) {
-                    break;
-                }
-                _kgflags_consume_arg();
-                count++;
+            _kgflags_get_typed_array(flag, &items, &count);
+            record->count = (uint32_t)count;
+            if (count > 0) {
+                record->offset = _kgflags_image_append(writer, items, sizeof(int64_t) * (size_t)count, sizeof(double));
             }
-            kgflags_string_array_t *arr = flag->result.string_array;
-            arr->_items = _kgflags_g.argv + initial_cursor;
-            arr->_count = count;
-            flag->assigned = true;
             break;
         }
-        case KGFLAGS_FLAG_KIND_INT_ARRAY: {
-            int initial_cursor = _kgflags_g.arg_cursor;
+        default: {
+            char **items = NULL;
             int count = 0;
-            bool all_args_ok = true;
-            while (true) {
-                const char *val = _kgflags_peek_arg();
-                if (val == NULL || _kgflags_is_flag(val)) {
-                    break;
-                }
-                _kgflags_consume_arg();
-                bool ok = false;
-                _kgflags_parse_int(val, &ok);
-                if (!ok) {
-                    flag->error = true;
-                    _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_INT, flag->name, val);
-                    all_args_ok = false;
-                }
-                count++;
+            _kgflags_get_array(flag, &items, &count);
+            record->count = (uint32_t)count;
+            record->value.int64_value = _kgflags_get_ranges_length(flag);
+            if (count == 0) {
+                break;
             }
-            kgflags_int_array_t *arr = flag->result.int_array;
-            if (all_args_ok) {
-                arr->_items = _kgflags_g.argv + initial_cursor;
-                arr->_count = count;
+            size_t table = _kgflags_image_reserve(writer, sizeof(uint32_t) * (size_t)count, sizeof(uint32_t));
+            record->offset = (uint32_t)table;
+            for (int i = 0; i < count; i++) {
+                uint32_t offset = _kgflags_image_append_string(writer, items[i]);
+                _kgflags_write_at(writer, table + sizeof(uint32_t) * (size_t)i, &offset, sizeof(offset));
             }
-            flag->assigned = true;
             break;
         }
-        case KGFLAGS_FLAG_KIND_DOUBLE_ARRAY: {
-            int initial_cursor = _kgflags_g.arg_cursor;
-            int count = 0;
-            bool all_args_ok = true;
-            while (true) {
-                const char *val = _kgflags_peek_arg();
-                if (val == NULL || _kgflags_is_flag(val)) {
-                    break;
-                }
-                _kgflags_consume_arg();
-                bool ok = false;
-                _kgflags_parse_double(val, &ok);
-                if (!ok) {
-                    flag->error = true;
-                    _kgflags_add_error(KGFLAGS_ERROR_KIND_INVALID_DOUBLE, flag->name, val);
-                    all_args_ok = false;
-                }
-                count++;
+    }
+}
+
+// NUL terminator has to be inside the image too, offset 0 stands for NULL.
+static bool _kgflags_image_string_ok(const char *base, size_t size, uint32_t offset) {
+    return offset == 0 || (offset < size && memchr(base + offset, '\0', size - offset) != NULL);
+}
+
+// Paths could've been removed or changed since the cache was written, so they're checked again just like
+// kgflags_parse would check them. Record has to be checked with _kgflags_image_record_ok first.
+static bool _kgflags_image_paths_ok(const _kgflags_flag_t *flag, const _kgflags_image_record_t *record, const char *base) {
+    if (flag->kind == KGFLAGS_FLAG_KIND_STRING) {
+        return record->offset == 0 || _kgflags_check_path(base + record->offset, flag->path_checks) == KGFLAGS_ERROR_KIND_NONE;
+    }
+    for (uint32_t i = 0; i < record->count; i++) {
+        uint32_t offset = 0;
+        memcpy(&offset, base + record->offset + sizeof(uint32_t) * i, sizeof(offset));
+        if (_kgflags_check_path(base + offset, flag->path_checks) != KGFLAGS_ERROR_KIND_NONE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks that everything a record refers to lies inside the image and that values are ones kgflags_parse could
+// have produced, so attached flags never point past the image or past their storage.
+static bool _kgflags_image_record_ok(const _kgflags_flag_t *flag, const _kgflags_image_record_t *record, const char *base, size_t size) {
+    size_t count = record->count;
+    switch (flag->kind) {
+        case KGFLAGS_FLAG_KIND_STRING:
+            return _kgflags_image_string_ok(base, size, record->offset);
+        case KGFLAGS_FLAG_KIND_CHOICE:
+            return record->value.int64_value >= -1 && record->value.int64_value < flag->choices_count;
+        case KGFLAGS_FLAG_KIND_STRING_LIST: {
+            if (count > (size_t)flag->list_capacity || !_kgflags_image_string_ok(base, size, record->offset)
+                || record->spans_offset + sizeof(kgflags_span_t) * count > size) {
+                return false;
             }
-            kgflags_double_array_t *arr = flag->result.double_array;
-            if (all_args_ok) {
-                arr->_items = _kgflags_g.argv + initial_cursor;
-                arr->_count = count;
+            size_t arg_length = record->offset ? strlen(base + record->offset) : 0;
+            for (size_t i = 0; i < count; i++) {
+                kgflags_span_t span;
+                memcpy(&span, base + record->spans_offset + sizeof(kgflags_span_t) * i, sizeof(span));
+                if (span.offset < 0 || span.length < 0 || (size_t)span.offset + (size_t)span.length > arg_length) {
+                    return false;
+                }
             }
-            flag->assigned = true;
-            break;
+            return true;
         }
+        case KGFLAGS_FLAG_KIND_INT_LIST:
+            return count <= (size_t)flag->list_capacity && record->offset + sizeof(int) * count <= size;
+        case KGFLAGS_FLAG_KIND_DOUBLE_LIST:
+            return count <= (size_t)flag->list_capacity && record->offset + sizeof(double) * count <= size;
+        case KGFLAGS_FLAG_KIND_INT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_UINT64_ARRAY:
+        case KGFLAGS_FLAG_KIND_SIZE_ARRAY:
+        case KGFLAGS_FLAG_KIND_DURATION_ARRAY:
+            return count <= (size_t)flag->list_capacity && record->offset + sizeof(int64_t) * count <= size;
+        case KGFLAGS_FLAG_KIND_CUSTOM_LIST:
+            return _kgflags_image_string_ok(base, size, record->offset) && count <= (size_t)flag->list_capacity
+                && record->spans_offset + _kgflags_g.custom_kinds[flag->custom_kind].elem_size * count <= size;
         default:
-            break;
+            if (_kgflags_takes_inline_value(flag->kind) || flag->kind == KGFLAGS_FLAG_KIND_BOOL) {
+                return true;
+            }
+            if (count > (size_t)INT_MAX || record->offset + sizeof(uint32_t) * count > size) {
+                return false;
+            }
+            if (flag->repeatable && count > (size_t)flag->list_capacity) {
+                return false;
+            }
+            if (record->value.int64_value < -1 || record->value.int64_value > INT_MAX) {
+                return false;
+            }
+            for (size_t i = 0; i < count; i++) {
+                uint32_t offset = 0;
+                memcpy(&offset, base + record->offset + sizeof(uint32_t) * i, sizeof(offset));
+                if (offset == 0 || !_kgflags_image_string_ok(base, size, offset)) {
+                    return false;
+                }
+            }
+            return true;
     }
 }
 
@@ -0,0 +1,452 @@
+/*
+ Copyright (c) 2019 Krzysztof Gabis
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+// Benchmarks, run with:
+//   gcc -O2 -std=c99 -pthread bench.c -o bench && ./bench [threads [section]]
+// where section is one of arrays, lookup, validate, cache and ranges (all of them by default). run_tests.sh
+// runs arrays and validate with 1 and 4 threads, other sections are only built.
+// "./bench stress [threads]" instead runs reader threads against a reloading thread and exits with 1 if a
+// reader saw a torn snapshot, run_tests.sh builds it with -fsanitize=thread.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define KGFLAGS_IMPLEMENTATION
+#include "../kgflags.h"
+
+#define BENCH_MAX_THREADS 64
+
+typedef struct bench_pool_worker {
+    pthread_t thread;
+    int first;
+    int count;
+    int step;
+    void (*job)(void *job_ctx, int index);
+    void *job_ctx;
+} bench_pool_worker_t;
+
+static int bench_threads = 4;
+
+static double bench_now(void);
+static bool bench_section_enabled(const char *section, const char *name);
+static void* bench_pool_run(void *arg);
+static void bench_parallel_for(int count, void (*job)(void *job_ctx, int index), void *job_ctx, void *user_ctx);
+static char** bench_make_number_args(int count, const char *flag, int *out_argc, char **out_text);
+static void bench_parallel_arrays(int count);
+static void bench_lookup(int flags_count, int iterations);
+static void bench_validate_batch(int count);
+static void bench_parse_cache(int iterations);
+static void bench_range_items(int items_count);
+static void* bench_stress_read(void *arg);
+static bool bench_reload_stress(int reloads);
+
+int main(int argc, char **argv) {
+    bool stress = argc > 1 && strcmp(argv[1], "stress") == 0;
+    int threads_arg = stress ? 2 : 1;
+    if (argc > threads_arg) {
+        bench_threads = atoi(argv[threads_arg]);
+        if (bench_threads < 1 || bench_threads > BENCH_MAX_THREADS) {
+            fprintf(stderr, "threads must be in [1, %d]\n", BENCH_MAX_THREADS);
+            return 1;
+        }
+    }
+    printf("threads: %d\n", bench_threads);
+    if (stress) {
+        return bench_reload_stress(20000) ? 0 : 1;
+    }
+    const char *section = argc > 2 ? argv[2] : NULL;
+    if (bench_section_enabled(section, "arrays")) {
+        bench_parallel_arrays(1000 * 1000);
+        bench_parallel_arrays(10 * 1000 * 1000);
+    }
+    if (bench_section_enabled(section, "lookup")) {
+        bench_lookup(32, 20000);
+        bench_lookup(KGFLAGS_MAX_FLAGS, 2000);
+    }
+    if (bench_section_enabled(section, "validate")) {
+        bench_validate_batch(1000);
+        bench_validate_batch(100 * 1000);
+    }
+    if (bench_section_enabled(section, "cache")) {
+        bench_parse_cache(20000);
+    }
+    if (bench_section_enabled(section, "ranges")) {
+        bench_range_items(100);
+        bench_range_items(KGFLAGS_MAX_RANGE_TERMS / 2);
+    }
+    return 0;
+}
+
+static bool bench_section_enabled(const char *section, const char *name) {
+    return section == NULL || strcmp(section, name) == 0;
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void* bench_pool_run(void *arg) {
+    bench_pool_worker_t *worker = (bench_pool_worker_t*)arg;
+    for (int i = worker->first; i < worker->count; i += worker->step) {
+        worker->job(worker->job_ctx, i);
+    }
+    return NULL;
+}
+
+// Minimal parallel-for hook: one thread per worker, jobs are dealt round-robin.
+static void bench_parallel_for(int count, void (*job)(void *job_ctx, int index), void *job_ctx, void *user_ctx) {
+    (void)user_ctx;
+    bench_pool_worker_t workers[BENCH_MAX_THREADS];
+    int threads = bench_threads < count ? bench_threads : count;
+    for (int i = 0; i < threads; i++) {
+        workers[i].first = i;
+        workers[i].count = count;
+        workers[i].step = threads;
+        workers[i].job = job;
+        workers[i].job_ctx = job_ctx;
+        pthread_create(&workers[i].thread, NULL, bench_pool_run, &workers[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+// "app flag 0 1 2 ...", numbers are written to a single block returned in out_text.
+static char** bench_make_number_args(int count, const char *flag, int *out_argc, char **out_text) {
+    char **args = (char**)malloc(sizeof(char*) * ((size_t)count + 2));
+    char *text = (char*)malloc((size_t)count * 12);
+    char *cursor = text;
+    args[0] = (char*)"app";
+    args[1] = (char*)flag;
+    for (int i = 0; i < count; i++) {
+        args[i + 2] = cursor;
+        cursor += sprintf(cursor, "%d", i * 7 - count) + 1;
+    }
+    *out_argc = count + 2;
+    *out_text = text;
+    return args;
+}
+
+// user-026: validation of large numeric arrays, sequential vs. through the parallel-for hook.
+static void bench_parallel_arrays(int count) {
+    int args_count = 0;
+    char *text = NULL;
+    char **args = bench_make_number_args(count, "--ids", &args_count, &text);
+    double times[2];
+    for (int parallel = 0; parallel < 2; parallel++) {
+        kgflags_int_array_t ids;
+        kgflags_reset_values();
+        kgflags_int_array("ids", NULL, true, &ids);
+        kgflags_set_parallel_for(parallel ? bench_parallel_for : NULL, NULL, 4096);
+        double start = bench_now();
+        bool ok = kgflags_parse(args_count, args);
+        times[parallel] = bench_now() - start;
+        if (!ok || kgflags_int_array_get_count(&ids) != count) {
+            printf("parallel arrays: parse failed\n");
+            return;
+        }
+        memset(&_kgflags_g, 0, sizeof(_kgflags_g)); // declared flags are dropped, next run declares them again
+    }
+    printf("parallel arrays, %d items: sequential %.3fs, parallel %.3fs (%.2fx)\n",
+           count, times[0], times[1], times[0] / times[1]);
+    free(args);
+    free(text);
+}
+
+// user-028: parse of a command line that sets every declared flag, dominated by flag lookups.
+static void bench_lookup(int flags_count, int iterations) {
+    static char names[KGFLAGS_MAX_FLAGS][32];
+    static char args_text[KGFLAGS_MAX_FLAGS][40];
+    static char *args[KGFLAGS_MAX_FLAGS * 2 + 1];
+    static int values[KGFLAGS_MAX_FLAGS];
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    args[0] = (char*)"app";
+    for (int i = 0; i < flags_count; i++) {
+        sprintf(names[i], "option-number-%d", i);
+        sprintf(args_text[i], "--%s", names[i]);
+        kgflags_int(names[i], 0, NULL, false, &values[i]);
+        // Flags are set in reverse declaration order so a linear scan would be at its worst.
+        args[(flags_count - i) * 2 - 1] = args_text[i];
+        args[(flags_count - i) * 2] = (char*)"1";
+    }
+    double start = bench_now();
+    for (int i = 0; i < iterations; i++) {
+        kgflags_reset_values();
+        if (!kgflags_parse(flags_count * 2 + 1, args)) {
+            printf("lookup: parse failed\n");
+            return;
+        }
+    }
+    double elapsed = bench_now() - start;
+    printf("lookup, %d flags: %.1f ns per flag\n", flags_count, elapsed * 1e9 / ((double)iterations * flags_count));
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+}
+
+// user-040: batch validation of many command lines, sequential vs. through the parallel-for hook.
+static void bench_validate_batch(int count) {
+    static char *argv_a[] = { "app", "in.txt", "--port", "8080", "--verbose", "--weights", "0.5", "1.5", "2.5" };
+    static char *argv_b[] = { "app", "--name", "worker", "--weights", "1..64", "--ids", "1,2,3,4", "out.txt" };
+    static char *argv_c[] = { "app", "--port", "x", "--ids", "1,2" }; // invalid port
+    char ***argvs = (char***)malloc(sizeof(char**) * (size_t)count);
+    int *argcs = (int*)malloc(sizeof(int) * (size_t)count);
+    kgflags_validation_t *results = (kgflags_validation_t*)malloc(sizeof(kgflags_validation_t) * (size_t)count);
+    for (int i = 0; i < count; i++) {
+        argvs[i] = i % 3 == 0 ? argv_a : i % 3 == 1 ? argv_b : argv_c;
+        argcs[i] = i % 3 == 0 ? (int)(sizeof(argv_a) / sizeof(argv_a[0]))
+                 : i % 3 == 1 ? (int)(sizeof(argv_b) / sizeof(argv_b[0])) : (int)(sizeof(argv_c) / sizeof(argv_c[0]));
+    }
+
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    int port = 0;
+    bool verbose = false;
+    const char *name = NULL;
+    int ids_storage[8];
+    kgflags_int_list_t ids;
+    kgflags_double_array_t weights;
+    kgflags_int("port", 80, NULL, false, &port);
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    kgflags_string("name", NULL, NULL, false, &name);
+    kgflags_int_list("ids", ',', ids_storage, 8, NULL, false, &ids);
+    kgflags_double_array("weights", NULL, false, &weights);
+    kgflags_freeze();
+
+    double times[2];
+    int invalid[2];
+    for (int parallel = 0; parallel < 2; parallel++) {
+        kgflags_set_parallel_for(parallel ? bench_parallel_for : NULL, NULL, 64);
+        double start = bench_now();
+        invalid[parallel] = kgflags_validate_batch(count, argcs, argvs, false, results);
+        times[parallel] = bench_now() - start;
+    }
+    if (invalid[0] != invalid[1] || invalid[0] != count / 3) {
+        printf("validate batch: unexpected results\n");
+    } else {
+        printf("validate batch, %d argvs: sequential %.1f ns, parallel %.1f ns per argv (%.2fx)\n",
+               count, times[0] * 1e9 / count, times[1] * 1e9 / count, times[0] / times[1]);
+    }
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    free(argvs);
+    free(argcs);
+    free(results);
+}
+
+// user-044: startup without cache (parse), with cache read from file (load) and already in memory (attach).
+static void bench_parse_cache(int iterations) {
+    static char names[64][32];
+    static char args_text[64][40];
+    static char *args[64 * 2 + 1];
+    static int values[64];
+    static uint64_t cache[4096];
+    static uint64_t loaded[4096];
+    const char *path = "bench_cache.bin";
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    args[0] = (char*)"app";
+    for (int i = 0; i < 64; i++) {
+        sprintf(names[i], "option-number-%d", i);
+        sprintf(args_text[i], "--%s", names[i]);
+        kgflags_int(names[i], 0, NULL, false, &values[i]);
+        args[i * 2 + 1] = args_text[i];
+        args[i * 2 + 2] = (char*)"12345";
+    }
+    kgflags_freeze(); // schema hash is computed once, like it'd be at startup of a program using the cache
+    int argc = 64 * 2 + 1;
+    if (!kgflags_parse(argc, args) || !kgflags_cache_save(path, argc, args, cache, sizeof(cache))) {
+        printf("parse cache: save failed\n");
+        return;
+    }
+    size_t size = kgflags_cache_write(cache, sizeof(cache), argc, args);
+
+    double times[3];
+    for (int mode = 0; mode < 3; mode++) {
+        double start = bench_now();
+        for (int i = 0; i < iterations; i++) {
+            kgflags_reset_values();
+            bool ok = mode == 0 ? kgflags_parse(argc, args)
+                    : mode == 1 ? kgflags_cache_load(path, argc, args, loaded, sizeof(loaded), NULL, 0)
+                    : kgflags_cache_attach(cache, size, argc, args, NULL, 0);
+            if (!ok || values[63] != 12345) {
+                printf("parse cache: mode %d failed\n", mode);
+                remove(path);
+                return;
+            }
+        }
+        times[mode] = (bench_now() - start) * 1e9 / iterations;
+    }
+    printf("parse cache, 64 flags: parse %.0f ns, load %.0f ns, attach %.0f ns\n", times[0], times[1], times[2]);
+    remove(path);
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+}
+
+// user-049: reading every value of an array of range expressions through get_item, with the term index
+// and walking items from the start like arrays that don't fit KGFLAGS_MAX_RANGE_TERMS.
+static void bench_range_items(int items_count) {
+    static char items_text[KGFLAGS_MAX_RANGE_TERMS][32];
+    static char *args[KGFLAGS_MAX_RANGE_TERMS + 2];
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    kgflags_int_array_t ids;
+    kgflags_int_array("ids", NULL, true, &ids);
+    args[0] = (char*)"app";
+    args[1] = (char*)"--ids";
+    for (int i = 0; i < items_count; i++) {
+        sprintf(items_text[i], "%d..%d", i * 4, i * 4 + 4);
+        args[i + 2] = items_text[i];
+    }
+    if (!kgflags_parse(items_count + 2, args) || ids._terms == NULL) {
+        printf("range items: parse failed\n");
+        return;
+    }
+    double times[2];
+    long long sum = 0;
+    for (int walked = 0; walked < 2; walked++) {
+        if (walked) {
+            ids._terms = NULL;
+        }
+        double start = bench_now();
+        for (int i = 0; i < kgflags_int_array_get_count(&ids); i++) {
+            sum += kgflags_int_array_get_item(&ids, i);
+        }
+        times[walked] = bench_now() - start;
+    }
+    printf("range items, %d items: indexed %.1f ns, walked %.1f ns per get_item (sum %lld)\n", items_count,
+           times[0] * 1e9 / (items_count * 4), times[1] * 1e9 / (items_count * 4), sum);
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+}
+
+// user-031: readers keep reading published snapshots while one thread reloads into a pool of them. A reader
+// announces the snapshot it uses in its hazard slot and rechecks that it's still published, the reloader only
+// reuses snapshots that are neither published nor announced. Every snapshot holds one generation number in
+// an int, a list and a string array, so a reader seeing a snapshot while it's rewritten finds them differ.
+#define BENCH_STRESS_SNAPSHOTS (BENCH_MAX_THREADS + 2)
+
+typedef struct bench_stress {
+    kgflags_snapshot_t *current;
+    kgflags_snapshot_t *hazards[BENCH_MAX_THREADS];
+    bool stop;
+    int gen_id;
+    int ids_id;
+    int peers_id;
+    int torn[BENCH_MAX_THREADS];
+    int reads[BENCH_MAX_THREADS];
+} bench_stress_t;
+
+typedef struct bench_stress_reader {
+    pthread_t thread;
+    bench_stress_t *stress;
+    int index;
+} bench_stress_reader_t;
+
+static void* bench_stress_read(void *arg) {
+    bench_stress_reader_t *reader = (bench_stress_reader_t*)arg;
+    bench_stress_t *stress = reader->stress;
+    kgflags_snapshot_t **hazard = &stress->hazards[reader->index];
+    while (!__atomic_load_n(&stress->stop, __ATOMIC_ACQUIRE)) {
+        const kgflags_snapshot_t *snapshot = NULL;
+        do {
+            snapshot = kgflags_snapshot_acquire(&stress->current);
+            __atomic_store_n(hazard, (kgflags_snapshot_t*)snapshot, __ATOMIC_SEQ_CST);
+        } while (snapshot != __atomic_load_n(&stress->current, __ATOMIC_SEQ_CST));
+        int gen = kgflags_snapshot_get_int(snapshot, stress->gen_id);
+        const kgflags_int_list_t *ids = kgflags_snapshot_get_int_list(snapshot, stress->ids_id);
+        const kgflags_string_array_t *peers = kgflags_snapshot_get_string_array(snapshot, stress->peers_id);
+        bool ok = kgflags_int_list_get_count(ids) == 2 && kgflags_int_list_get_items(ids)[0] == gen
+            && kgflags_int_list_get_items(ids)[1] == -gen && kgflags_string_array_get_count(peers) == 1
+            && atoi(kgflags_string_array_get_item(peers, 0) + 1) == gen;
+        __atomic_store_n(hazard, NULL, __ATOMIC_RELEASE);
+        stress->torn[reader->index] += ok ? 0 : 1;
+        stress->reads[reader->index]++;
+    }
+    return NULL;
+}
+
+static bool bench_reload_stress(int reloads) {
+    static kgflags_snapshot_t snapshots[BENCH_STRESS_SNAPSHOTS];
+    static char texts[BENCH_STRESS_SNAPSHOTS][3][32];
+    static char *argvs[BENCH_STRESS_SNAPSHOTS][7];
+    static bench_stress_t stress;
+    bench_stress_reader_t readers[BENCH_MAX_THREADS];
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    int gen = 0;
+    int ids_storage[2];
+    kgflags_int_list_t ids;
+    kgflags_string_array_t peers;
+    kgflags_int("gen", 0, NULL, true, &gen);
+    kgflags_int_list("ids", ',', ids_storage, 2, NULL, true, &ids);
+    kgflags_string_array("peers", NULL, true, &peers);
+    kgflags_freeze();
+    memset(&stress, 0, sizeof(stress));
+    stress.gen_id = kgflags_get_flag_id("gen");
+    stress.ids_id = kgflags_get_flag_id("ids");
+    stress.peers_id = kgflags_get_flag_id("peers");
+
+    for (int i = 0; i <= reloads; i++) {
+        // Slot that's neither published nor announced by a reader, there's always one since there are more
+        // snapshots than readers + 1.
+        int slot = -1;
+        for (int candidate = 0; slot < 0; candidate = (candidate + 1) % BENCH_STRESS_SNAPSHOTS) {
+            bool used = &snapshots[candidate] == __atomic_load_n(&stress.current, __ATOMIC_SEQ_CST);
+            for (int r = 0; r < bench_threads && !used; r++) {
+                used = __atomic_load_n(&stress.hazards[r], __ATOMIC_SEQ_CST) == &snapshots[candidate];
+            }
+            slot = used ? -1 : candidate;
+        }
+        sprintf(texts[slot][0], "%d", i);
+        sprintf(texts[slot][1], "%d,%d", i, -i);
+        sprintf(texts[slot][2], "p%d", i);
+        char **argv = argvs[slot];
+        argv[0] = (char*)"app";
+        argv[1] = (char*)"--gen";
+        argv[2] = texts[slot][0];
+        argv[3] = (char*)"--ids";
+        argv[4] = texts[slot][1];
+        argv[5] = (char*)"--peers";
+        argv[6] = texts[slot][2];
+        if (!kgflags_reload(7, argv, &snapshots[slot])) {
+            printf("reload stress: reload failed\n");
+            return false;
+        }
+        kgflags_snapshot_publish(&stress.current, &snapshots[slot]);
+        if (i == 0) {
+            for (int r = 0; r < bench_threads; r++) {
+                readers[r].stress = &stress;
+                readers[r].index = r;
+                pthread_create(&readers[r].thread, NULL, bench_stress_read, &readers[r]);
+            }
+        }
+    }
+    __atomic_store_n(&stress.stop, true, __ATOMIC_RELEASE);
+    int torn = 0;
+    long long reads = 0;
+    for (int r = 0; r < bench_threads; r++) {
+        pthread_join(readers[r].thread, NULL);
+        torn += stress.torn[r];
+        reads += stress.reads[r];
+    }
+    printf("reload stress, %d reloads, %d readers: %lld reads, %d torn\n", reloads, bench_threads, reads, torn);
+    memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    // Variables passed when declaring flags are never written by reload.
+    return torn == 0 && gen == 0;
+}
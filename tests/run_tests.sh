@@ -58,6 +58,62 @@ do
 	fi
 done
 
+echo "Compiling bench.c with ${CC} ${CFLAGS} -pthread:"
+${CC} ${CFLAGS} -pthread bench.c -o "${OUTDIR}/bench"
+RES=$?
+
+if [ ${RES} != "0" ]; then
+	echo " FAIL"
+	TESTS_OK=false
+else
+	echo "	OK"
+fi
+
+# Timings are only printed, a run fails if a benchmark reports wrong results.
+function run_bench {
+	SECTION=$1
+	for THREADS in 1 4
+	do
+		echo "Running ${SECTION} benchmark with ${THREADS} threads:"
+		"./${OUTDIR}/bench_O2" ${THREADS} ${SECTION} > "${OUTDIR}/bench_${SECTION}_${THREADS}"
+		RES=$?
+		cat "${OUTDIR}/bench_${SECTION}_${THREADS}"
+
+		if [ ${RES} != "0" ] || grep -q "failed\|unexpected" "${OUTDIR}/bench_${SECTION}_${THREADS}"; then
+			echo " FAIL"
+			TESTS_OK=false
+		else
+			echo "	OK"
+		fi
+	done
+}
+
+echo "Compiling bench.c with ${CC} -O2 -std=c99 -pthread:"
+${CC} -O2 -std=c99 -pthread bench.c -o "${OUTDIR}/bench_O2"
+RES=$?
+
+if [ ${RES} != "0" ]; then
+	echo " FAIL"
+	TESTS_OK=false
+else
+	echo "	OK"
+	run_bench arrays
+	run_bench validate
+fi
+
+echo "Compiling bench.c with ${CC} ${CFLAGS} -pthread -fsanitize=thread and running reload stress:"
+${CC} ${CFLAGS} -O1 -pthread -fsanitize=thread bench.c -o "${OUTDIR}/bench_tsan"
+TSAN_OPTIONS="halt_on_error=1" "./${OUTDIR}/bench_tsan" stress 4 > "${OUTDIR}/bench_tsan_output" 2>&1
+RES=$?
+
+if [ ${RES} != "0" ]; then
+	echo " FAIL"
+	cat "${OUTDIR}/bench_tsan_output"
+	TESTS_OK=false
+else
+	echo "	OK (output in ${OUTDIR}/bench_tsan_output)"
+fi
+
 echo "Compiling, running and comparing output of ../examples/full_api.c with ${CC} ${CFLAGS}:"
 ${CC} ${CFLAGS} ../examples/full_api.c -o "${OUTDIR}/full_api"
 "./${OUTDIR}/full_api" -extra-flag 2> "${OUTDIR}/full_api_output"
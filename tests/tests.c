@@ -25,6 +25,8 @@
 #include <string.h>
 
 #define KGFLAGS_IMPLEMENTATION
+#define KGFLAGS_TRACE
+#define KGFLAGS_TRACE_CAPACITY 16
 #include "../kgflags.h"
 
 #define TEST(DESC, A) printf("%4d: %-72s-", __LINE__, DESC);\
@@ -37,22 +39,95 @@ else{puts(" FAIL");tests_failed++;}
 
 static void test_suite_expected(void);
 static void test_suite_uncommon(void);
+static void test_suite_many_flags(void);
 static void test_suite_errors(void);
 static void test_suite_int(void);
 static void test_suite_double(void);
-
-static bool test_kgflags_contains_error(_kgflags_error_kind_t kind);
+static void test_suite_parallel(void);
+static void test_suite_reset_values(void);
+static void test_suite_dump(void);
+static void test_suite_reload(void);
+static void test_suite_completion(void);
+static void test_suite_int64_size_duration(void);
+static void test_suite_choice(void);
+static void test_suite_lists(void);
+static void test_suite_permute_argv(void);
+static void test_suite_constraints(void);
+static void test_suite_section_registration(void);
+static void test_suite_short_names(void);
+static void test_suite_validate(void);
+static void test_suite_pass_through(void);
+static void test_suite_serialize_argv(void);
+static void test_suite_image(void);
+static void test_suite_parse_cache(void);
+static void test_suite_trace(void);
+static void test_suite_repeatable(void);
+static void test_suite_paths(void);
+static void test_suite_files(void);
+static void test_suite_ranges(void);
+static void test_suite_custom(void);
+
+static bool test_kgflags_contains_error(kgflags_error_kind_t kind);
+static void test_reverse_parallel_for(int count, void (*job)(void *job_ctx, int index), void *job_ctx, void *user_ctx);
+static int test_pass_through_arity(const char *flag_arg, void *ctx);
+
+typedef struct test_image_flags {
+    const char *name;
+    bool verbose;
+    double ratio;
+    uint64_t cache;
+    int mode;
+    kgflags_string_array_t files;
+    kgflags_int_array_t ids;
+    int weights_storage[8];
+    kgflags_int_list_t weights;
+    kgflags_span_t tags_storage[8];
+    kgflags_string_list_t tags;
+} test_image_flags_t;
+
+static void test_declare_image_flags(test_image_flags_t *flags);
 static void test_kgflags_reset(void);
 
 static int tests_passed;
 static int tests_failed;
 
+#ifdef KGFLAGS_HAS_SECTION_REGISTRATION
+KGFLAGS_DEFINE_STRING(spec_host, "spec-host", "localhost", "Host.", false);
+KGFLAGS_DEFINE_INT(spec_port, "spec-port", 80, "Port.", false);
+KGFLAGS_DEFINE_SIZE(spec_cache, "spec-cache", 1024, "Cache size.", true);
+KGFLAGS_DEFINE_INT_ARRAY(spec_ids, "spec-ids", "Ids.", false);
+#endif
+
 int main() {
     test_suite_expected();
     test_suite_uncommon();
+    test_suite_many_flags();
     test_suite_errors();
     test_suite_int();
     test_suite_double();
+    test_suite_parallel();
+    test_suite_reset_values();
+    test_suite_dump();
+    test_suite_reload();
+    test_suite_completion();
+    test_suite_int64_size_duration();
+    test_suite_choice();
+    test_suite_lists();
+    test_suite_permute_argv();
+    test_suite_constraints();
+    test_suite_section_registration();
+    test_suite_short_names();
+    test_suite_validate();
+    test_suite_pass_through();
+    test_suite_serialize_argv();
+    test_suite_image();
+    test_suite_parse_cache();
+    test_suite_trace();
+    test_suite_repeatable();
+    test_suite_paths();
+    test_suite_files();
+    test_suite_ranges();
+    test_suite_custom();
     printf("Tests failed: %d\n", tests_failed);
     printf("Tests passed: %d\n", tests_passed);
     return tests_failed;
@@ -187,6 +262,22 @@ static void test_suite_uncommon() {
     }
 }
 
+static void test_suite_many_flags() {
+    test_kgflags_reset();
+    static char names[KGFLAGS_MAX_FLAGS][32];
+    static int values[KGFLAGS_MAX_FLAGS];
+    for (int i = 0; i < KGFLAGS_MAX_FLAGS; i++) {
+        sprintf(names[i], "flag-%d", i);
+        kgflags_int(names[i], i, NULL, false, &values[i]);
+    }
+    char *argv[] = { "", "--flag-0", "-1", "--flag-128", "-2", "--flag-255", "-3" };
+    TEST("Max flags declared", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("flag-0 == -1", values[0] == -1);
+    TEST("flag-128 == -2", values[128] == -2);
+    TEST("flag-255 == -3", values[255] == -3);
+    TEST("flag-77 == 77 (default)", values[77] == 77);
+}
+
 static void test_suite_errors() {
     {
         test_kgflags_reset();
@@ -194,7 +285,7 @@ static void test_suite_errors() {
         const char *str = NULL;
         kgflags_string("string", NULL, NULL, true, &str);
         TEST("Missing value (string)", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_MISSING_VALUE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MISSING_VALUE));
     }
 
@@ -204,7 +295,7 @@ static void test_suite_errors() {
         int intval = 0;
         kgflags_int("intval", 0, NULL, true, &intval);
         TEST("Missing value (int)", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_MISSING_VALUE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MISSING_VALUE));
     }
 
@@ -214,7 +305,7 @@ static void test_suite_errors() {
         double dblval = 0.0;
         kgflags_double("double", 0.0, NULL, true, &dblval);
         TEST("Missing value (double)", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_MISSING_VALUE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MISSING_VALUE));
     }
 
@@ -222,7 +313,7 @@ static void test_suite_errors() {
         test_kgflags_reset();
         char *argv[] = { "", "--unknown", "val" };
         TEST("Unknown flag", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_UNKNOWN_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG));
     }
 
@@ -232,7 +323,7 @@ static void test_suite_errors() {
         double dblval = 0.0;
         kgflags_double("non-flag", 0.0, NULL, true, &dblval);
         TEST("Non-flag flag", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG));
     }
 
@@ -242,7 +333,7 @@ static void test_suite_errors() {
         int intval = 0;
         kgflags_int("invalid-int", 0.0, NULL, true, &intval);
         TEST("Invalid int", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
     }
 
@@ -252,7 +343,7 @@ static void test_suite_errors() {
         int intval = 0;
         kgflags_int("invalid-int", 0.0, NULL, true, &intval);
         TEST("Invalid int (double)", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
     }
 
@@ -262,8 +353,15 @@ static void test_suite_errors() {
         kgflags_int_array_t arr;
         kgflags_int_array("invalid-int", NULL, true, &arr);
         TEST("Invalid int in array", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
+        kgflags_error_info_t err;
+        TEST("Error info", kgflags_get_error(0, &err));
+        TEST("Error flag name", STREQ(err.flag_name, "invalid-int"));
+        TEST("Error value", STREQ(err.value, "abc"));
+        TEST("Error arg index == 4", err.arg_index == 4);
+        TEST("Error item index == 2", err.item_index == 2);
+        TEST("Error out of range", kgflags_get_error(1, &err) == false);
         TEST("Array count == 0", kgflags_int_array_get_count(&arr) == 0);
     }
 
@@ -273,7 +371,7 @@ static void test_suite_errors() {
         double dblval = 0.0;
         kgflags_double("invalid-double", 0.0, NULL, true, &dblval);
         TEST("Invalid double", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_DOUBLE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_DOUBLE));
     }
 
@@ -283,7 +381,7 @@ static void test_suite_errors() {
         kgflags_double_array_t arr;
         kgflags_double_array("invalid-double", NULL, true, &arr);
         TEST("Invalid double in array", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_DOUBLE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_DOUBLE));
         TEST("Array count == 0", kgflags_double_array_get_count(&arr) == 0);
     }
@@ -298,7 +396,7 @@ static void test_suite_errors() {
             kgflags_int(buf, 0.0, NULL, true, intval);
         }
         TEST("Too many flags", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_FLAGS));
     }
 
@@ -308,7 +406,7 @@ static void test_suite_errors() {
         char *argv[] = { "", "--string", "val1", "--string", "val2" };
         kgflags_string("string", NULL, NULL, true, &str);
         TEST("Multiple assignment", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT));
     }
 
@@ -319,7 +417,19 @@ static void test_suite_errors() {
         kgflags_string("string", NULL, NULL, true, &strval1);
         kgflags_string("string", NULL, NULL, true, &strval2);
         TEST("Duplicate flag", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
+        TEST("KGFLAGS_ERROR_KIND_DUPLICATE_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_DUPLICATE_FLAG));
+    }
+
+    {
+        test_kgflags_reset();
+        char *argv[] = { "", };
+        bool boolval = false;
+        const char *strval = NULL;
+        kgflags_bool("bool", false, NULL, false, &boolval);
+        kgflags_string("no-bool", NULL, NULL, false, &strval);
+        TEST("Duplicate of negated bool flag", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_DUPLICATE_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_DUPLICATE_FLAG));
     }
 
@@ -329,7 +439,7 @@ static void test_suite_errors() {
         bool boolval = false;
         kgflags_bool("no-bool", false, NULL, true, &boolval);
         TEST("Bool flag with no- prefix", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_PREFIX_NO set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_PREFIX_NO));
     }
 
@@ -339,7 +449,7 @@ static void test_suite_errors() {
         const char *strval = NULL;
         kgflags_string("unknown", NULL, NULL, true, &strval);
         TEST("Unknown flag with no-prefix (non-boolean)", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 2);
+        TEST("Errors count == 1", kgflags_get_error_count() == 2);
         TEST("KGFLAGS_ERROR_KIND_UNKNOWN_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG));
         TEST("KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG));
     }
@@ -370,7 +480,7 @@ void test_suite_int() {
         int intval = 0;
         kgflags_int("intval", 0, NULL, true, &intval);
         TEST("Invalid int value - extra character", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
     }
 
@@ -380,7 +490,7 @@ void test_suite_int() {
         int intval = 0;
         kgflags_int("intval", 0, NULL, true, &intval);
         TEST("Invalid int value - string", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
     }
 
@@ -405,7 +515,7 @@ void test_suite_int() {
         int intval = 0;
         kgflags_int("intval", 0, NULL, true, &intval);
         TEST("INT_MAX + 1", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
     }
 
@@ -430,7 +540,7 @@ void test_suite_int() {
         int intval = 0;
         kgflags_int("intval", 0, NULL, true, &intval);
         TEST("INT_MIN - 1", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
     }
 }
@@ -510,21 +620,1502 @@ static void test_suite_double() {
         double dblval = 0.0;
         kgflags_double("dblval", 0.0, NULL, true, &dblval);
         TEST("Invalid double", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
-        TEST("Errors count == 1", _kgflags_g.errors_count == 1);
+        TEST("Errors count == 1", kgflags_get_error_count() == 1);
         TEST("KGFLAGS_ERROR_KIND_INVALID_DOUBLE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_DOUBLE));
     }
 }
 
-static bool test_kgflags_contains_error(_kgflags_error_kind_t kind) {
-    for (int i = 0; i < _kgflags_g.errors_count; i++) {
-        _kgflags_error_t *err = &_kgflags_g.errors[i];
-        if (err->kind == kind) {
+static void test_suite_parallel() {
+    {
+        test_kgflags_reset();
+        char *argv[1 + 1 + 100];
+        char bufs[100][16];
+        argv[0] = (char*)"";
+        argv[1] = (char*)"--ints";
+        for (int i = 0; i < 100; i++) {
+            sprintf(bufs[i], "%d", i);
+            argv[2 + i] = bufs[i];
+        }
+        int calls = 0;
+        kgflags_int_array_t arr;
+        kgflags_int_array("ints", NULL, true, &arr);
+        kgflags_set_parallel_for(test_reverse_parallel_for, &calls, 10);
+        TEST("Parallel int array", kgflags_parse(ARRAY_SIZE(argv), argv));
+        TEST("Parallel-for hook called", calls > 1);
+        TEST("Array count == 100", kgflags_int_array_get_count(&arr) == 100);
+        TEST("Array [99] == 99", kgflags_int_array_get_item(&arr, 99) == 99);
+    }
+
+    {
+        test_kgflags_reset();
+        char *argv[1 + 1 + 100];
+        char bufs[100][16];
+        argv[0] = (char*)"";
+        argv[1] = (char*)"--doubles";
+        for (int i = 0; i < 100; i++) {
+            sprintf(bufs[i], "%d.5", i);
+            argv[2 + i] = bufs[i];
+        }
+        argv[2 + 7] = (char*)"abc";
+        argv[2 + 93] = (char*)"def";
+        int calls = 0;
+        kgflags_double_array_t arr;
+        kgflags_double_array("doubles", NULL, true, &arr);
+        kgflags_set_parallel_for(test_reverse_parallel_for, &calls, 10);
+        TEST("Parallel invalid double array", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
+        TEST("Errors count == 2", kgflags_get_error_count() == 2);
+        kgflags_error_info_t err0, err1;
+        kgflags_get_error(0, &err0);
+        kgflags_get_error(1, &err1);
+        TEST("Errors in item order", STREQ(err0.value, "abc") && STREQ(err1.value, "def"));
+        TEST("Error item indices", err0.item_index == 7 && err1.item_index == 93);
+        TEST("Error arg indices", err0.arg_index == 9 && err1.arg_index == 95);
+        TEST("Array count == 0", kgflags_double_array_get_count(&arr) == 0);
+    }
+}
+
+static void test_suite_reset_values() {
+    test_kgflags_reset();
+
+    const char *strval = NULL;
+    kgflags_string("string", "default", NULL, false, &strval);
+    int intval = 0;
+    kgflags_int("int", 0, NULL, true, &intval);
+    kgflags_string_array_t arr;
+    kgflags_string_array("arr", NULL, false, &arr);
+
+    {
+        char *argv[] = { "", "--int", "1", "--string", "a", "non-flag", "--arr", "x", "y" };
+        TEST("First parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+        TEST("string == a", STREQ(strval, "a"));
+        TEST("Array count == 2", kgflags_string_array_get_count(&arr) == 2);
+        TEST("Non-flag args count == 1", kgflags_get_non_flag_args_count() == 1);
+    }
+
+    {
+        kgflags_reset_values();
+        char *argv[] = { "", "--int", "abc", "--string", "a", "--string", "b" };
+        TEST("Second parse fails", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
+        TEST("Errors count == 2", kgflags_get_error_count() == 2);
+        TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
+        TEST("KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT));
+    }
+
+    {
+        kgflags_reset_values();
+        char *argv[] = { "", "--int", "3" };
+        TEST("Third parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+        TEST("Errors count == 0", kgflags_get_error_count() == 0);
+        TEST("int == 3", intval == 3);
+        TEST("string == default", STREQ(strval, "default"));
+        TEST("Array count == 0", kgflags_string_array_get_count(&arr) == 0);
+        TEST("Non-flag args count == 0", kgflags_get_non_flag_args_count() == 0);
+    }
+
+    {
+        kgflags_reset_values();
+        char *argv[] = { "" };
+        TEST("Required flag unassigned after reset", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
+        TEST("KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG));
+    }
+}
+
+static void test_suite_dump() {
+    test_kgflags_reset();
+    char *argv[] = { "", "--string", "a \"b\"", "--ints", "1", "+2" };
+
+    const char *strval = NULL;
+    kgflags_string("string", NULL, NULL, true, &strval);
+    bool boolval = false;
+    kgflags_bool("bool", true, NULL, false, &boolval);
+    double dblval = 0.0;
+    kgflags_double("double", 0.5, NULL, false, &dblval);
+    kgflags_int_array_t ints;
+    kgflags_int_array("ints", NULL, true, &ints);
+    kgflags_string_array_t strs;
+    kgflags_string_array("strs", NULL, false, &strs);
+    TEST("Parse before dump", kgflags_parse(ARRAY_SIZE(argv), argv));
+
+    char buf[1024];
+    const char *expected_json =
+        "{\"name\":\"string\",\"source\":\"argv\",\"value\":\"a \\\"b\\\"\"}\n"
+        "{\"name\":\"bool\",\"source\":\"default\",\"value\":true}\n"
+        "{\"name\":\"double\",\"source\":\"default\",\"value\":0.5}\n"
+        "{\"name\":\"ints\",\"source\":\"argv\",\"value\":[1,2]}\n"
+        "{\"name\":\"strs\",\"source\":\"default\",\"value\":[]}\n";
+    int len = kgflags_dump(buf, sizeof(buf), KGFLAGS_DUMP_FORMAT_JSON_LINES);
+    TEST("JSON Lines dump", strcmp(buf, expected_json) == 0);
+    TEST("JSON Lines dump length", len == (int)strlen(expected_json));
+
+    const char *expected_kv =
+        "argv string=a \"b\"\n"
+        "default bool=true\n"
+        "default double=0.5\n"
+        "argv ints=1,2\n"
+        "default strs=\n";
+    len = kgflags_dump(buf, sizeof(buf), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    TEST("key=value dump", strcmp(buf, expected_kv) == 0);
+
+    char small[8];
+    len = kgflags_dump(small, sizeof(small), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    TEST("Truncated dump", len == (int)strlen(expected_kv) && strlen(small) == sizeof(small) - 1);
+}
+
+static void test_suite_reload() {
+    test_kgflags_reset();
+
+    int port = 0;
+    kgflags_int("port", 80, NULL, false, &port);
+    const char *host = NULL;
+    kgflags_string("host", "localhost", NULL, false, &host);
+    kgflags_string_array_t peers;
+    kgflags_string_array("peers", NULL, false, &peers);
+
+    char *argv[] = { "", "--port", "8080" };
+    TEST("Initial parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+
+    int port_id = kgflags_get_flag_id("port");
+    int host_id = kgflags_get_flag_id("host");
+    int peers_id = kgflags_get_flag_id("peers");
+    TEST("Flag ids", port_id == 0 && host_id == 1 && peers_id == 2);
+    TEST("Unknown flag id", kgflags_get_flag_id("unknown") == -1);
+
+    static kgflags_snapshot_t snapshots[2];
+    kgflags_snapshot_t *current = NULL;
+
+    char *argv1[] = { "", "--port", "9090" };
+    TEST("First reload", kgflags_reload(ARRAY_SIZE(argv1), argv1, &snapshots[0]));
+    kgflags_snapshot_publish(&current, &snapshots[0]);
+    const kgflags_snapshot_t *snapshot = kgflags_snapshot_acquire(&current);
+    TEST("Snapshot port == 9090", kgflags_snapshot_get_int(snapshot, port_id) == 9090);
+    TEST("Snapshot host == localhost", STREQ(kgflags_snapshot_get_string(snapshot, host_id), "localhost"));
+    TEST("Variables not modified", port == 8080);
+
+    char *argv2[] = { "", "--port", "9090", "--peers", "a", "b" };
+    TEST("Second reload", kgflags_reload(ARRAY_SIZE(argv2), argv2, &snapshots[1]));
+    int changed[4];
+    int changed_count = kgflags_snapshot_diff(&snapshots[0], &snapshots[1], changed, 4);
+    TEST("One flag changed", changed_count == 1 && changed[0] == peers_id);
+    kgflags_snapshot_publish(&current, &snapshots[1]);
+    snapshot = kgflags_snapshot_acquire(&current);
+    TEST("Snapshot peers count == 2", kgflags_string_array_get_count(kgflags_snapshot_get_string_array(snapshot, peers_id)) == 2);
+
+    char *argv3[] = { "", "--port", "abc" };
+    TEST("Invalid reload", kgflags_reload(ARRAY_SIZE(argv3), argv3, &snapshots[0]) == false);
+    TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
+    TEST("Published snapshot intact", kgflags_snapshot_get_int(kgflags_snapshot_acquire(&current), port_id) == 9090);
+    TEST("Variables still not modified", port == 8080 && kgflags_string_array_get_count(&peers) == 0);
+
+    test_kgflags_reset();
+    int id_items[4];
+    kgflags_int_list_t ids;
+    kgflags_int_list("ids", ',', id_items, 4, NULL, false, &ids);
+    char *tag_items[4];
+    kgflags_string_array_t tags;
+    kgflags_string_repeatable("tag", tag_items, 4, NULL, false, &tags);
+    char *argv_lists1[] = { "", "--ids", "1,2", "--tag", "a" };
+    char *argv_lists2[] = { "", "--ids", "3,4", "--tag", "b" };
+    TEST("Reload lists", kgflags_reload(ARRAY_SIZE(argv_lists1), argv_lists1, &snapshots[0]));
+    TEST("Reload lists again", kgflags_reload(ARRAY_SIZE(argv_lists2), argv_lists2, &snapshots[1]));
+    const kgflags_int_list_t *ids0 = kgflags_snapshot_get_int_list(&snapshots[0], 0);
+    const kgflags_int_list_t *ids1 = kgflags_snapshot_get_int_list(&snapshots[1], 0);
+    TEST("First snapshot keeps its list", kgflags_int_list_get_count(ids0) == 2
+         && kgflags_int_list_get_items(ids0)[0] == 1 && kgflags_int_list_get_items(ids0)[1] == 2);
+    TEST("Second snapshot has new list", kgflags_int_list_get_count(ids1) == 2 && kgflags_int_list_get_items(ids1)[0] == 3);
+    TEST("First snapshot keeps repeatable values",
+         STREQ(kgflags_string_array_get_item(kgflags_snapshot_get_string_array(&snapshots[0], 1), 0), "a"));
+    changed_count = kgflags_snapshot_diff(&snapshots[0], &snapshots[1], changed, 4);
+    TEST("List and repeatable flags changed", changed_count == 2 && changed[0] == 0 && changed[1] == 1);
+    TEST("Caller's storage not used", kgflags_int_list_get_count(&ids) == 0 && kgflags_string_array_get_count(&tags) == 0);
+
+    test_kgflags_reset();
+    kgflags_string_array("peers", NULL, false, &peers);
+    int small_items[2];
+    kgflags_int_list_t small;
+    kgflags_int_list("small", ',', small_items, 2, NULL, false, &small);
+    char *argv_live[] = { "app", "rest", "--small", "5,6", "--peers", "a", "b" };
+    TEST("Parse before reload", kgflags_parse(ARRAY_SIZE(argv_live), argv_live));
+    char dump_before[256];
+    char dump_after[256];
+    char serialized_before[256];
+    char serialized_after[256];
+    char *serialized_argv[16];
+    int serialized_argc = ARRAY_SIZE(serialized_argv);
+    kgflags_dump(dump_before, sizeof(dump_before), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    int serialized_length = kgflags_serialize_argv(serialized_before, sizeof(serialized_before), serialized_argv, &serialized_argc);
+    char *argv_other[] = { "other", "x", "y", "--peers", "c", "--small", "9" };
+    TEST("Reload other arguments", kgflags_reload(ARRAY_SIZE(argv_other), argv_other, &snapshots[0]));
+    kgflags_dump(dump_after, sizeof(dump_after), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    serialized_argc = ARRAY_SIZE(serialized_argv);
+    int serialized_length_after = kgflags_serialize_argv(serialized_after, sizeof(serialized_after), serialized_argv, &serialized_argc);
+    TEST("Non-flag args still of the parse", kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "rest"));
+    TEST("Dump still of the parse", strcmp(dump_before, dump_after) == 0);
+    TEST("Serialized argv still of the parse", serialized_length == serialized_length_after && serialized_argc == 6
+         && memcmp(serialized_before, serialized_after, (size_t)serialized_length) == 0 && STREQ(serialized_argv[0], "app"));
+    char *argv_bad[] = { "other", "--small", "x" };
+    TEST("Failed reload", kgflags_reload(ARRAY_SIZE(argv_bad), argv_bad, &snapshots[0]) == false
+         && kgflags_get_error_count() == 1 && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
+    TEST("Non-flag args kept after failed reload", kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "rest"));
+
+    test_kgflags_reset();
+    kgflags_string_array("peers", NULL, false, &peers);
+    kgflags_int_list("small", ',', small_items, 2, NULL, false, &small);
+    static int big_items[KGFLAGS_SNAPSHOT_STORAGE_SIZE / sizeof(int) + 1];
+    kgflags_int_list_t big;
+    kgflags_int_list("big", ',', big_items, ARRAY_SIZE(big_items), NULL, false, &big);
+    TEST("Parse with large list", kgflags_parse(ARRAY_SIZE(argv_live), argv_live));
+    TEST("Storage full", kgflags_reload(ARRAY_SIZE(argv_other), argv_other, &snapshots[0]) == false
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_SNAPSHOT_STORAGE_FULL));
+    TEST("Array result kept", kgflags_string_array_get_count(&peers) == 2 && STREQ(kgflags_string_array_get_item(&peers, 1), "b"));
+    TEST("List result kept", kgflags_int_list_get_count(&small) == 2 && small_items[0] == 5 && small_items[1] == 6);
+    TEST("Non-flag args kept", kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "rest"));
+}
+
+static void test_suite_completion() {
+    test_kgflags_reset();
+
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    int version = 0;
+    kgflags_int("version", 0, NULL, false, &version);
+    const char *name = NULL;
+    kgflags_string("name", NULL, NULL, false, &name);
+    bool nocache = false;
+    kgflags_bool("cache", true, NULL, false, &nocache);
+
+    char buf[256];
+    kgflags_get_completions("--ver", buf, sizeof(buf));
+    TEST("Completions for --ver", strcmp(buf, "--verbose\n--version\n") == 0);
+    kgflags_get_completions("--n", buf, sizeof(buf));
+    TEST("Completions for --n", strcmp(buf, "--name\n--no-cache\n--no-verbose\n") == 0);
+    kgflags_get_completions("-", buf, sizeof(buf));
+    TEST("Completions for -", strcmp(buf, "--cache\n--name\n--no-cache\n--no-verbose\n--verbose\n--version\n") == 0);
+    int len = kgflags_get_completions("--x", buf, sizeof(buf));
+    TEST("No completions for --x", len == 0 && strcmp(buf, "") == 0);
+    len = kgflags_get_completions("abc", buf, sizeof(buf));
+    TEST("No completions for non-flag", len == 0);
+
+    char *argv[] = { "", "--name", "x" };
+    TEST("kgflags_complete ignores regular args", kgflags_complete(ARRAY_SIZE(argv), argv) == false);
+}
+
+static void test_suite_int64_size_duration() {
+    test_kgflags_reset();
+
+    int64_t bytes = 0;
+    kgflags_int64("bytes", 0, NULL, true, &bytes);
+    uint64_t mask = 0;
+    kgflags_uint64("mask", 0, NULL, true, &mask);
+    uint64_t cache = 0;
+    kgflags_size("cache", 0, NULL, true, &cache);
+    uint64_t page = 0;
+    kgflags_size("page", 0, NULL, true, &page);
+    int64_t timeout = 0;
+    kgflags_duration("timeout", 0, NULL, true, &timeout);
+    int64_t delay = 0;
+    kgflags_duration("delay", 0, NULL, true, &delay);
+    int64_t retry = 0;
+    kgflags_duration("retry", 30000000000, NULL, false, &retry);
+    uint64_t buffers_storage[4];
+    kgflags_size_array_t buffers;
+    kgflags_size_array("buffers", buffers_storage, 4, NULL, true, &buffers);
+    int64_t backoff_storage[3];
+    kgflags_duration_array_t backoff;
+    kgflags_duration_array("backoff", backoff_storage, 3, NULL, true, &backoff);
+
+    char *argv[] = {
+        "",
+        "--bytes", "2147483648",
+        "--mask", "18446744073709551615",
+        "--cache", "4MiB",
+        "--page", "1.5K",
+        "--timeout", "1.5s",
+        "--delay", "-250us",
+        "--buffers", "64K", "2GB", "512",
+        "--backoff", "2h", "0", "10ms",
+    };
+    TEST("Parse int64, size and duration flags", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("bytes == 2147483648", bytes == 2147483648LL);
+    TEST("mask == UINT64_MAX", mask == UINT64_MAX);
+    TEST("cache == 4MiB", cache == 4 * 1024 * 1024);
+    TEST("page == 1536", page == 1536);
+    TEST("timeout == 1.5s", timeout == 1500000000);
+    TEST("delay == -250us", delay == -250000);
+    TEST("retry has default value", retry == 30000000000LL);
+    TEST("buffers count == 3", kgflags_size_array_get_count(&buffers) == 3);
+    TEST("buffers[0] == 65536", kgflags_size_array_get_item(&buffers, 0) == 65536);
+    TEST("buffers[1] == 2000000000", kgflags_size_array_get_item(&buffers, 1) == 2000000000);
+    TEST("buffers[2] == 512", kgflags_size_array_get_item(&buffers, 2) == 512);
+    TEST("backoff[0] == 2h", kgflags_duration_array_get_item(&backoff, 0) == 7200000000000LL);
+    TEST("backoff[1] == 0", kgflags_duration_array_get_item(&backoff, 1) == 0);
+    TEST("backoff[2] == 10ms", kgflags_duration_array_get_item(&backoff, 2) == 10000000);
+    TEST("buffers items are in storage", kgflags_size_array_get_items(&buffers) == buffers_storage && buffers_storage[1] == 2000000000);
+
+    test_kgflags_reset();
+    kgflags_int64("min", 0, NULL, true, &bytes);
+    kgflags_int64("max", 0, NULL, true, &bytes);
+    kgflags_uint64("mask", 0, NULL, true, &mask);
+    char *argv_limits[] = { "", "--min", "-9223372036854775808", "--max", "9223372036854775808", "--mask", "-1" };
+    TEST("Parse 64-bit limits", kgflags_parse(ARRAY_SIZE(argv_limits), argv_limits) == false);
+    TEST("Two errors", kgflags_get_error_count() == 2);
+    TEST("KGFLAGS_ERROR_KIND_INVALID_INT64 set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT64));
+    TEST("KGFLAGS_ERROR_KIND_INVALID_UINT64 set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_UINT64));
+    TEST("min == INT64_MIN", bytes == INT64_MIN);
+
+    test_kgflags_reset();
+    kgflags_size("cache", 0, NULL, true, &cache);
+    kgflags_duration("timeout", 0, NULL, true, &timeout);
+    kgflags_size_array("buffers", buffers_storage, 4, NULL, true, &buffers);
+    char *argv_invalid[] = { "", "--cache", "20000000000T", "--timeout", "15", "--buffers", "1K", "1X", "." };
+    TEST("Parse invalid sizes and durations", kgflags_parse(ARRAY_SIZE(argv_invalid), argv_invalid) == false);
+    TEST("Four errors", kgflags_get_error_count() == 4);
+    TEST("KGFLAGS_ERROR_KIND_INVALID_SIZE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_SIZE));
+    TEST("KGFLAGS_ERROR_KIND_INVALID_DURATION set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_DURATION));
+    kgflags_error_info_t err;
+    kgflags_get_error(3, &err);
+    TEST("Last error is for buffers item 2", STREQ(err.flag_name, "buffers") && err.item_index == 2 && err.arg_index == 8);
+
+    test_kgflags_reset();
+    int64_t offsets_storage[2];
+    kgflags_int64_array_t offsets;
+    kgflags_int64_array("offsets", offsets_storage, 2, NULL, true, &offsets);
+    char *argv_capacity[] = { "", "--offsets", "1", "2", "3" };
+    TEST("Parse int64 array over capacity", kgflags_parse(ARRAY_SIZE(argv_capacity), argv_capacity) == false);
+    TEST("KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS));
+    kgflags_get_error(0, &err);
+    TEST("Error points at first item over capacity", err.arg_index == 4 && err.item_index == 2 && err.limit == 2);
+    TEST("offsets not set", kgflags_int64_array_get_count(&offsets) == 0 && kgflags_int64_array_get_items(&offsets) == NULL);
+}
+
+static void test_suite_choice() {
+    test_kgflags_reset();
+
+    static const char *const compressions[] = { "zstd", "lz4", "none" };
+    static const char *const levels[] = { "debug", "info", "warning", "error" };
+    int compression = 0;
+    kgflags_choice("compression", compressions, 3, -1, NULL, true, &compression);
+    int level = 0;
+    kgflags_choice("level", levels, 4, 1, NULL, false, &level);
+    TEST("Unset choice is -1", compression == -1);
+
+    char *argv[] = { "", "--compression", "lz4" };
+    TEST("Parse choice flags", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("compression == lz4", compression == 1);
+    TEST("level has default value", level == 1);
+
+    kgflags_reset_values();
+    char *argv_invalid[] = { "", "--compression", "lz", "--level", "error" };
+    TEST("Parse invalid choice", kgflags_parse(ARRAY_SIZE(argv_invalid), argv_invalid) == false);
+    TEST("KGFLAGS_ERROR_KIND_INVALID_CHOICE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_CHOICE));
+    kgflags_error_info_t err;
+    kgflags_get_error(0, &err);
+    TEST("Error has offending value", STREQ(err.value, "lz") && err.arg_index == 2);
+    TEST("level == error", level == 3);
+
+    char buf[128];
+    kgflags_dump(buf, sizeof(buf), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    TEST("Dump writes choice name", strstr(buf, "level=error") != NULL);
+
+    test_kgflags_reset();
+    kgflags_choice("format", compressions, 3, 3, NULL, false, &compression);
+    kgflags_choice("empty", compressions, 0, -1, NULL, false, &level);
+    char *argv_empty[] = { "" };
+    TEST("Parse with invalid choice declarations", kgflags_parse(ARRAY_SIZE(argv_empty), argv_empty) == false);
+    TEST("KGFLAGS_ERROR_KIND_INVALID_CHOICE set for default", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_CHOICE));
+    TEST("KGFLAGS_ERROR_KIND_TOO_MANY_CHOICES set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_CHOICES));
+}
+
+static void test_suite_lists() {
+    test_kgflags_reset();
+
+    kgflags_span_t name_spans[4];
+    kgflags_string_list_t names;
+    kgflags_string_list("names", ',', name_spans, 4, NULL, true, &names);
+    int id_items[8];
+    kgflags_int_list_t ids;
+    kgflags_int_list("ids", ',', id_items, 8, NULL, true, &ids);
+    double weight_items[4];
+    kgflags_double_list_t weights;
+    kgflags_double_list("weights", ':', weight_items, 4, NULL, true, &weights);
+    int port = 0;
+    kgflags_int("port", 0, NULL, true, &port);
+
+    char *argv[] = { "", "--names", "ala,,kot", "--ids=1,-2,300", "--weights=0.5:1e3", "--port=8080" };
+    TEST("Parse lists and inline values", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("names count == 3", kgflags_string_list_get_count(&names) == 3);
+    kgflags_span_t span = kgflags_string_list_get_span(&names, 2);
+    TEST("names[2] == kot", span.offset == 5 && span.length == 3
+         && strncmp(kgflags_string_list_get_arg(&names) + span.offset, "kot", 3) == 0);
+    TEST("names[1] is empty", kgflags_string_list_get_span(&names, 1).length == 0);
+    TEST("names point into argument", kgflags_string_list_get_arg(&names) == argv[2]);
+    const int *id_values = kgflags_int_list_get_items(&ids);
+    TEST("ids == [1, -2, 300]", kgflags_int_list_get_count(&ids) == 3 && id_values[0] == 1 && id_values[1] == -2 && id_values[2] == 300);
+    const double *weight_values = kgflags_double_list_get_items(&weights);
+    TEST("weights == [0.5, 1000]", kgflags_double_list_get_count(&weights) == 2 && DBLEQ(weight_values[0], 0.5) && DBLEQ(weight_values[1], 1000.0));
+    TEST("port == 8080", port == 8080);
+
+    char buf[256];
+    kgflags_dump(buf, sizeof(buf), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    TEST("Dump writes lists", strstr(buf, "names=ala,,kot") != NULL && strstr(buf, "ids=1,-2,300") != NULL);
+
+    kgflags_reset_values();
+    char *argv_invalid[] = { "", "--names", "a,b,c,d,e", "--ids", "1,x,3,", "--weights", "", "--port" };
+    TEST("Parse invalid lists", kgflags_parse(ARRAY_SIZE(argv_invalid), argv_invalid) == false);
+    TEST("KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS));
+    TEST("KGFLAGS_ERROR_KIND_INVALID_INT set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
+    TEST("KGFLAGS_ERROR_KIND_MISSING_VALUE set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MISSING_VALUE));
+    TEST("Four errors", kgflags_get_error_count() == 4);
+    kgflags_error_info_t err;
+    kgflags_get_error(0, &err);
+    TEST("Too many items error has limit", err.kind == KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS && err.limit == 4
+         && err.item_index == 4 && err.char_index == -1);
+    kgflags_get_error(2, &err);
+    TEST("Trailing delimiter is an empty item", err.kind == KGFLAGS_ERROR_KIND_INVALID_INT && err.item_index == 3 && err.limit == -1);
+    TEST("Empty argument is an empty list", kgflags_double_list_get_count(&weights) == 0);
+
+    test_kgflags_reset();
+    int kept_items[3] = { 7, 7, 7 };
+    kgflags_int_list_t kept;
+    kgflags_int_list("i", ',', kept_items, 3, NULL, false, &kept);
+    char *argv_kept[] = { "", "--i", "1,2,x" };
+    TEST("Invalid last item", kgflags_parse(ARRAY_SIZE(argv_kept), argv_kept) == false);
+    TEST("Storage not written", kept_items[0] == 7 && kept_items[1] == 7 && kept_items[2] == 7 && kgflags_int_list_get_count(&kept) == 0);
+
+    // Delimiters that can continue a number still split it.
+    test_kgflags_reset();
+    int e_items[4];
+    int dot_items[4];
+    double plus_items[4];
+    double x_items[4];
+    kgflags_int_list_t e_list;
+    kgflags_int_list_t dot_list;
+    kgflags_double_list_t plus_list;
+    kgflags_double_list_t x_list;
+    kgflags_int_list("e", 'e', e_items, 4, NULL, true, &e_list);
+    kgflags_int_list("dot", '.', dot_items, 4, NULL, true, &dot_list);
+    kgflags_double_list("plus", '+', plus_items, 4, NULL, true, &plus_list);
+    kgflags_double_list("x", 'x', x_items, 4, NULL, true, &x_list);
+    kgflags_freeze();
+    char *argv_numeric[] = { "", "--e", "1e2", "--dot", "1.-2", "--plus", "1.5+-5", "--x", "0x1.5" };
+    TEST("Parse numeric delimiters", kgflags_parse(ARRAY_SIZE(argv_numeric), argv_numeric));
+    TEST("'e' splits ints", kgflags_int_list_get_count(&e_list) == 2 && e_items[0] == 1 && e_items[1] == 2);
+    TEST("'.' splits ints", kgflags_int_list_get_count(&dot_list) == 2 && dot_items[0] == 1 && dot_items[1] == -2);
+    TEST("'+' splits doubles", kgflags_double_list_get_count(&plus_list) == 2 && DBLEQ(plus_items[0], 1.5) && DBLEQ(plus_items[1], -5.0));
+    TEST("'x' splits doubles", kgflags_double_list_get_count(&x_list) == 2 && DBLEQ(x_items[0], 0.0) && DBLEQ(x_items[1], 1.5));
+    kgflags_validation_t validation;
+    TEST("Validate splits the same way", kgflags_validate(ARRAY_SIZE(argv_numeric), argv_numeric, false, &validation));
+
+    test_kgflags_reset();
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    kgflags_string_array_t arr;
+    kgflags_string_array("arr", NULL, false, &arr);
+    char *argv_unexpected[] = { "", "--verbose=true", "--arr=a" };
+    TEST("Parse bool and array with inline values", kgflags_parse(ARRAY_SIZE(argv_unexpected), argv_unexpected) == false);
+    kgflags_get_error(0, &err);
+    TEST("KGFLAGS_ERROR_KIND_UNEXPECTED_VALUE set", err.kind == KGFLAGS_ERROR_KIND_UNEXPECTED_VALUE && STREQ(err.value, "true"));
+    TEST("Two errors", kgflags_get_error_count() == 2);
+}
+
+static void test_suite_permute_argv() {
+    test_kgflags_reset();
+    kgflags_set_permute_argv(true);
+
+    const char *out = NULL;
+    kgflags_string("out", NULL, NULL, true, &out);
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    kgflags_int_array_t levels;
+    kgflags_int_array("levels", NULL, false, &levels);
+
+    char *argv[] = { "app", "a.txt", "b.txt", "--out", "x", "c.txt", "--verbose", "--levels", "1", "2", "3", "--out2", "d.txt" };
+    char *expected[] = { "app", "--out", "x", "--verbose", "--levels", "1", "2", "3", "--out2", "a.txt", "b.txt", "c.txt", "d.txt" };
+    TEST("Parse with argv permutation", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
+    TEST("KGFLAGS_ERROR_KIND_UNKNOWN_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG));
+    bool same_order = true;
+    for (int i = 0; i < (int)ARRAY_SIZE(argv); i++) {
+        same_order = same_order && STREQ(argv[i], expected[i]);
+    }
+    TEST("Flags first, non-flag arguments in order at the end", same_order);
+    TEST("Non-flag args count == 4", kgflags_get_non_flag_args_count() == 4);
+    TEST("Non-flag args are argv tail", kgflags_get_non_flag_arg(0) == argv[9] && kgflags_get_non_flag_arg(3) == argv[12]);
+    TEST("Non-flag arg out of range", kgflags_get_non_flag_arg(4) == NULL);
+    TEST("out == x", STREQ(out, "x"));
+    TEST("Array items follow permutation", kgflags_int_array_get_count(&levels) == 3
+         && levels._items == argv + 5 && kgflags_int_array_get_item(&levels, 2) == 3);
+
+    kgflags_reset_values();
+    char *argv_many[1000];
+    argv_many[0] = "app";
+    for (int i = 1; i < 998; i++) {
+        argv_many[i] = "file";
+    }
+    argv_many[998] = "--out";
+    argv_many[999] = "y";
+    TEST("Parse more than KGFLAGS_MAX_NON_FLAG_ARGS non-flag args", kgflags_parse(ARRAY_SIZE(argv_many), argv_many));
+    TEST("Non-flag args count == 997", kgflags_get_non_flag_args_count() == 997);
+    TEST("Flag moved to front", STREQ(argv_many[1], "--out") && STREQ(argv_many[2], "y") && STREQ(out, "y"));
+
+    kgflags_set_permute_argv(false);
+}
+
+static void test_suite_constraints() {
+    test_kgflags_reset();
+
+    const char *file = NULL;
+    kgflags_string("file", NULL, NULL, false, &file);
+    const char *url = NULL;
+    kgflags_string("url", NULL, NULL, false, &url);
+    bool json = false;
+    kgflags_bool("json", false, NULL, false, &json);
+    bool yaml = false;
+    kgflags_bool("yaml", false, NULL, false, &yaml);
+    const char *user = NULL;
+    kgflags_string("user", NULL, NULL, false, &user);
+    const char *password = NULL;
+    kgflags_string("password", NULL, NULL, false, &password);
+    int port = 0;
+    kgflags_int("port", 0, NULL, false, &port);
+
+    static const char *const sources[] = { "file", "url" };
+    kgflags_exactly_one_of(sources, 2);
+    static const char *const formats[] = { "json", "yaml" };
+    kgflags_at_most_one_of(formats, 2);
+    kgflags_requires("password", "user");
+
+    char *argv_ok[] = { "", "--file", "a", "--json", "--user", "u", "--password", "p" };
+    TEST("Parse satisfying constraints", kgflags_parse(ARRAY_SIZE(argv_ok), argv_ok));
+
+    kgflags_reset_values();
+    char *argv_bad[] = { "", "--file", "a", "--url", "b", "--json", "--yaml", "--password", "p" };
+    TEST("Parse violating constraints", kgflags_parse(ARRAY_SIZE(argv_bad), argv_bad) == false);
+    TEST("Three errors", kgflags_get_error_count() == 3);
+    kgflags_error_info_t err;
+    kgflags_get_error(0, &err);
+    TEST("file and url are exclusive", err.kind == KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS && STREQ(err.flag_name, "file") && STREQ(err.value, "url"));
+    kgflags_get_error(1, &err);
+    TEST("json and yaml are exclusive", err.kind == KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS && STREQ(err.flag_name, "json") && STREQ(err.value, "yaml"));
+    kgflags_get_error(2, &err);
+    TEST("password requires user", err.kind == KGFLAGS_ERROR_KIND_MISSING_DEPENDENCY && STREQ(err.flag_name, "password") && STREQ(err.value, "user"));
+
+    kgflags_reset_values();
+    char *argv_missing[] = { "", "--port", "80" };
+    TEST("Parse without source", kgflags_parse(ARRAY_SIZE(argv_missing), argv_missing) == false);
+    TEST("KGFLAGS_ERROR_KIND_MISSING_ONE_OF set", kgflags_get_error_count() == 1 && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MISSING_ONE_OF));
+
+    kgflags_reset_values();
+    char *argv_invalid[] = { "", "--file" };
+    TEST("Parse with missing value", kgflags_parse(ARRAY_SIZE(argv_invalid), argv_invalid) == false);
+    TEST("Only missing value error", kgflags_get_error_count() == 1 && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MISSING_VALUE));
+
+    test_kgflags_reset();
+    kgflags_string("file", NULL, NULL, false, &file);
+    kgflags_requires("file", "unknown");
+    char *argv_empty[] = { "" };
+    TEST("Constraint with unknown flag", kgflags_parse(ARRAY_SIZE(argv_empty), argv_empty) == false);
+    TEST("KGFLAGS_ERROR_KIND_UNKNOWN_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG));
+
+    test_kgflags_reset();
+    static char names[250][8];
+    const char *group[2];
+    bool values[250];
+    for (int i = 0; i < 250; i++) {
+        sprintf(names[i], "f%d", i);
+        kgflags_bool(names[i], false, NULL, i == 249, &values[i]);
+    }
+    group[0] = names[10];
+    group[1] = names[200];
+    kgflags_at_most_one_of(group, 2);
+    char *argv_many[] = { "", "--f10", "--f200" };
+    TEST("Constraints across bitset words", kgflags_parse(ARRAY_SIZE(argv_many), argv_many) == false);
+    TEST("KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_EXCLUSIVE_FLAGS));
+    TEST("KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG));
+}
+
+static void test_suite_section_registration() {
+#ifdef KGFLAGS_HAS_SECTION_REGISTRATION
+    test_kgflags_reset();
+    _kgflags_g.specs_registered = false;
+
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    TEST("Specs aren't registered before parsing", _kgflags_g.flags_count == 1);
+
+    char *argv[] = { "", "--spec-port", "8080", "--spec-cache", "4K", "--spec-ids", "1", "2", "--verbose" };
+    TEST("Parse flags defined in section", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("All specs registered", _kgflags_g.flags_count == 5);
+    TEST("spec_host has default value", STREQ(spec_host, "localhost"));
+    TEST("spec_port == 8080", spec_port == 8080);
+    TEST("spec_cache == 4096", spec_cache == 4096);
+    TEST("spec_ids == [1, 2]", kgflags_int_array_get_count(&spec_ids) == 2 && kgflags_int_array_get_item(&spec_ids, 1) == 2);
+    TEST("Flag id of spec", kgflags_get_flag_id("spec-cache") >= 1);
+
+    kgflags_reset_values();
+    char *argv_missing[] = { "" };
+    TEST("Required spec flag", kgflags_parse(ARRAY_SIZE(argv_missing), argv_missing) == false);
+    TEST("KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG set", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG));
+#endif
+}
+
+static void test_suite_short_names() {
+    test_kgflags_reset();
+
+    bool extract = false;
+    kgflags_bool("extract", false, NULL, false, &extract);
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    const char *file = NULL;
+    kgflags_string("file", NULL, NULL, false, &file);
+    int level = 0;
+    kgflags_int("level", 0, NULL, false, &level);
+    kgflags_int_array_t ids;
+    kgflags_int_array("ids", NULL, false, &ids);
+    kgflags_set_short_name("extract", 'x');
+    kgflags_set_short_name("verbose", 'v');
+    kgflags_set_short_name("file", 'f');
+    kgflags_set_short_name("level", 'l');
+    kgflags_set_short_name("ids", 'i');
+
+    char *argv[] = { "", "-xvf", "a.tar", "-l-3", "-", "-i", "1", "-2", "-v2" };
+    TEST("Parse short names", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
+    TEST("extract and verbose set", extract && verbose);
+    TEST("file == a.tar", STREQ(file, "a.tar"));
+    TEST("level == -3", level == -3);
+    TEST("ids == [1, -2]", kgflags_int_array_get_count(&ids) == 2 && kgflags_int_array_get_item(&ids, 1) == -2);
+    TEST("- is a non-flag argument", kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "-"));
+    TEST("Two errors", kgflags_get_error_count() == 2);
+    kgflags_error_info_t err;
+    kgflags_get_error(0, &err);
+    TEST("Repeated short name", err.kind == KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT && STREQ(err.flag_name, "verbose"));
+    kgflags_get_error(1, &err);
+    TEST("Unknown short name in cluster", err.kind == KGFLAGS_ERROR_KIND_UNKNOWN_SHORT_FLAG && STREQ(err.value, "-v2")
+         && err.char_index == 2 && err.item_index == -1 && err.arg_index == 8);
+
+    kgflags_reset_values();
+    char *argv_long[] = { "", "--file", "b", "-v" };
+    TEST("Mix long and short names", kgflags_parse(ARRAY_SIZE(argv_long), argv_long));
+    TEST("file == b and verbose", STREQ(file, "b") && verbose && !extract);
+
+    kgflags_reset_values();
+    char *argv_words[] = { "", "-word", "-xv", "--ids", "4", "-abc" };
+    TEST("Arguments not starting with an alias aren't flags", kgflags_parse(ARRAY_SIZE(argv_words), argv_words) == false
+         && extract && verbose && kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "-word"));
+    kgflags_get_error(0, &err);
+    TEST("-abc is an array item", kgflags_get_error_count() == 1 && err.kind == KGFLAGS_ERROR_KIND_INVALID_INT
+         && err.item_index == 1 && err.arg_index == 5);
+
+    kgflags_set_short_name("level", 'L');
+    kgflags_set_short_name("unknown", 'u');
+    kgflags_set_short_name("file", '-');
+    TEST("Duplicate short name", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_DUPLICATE_FLAG));
+    TEST("Short name of unknown flag", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG));
+    TEST("Invalid short name", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_SHORT_NAME));
+}
+
+static void test_suite_validate() {
+    test_kgflags_reset();
+
+    int port = 0;
+    kgflags_int("port", 80, NULL, true, &port);
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    kgflags_set_short_name("verbose", 'v');
+    kgflags_double_array_t weights;
+    kgflags_double_array("weights", NULL, false, &weights);
+    int ids_storage[2];
+    kgflags_int_list_t ids;
+    kgflags_int_list("ids", ',', ids_storage, 2, NULL, false, &ids);
+    kgflags_requires("weights", "verbose");
+
+    kgflags_validation_t res;
+    char *argv_ok[] = { "", "--port", "8080", "-v", "file" };
+    TEST("Validate without freezing", kgflags_validate(ARRAY_SIZE(argv_ok), argv_ok, false, &res) == false
+         && res.first_error.kind == KGFLAGS_ERROR_KIND_SCHEMA_NOT_FROZEN);
+    TEST("Freeze", kgflags_freeze());
+    int flag = 0;
+    kgflags_int("late", 0, NULL, false, &flag);
+    TEST("Declaring after freeze", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_SCHEMA_FROZEN));
+    _kgflags_g.errors_count = 0;
+
+    TEST("Valid argv", kgflags_validate(ARRAY_SIZE(argv_ok), argv_ok, false, &res) && res.errors_count == 0
+         && res.first_error.kind == KGFLAGS_ERROR_KIND_NONE);
+    TEST("Values aren't assigned", port == 0 && !verbose);
+
+    char *argv_bad[] = { "", "--port=x", "--weights", "1.5", "y", "--ids", "1,2,3", "--verbose=1" };
+    TEST("Invalid argv", kgflags_validate(ARRAY_SIZE(argv_bad), argv_bad, false, &res) == false);
+    TEST("All errors counted", res.errors_count == 4);
+    TEST("First error kept", res.first_error.kind == KGFLAGS_ERROR_KIND_INVALID_INT && STREQ(res.first_error.flag_name, "port")
+         && STREQ(res.first_error.value, "x") && res.first_error.arg_index == 1);
+    TEST("Stop at first error", kgflags_validate(ARRAY_SIZE(argv_bad), argv_bad, true, &res) == false && res.errors_count == 1);
+
+    char *argv_words[] = { "", "--port", "1", "-verbose" };
+    TEST("Words starting with an alias", kgflags_validate(ARRAY_SIZE(argv_words), argv_words, false, &res) == false
+         && res.errors_count == 1 && res.first_error.kind == KGFLAGS_ERROR_KIND_UNKNOWN_SHORT_FLAG && res.first_error.char_index == 2);
+    char *argv_not_alias[] = { "", "--port", "1", "-x", "--weights", "2", "-x", "-v" };
+    TEST("Words not starting with an alias", kgflags_validate(ARRAY_SIZE(argv_not_alias), argv_not_alias, false, &res) == false
+         && res.errors_count == 1 && res.first_error.kind == KGFLAGS_ERROR_KIND_INVALID_DOUBLE && res.first_error.arg_index == 6);
+
+    char *argv_missing[] = { "", "-v" };
+    TEST("Missing required flag", kgflags_validate(ARRAY_SIZE(argv_missing), argv_missing, false, &res) == false
+         && res.first_error.kind == KGFLAGS_ERROR_KIND_UNASSIGNED_FLAG && STREQ(res.first_error.flag_name, "port"));
+    char *argv_dependency[] = { "", "--port", "1", "--weights", "2" };
+    TEST("Constraints checked", kgflags_validate(ARRAY_SIZE(argv_dependency), argv_dependency, false, &res) == false
+         && res.first_error.kind == KGFLAGS_ERROR_KIND_MISSING_DEPENDENCY);
+    TEST("Global errors untouched", kgflags_get_error_count() == 0);
+
+    char **argvs[100];
+    int argcs[100];
+    kgflags_validation_t results[100];
+    for (int i = 0; i < 100; i++) {
+        argvs[i] = i % 10 == 3 ? argv_bad : argv_ok;
+        argcs[i] = i % 10 == 3 ? (int)ARRAY_SIZE(argv_bad) : (int)ARRAY_SIZE(argv_ok);
+    }
+    TEST("Sequential batch", kgflags_validate_batch(100, argcs, argvs, true, results) == 10);
+    int calls = 0;
+    kgflags_set_parallel_for(test_reverse_parallel_for, &calls, 10);
+    memset(results, 0, sizeof(results));
+    TEST("Parallel batch", kgflags_validate_batch(100, argcs, argvs, false, results) == 10);
+    TEST("Parallel-for hook called", calls > 1);
+    TEST("Batch results in order", results[13].errors_count == 4 && results[14].errors_count == 0);
+
+    TEST("Parse after validation", kgflags_parse(ARRAY_SIZE(argv_ok), argv_ok) && port == 8080 && verbose);
+}
+
+static void test_suite_pass_through() {
+    test_kgflags_reset();
+
+    int jobs = 0;
+    kgflags_int("jobs", 1, NULL, false, &jobs);
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    kgflags_set_short_name("verbose", 'v');
+    kgflags_string_array_t tags;
+    kgflags_string_array("tags", NULL, false, &tags);
+    int arity_calls = 0;
+    kgflags_set_pass_through(true, test_pass_through_arity, &arity_calls);
+
+    char *argv[] = { "wrap", "--jobs", "4", "--inner-pattern", "--jobs", "--inner-quiet", "in.txt", "-v", "-qz",
+                     "out.txt", "--tags", "a", "b", "--inner-last", NULL };
+    char *expected[] = { "/bin/inner", "--inner-pattern", "--jobs", "--inner-quiet", "in.txt", "-qz",
+                         "out.txt", "--inner-last", NULL };
+    int argc = (int)ARRAY_SIZE(argv) - 1;
+    TEST("Parse with pass-through", kgflags_parse(argc, argv));
+    TEST("Own flags parsed", jobs == 4 && verbose && kgflags_string_array_get_count(&tags) == 2
+         && STREQ(kgflags_string_array_get_item(&tags, 1), "b"));
+    TEST("Arity callback called for unknown flags", arity_calls == 4);
+    TEST("Non-flag args include passed flags", kgflags_get_non_flag_args_count() == 7
+         && STREQ(kgflags_get_non_flag_arg(0), "--inner-pattern"));
+
+    int child_argc = 0;
+    char **child_argv = kgflags_get_pass_through_argv("/bin/inner", &child_argc);
+    bool same = child_argc == (int)ARRAY_SIZE(expected) - 1;
+    for (int i = 0; same && i < (int)ARRAY_SIZE(expected); i++) {
+        same = expected[i] ? STREQ(child_argv[i], expected[i]) : child_argv[i] == NULL;
+    }
+    TEST("Pass-through vector ready for execv", same);
+    TEST("Vector is tail of argv", child_argv == argv + argc - child_argc);
+    TEST("Array items kept", kgflags_string_array_get_count(&tags) == 2 && STREQ(kgflags_string_array_get_item(&tags, 0), "a")
+         && STREQ(kgflags_string_array_get_item(&tags, 1), "b"));
+
+    kgflags_validation_t res;
+    kgflags_freeze();
+    char *argv_validate[] = { "wrap", "--inner-pattern", "--jobs", "x" };
+    TEST("Validate with pass-through", kgflags_validate(ARRAY_SIZE(argv_validate), argv_validate, false, &res)
+         && res.errors_count == 0);
+
+    kgflags_reset_values();
+    kgflags_set_pass_through(false, NULL, NULL);
+    char *argv_unknown[] = { "wrap", "--inner" };
+    TEST("Unknown flag without pass-through", kgflags_parse(ARRAY_SIZE(argv_unknown), argv_unknown) == false
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_UNKNOWN_FLAG));
+    kgflags_set_permute_argv(false);
+}
+
+static void test_suite_serialize_argv() {
+    test_kgflags_reset();
+
+    const char *name = NULL;
+    kgflags_string("name", "default", NULL, false, &name);
+    const char *host = NULL;
+    kgflags_string("host", "localhost", NULL, false, &host);
+    bool verbose = false;
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    bool color = false;
+    kgflags_bool("color", true, NULL, false, &color);
+    kgflags_set_short_name("color", 'c');
+    int port = 0;
+    kgflags_int("port", 80, NULL, true, &port);
+    double ratio = 0.0;
+    kgflags_double("ratio", 0.5, NULL, false, &ratio);
+    int64_t timeout = 0;
+    kgflags_duration("timeout", 0, NULL, false, &timeout);
+    const char *modes[] = { "fast", "safe" };
+    int mode = 0;
+    kgflags_choice("mode", modes, 2, 0, NULL, false, &mode);
+    kgflags_string_array_t files;
+    kgflags_string_array("files", NULL, false, &files);
+    int ids_storage[4];
+    kgflags_int_list_t ids;
+    kgflags_int_list("ids", ':', ids_storage, 4, NULL, false, &ids);
+
+    char *argv[] = { "app", "in", "--name", "--odd", "--host=localhost", "--no-color", "--port", "80", "--ratio",
+                     "0.1", "--timeout", "1.5s", "--mode", "safe", "--files", "a", "b", "--ids", "1:2:-3" };
+    TEST("Parse original argv", kgflags_parse(ARRAY_SIZE(argv), argv));
+
+    char buf[256];
+    char *out_argv[32];
+    int out_argc = ARRAY_SIZE(out_argv);
+    int len = kgflags_serialize_argv(buf, sizeof(buf), out_argv, &out_argc);
+    char *expected[] = { "app", "in", "--name=--odd", "--no-color", "--port=80", "--ratio=0.10000000000000001",
+                         "--timeout=1500000000ns", "--mode=safe", "--files", "a", "b", "--ids=1:2:-3" };
+    bool same = len <= (int)sizeof(buf) && out_argc == (int)ARRAY_SIZE(expected) && out_argv[out_argc] == NULL;
+    for (int i = 0; same && i < out_argc; i++) {
+        same = STREQ(out_argv[i], expected[i]);
+    }
+    TEST("Canonical argv without defaults", same);
+    TEST("Arguments packed in buffer", out_argv[1] == buf + 4 && buf[len - 1] == '\0');
+
+    kgflags_snapshot_t *a = (kgflags_snapshot_t*)malloc(sizeof(kgflags_snapshot_t));
+    kgflags_snapshot_t *b = (kgflags_snapshot_t*)malloc(sizeof(kgflags_snapshot_t));
+    int changed[4];
+    TEST("Reload original argv", kgflags_reload(ARRAY_SIZE(argv), argv, a));
+    TEST("Reload serialized argv", kgflags_reload(out_argc, out_argv, b));
+    TEST("Round trip gives identical configuration", kgflags_snapshot_diff(a, b, changed, 4) == 0);
+    free(a);
+    free(b);
+
+    kgflags_reset_values();
+    TEST("Parse serialized argv", kgflags_parse(out_argc, out_argv));
+    TEST("Same non-flag args", kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "in"));
+    char buf_again[256];
+    char *argv_again[32];
+    int argc_again = ARRAY_SIZE(argv_again);
+    TEST("Serialization is stable", kgflags_serialize_argv(buf_again, sizeof(buf_again), argv_again, &argc_again) == len
+         && memcmp(buf, buf_again, (size_t)len) == 0);
+
+    char small[20];
+    out_argc = 3;
+    len = kgflags_serialize_argv(small, sizeof(small), out_argv, &out_argc);
+    TEST("Truncated output", len > (int)sizeof(small) && out_argc == (int)ARRAY_SIZE(expected)
+         && STREQ(out_argv[2], "--name=--odd"));
+}
+
+static void test_suite_image() {
+    test_kgflags_reset();
+    test_image_flags_t parent;
+    test_declare_image_flags(&parent);
+    char *argv[] = { "app", "rest", "--name", "srv", "--verbose", "--cache", "64K", "--mode", "b", "--files", "x", "y",
+                     "--weights", "3,-4", "--tags", "a,bc", "--ids" };
+    TEST("Parse in parent", kgflags_parse(ARRAY_SIZE(argv), argv));
+
+    uint64_t image[128];
+    size_t size = kgflags_image_write(image, sizeof(image));
+    TEST("Image written", size > 0 && size <= sizeof(image));
+    TEST("Too small buffer reports needed size", kgflags_image_write(image, 16) == size);
+    kgflags_image_write(image, sizeof(image));
+    uint64_t moved[128];
+    memcpy(moved, image, size);
+    memset(image, 0xff, sizeof(image)); // image has to be usable at any address
+
+    test_kgflags_reset();
+    test_image_flags_t child;
+    test_declare_image_flags(&child);
+    char *items[4];
+    TEST("Too small items storage", kgflags_image_attach(moved, size, items, 1) == false && child.name == NULL);
+    TEST("Truncated image", kgflags_image_attach(moved, size - 1, items, 4) == false);
+    uint64_t bad[128];
+    _kgflags_image_record_t *records = (_kgflags_image_record_t*)((char*)bad + sizeof(_kgflags_image_header_t));
+    memcpy(bad, moved, size);
+    records[4].value.int64_value = 2;
+    TEST("Choice out of range", kgflags_image_attach(bad, size, items, 4) == false);
+    memcpy(bad, moved, size);
+    records[7].count = 9;
+    TEST("List over capacity", kgflags_image_attach(bad, size, items, 4) == false);
+    memcpy(bad, moved, size);
+    memset((char*)bad + records[0].offset, 'x', size - records[0].offset);
+    TEST("String without terminator", kgflags_image_attach(bad, size, items, 4) == false && child.name == NULL);
+    TEST("Attach image", kgflags_image_attach(moved, size, items, 4));
+    TEST("Scalars bound", STREQ(child.name, "srv") && child.verbose && DBLEQ(child.ratio, 0.5)
+         && child.cache == 64 * 1024 && child.mode == 1);
+    TEST("Strings point into image", child.name > (const char*)moved && child.name < (const char*)moved + size);
+    TEST("Arrays bound", kgflags_string_array_get_count(&child.files) == 2
+         && STREQ(kgflags_string_array_get_item(&child.files, 1), "y") && kgflags_int_array_get_count(&child.ids) == 0);
+    TEST("Lists bound", kgflags_int_list_get_count(&child.weights) == 2 && kgflags_int_list_get_items(&child.weights)[1] == -4
+         && kgflags_string_list_get_count(&child.tags) == 2 && kgflags_string_list_get_span(&child.tags, 1).length == 2);
+    TEST("Non-flag args bound", kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "rest"));
+
+    char dump[512];
+    kgflags_dump(dump, sizeof(dump), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    TEST("Assigned state kept", strstr(dump, "argv name=srv") != NULL && strstr(dump, "default ratio=0.5") != NULL);
+
+    test_kgflags_reset();
+    test_declare_image_flags(&child);
+    int extra = 0;
+    kgflags_int("extra", 0, NULL, false, &extra);
+    TEST("Schema mismatch", kgflags_image_attach(moved, size, items, 4) == false);
+
+    test_kgflags_reset();
+    int port = 0;
+    kgflags_int("port", 80, NULL, false, &port);
+    kgflags_set_permute_argv(true);
+    char *argv_many[KGFLAGS_MAX_NON_FLAG_ARGS + 4];
+    argv_many[0] = "app";
+    argv_many[1] = "--port";
+    argv_many[2] = "9";
+    for (int i = 3; i < (int)ARRAY_SIZE(argv_many); i++) {
+        argv_many[i] = "file";
+    }
+    TEST("Parse many non-flag args", kgflags_parse(ARRAY_SIZE(argv_many), argv_many)
+         && kgflags_get_non_flag_args_count() == KGFLAGS_MAX_NON_FLAG_ARGS + 1);
+    static uint64_t many_image[1024];
+    size = kgflags_image_write(many_image, sizeof(many_image));
+    TEST("Image with many non-flag args written", size > 0 && size <= sizeof(many_image));
+    test_kgflags_reset();
+    kgflags_int("port", 80, NULL, false, &port);
+    TEST("Image with many non-flag args attached", kgflags_image_attach(many_image, size, NULL, 0) && port == 9
+         && kgflags_get_non_flag_args_count() == KGFLAGS_MAX_NON_FLAG_ARGS + 1
+         && STREQ(kgflags_get_non_flag_arg(KGFLAGS_MAX_NON_FLAG_ARGS), "file"));
+    char buf[64];
+    char *out_argv[4];
+    int out_argc = 1;
+    kgflags_serialize_argv(buf, sizeof(buf), out_argv, &out_argc);
+    TEST("arg0 taken from image", STREQ(out_argv[0], "app"));
+    kgflags_print_usage();
+    kgflags_reset_values();
+    char *argv_empty[] = { "app" };
+    TEST("Reset after attach", kgflags_get_non_flag_args_count() == 0 && kgflags_parse(ARRAY_SIZE(argv_empty), argv_empty)
+         && port == 80);
+}
+
+static void test_suite_parse_cache() {
+    test_kgflags_reset();
+    test_image_flags_t flags;
+    test_declare_image_flags(&flags);
+    char *argv[] = { "app", "rest", "--name", "srv", "--cache", "64K", "--files", "x", "y", "--weights", "3,-4" };
+    TEST("Parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+    uint64_t key = kgflags_get_cache_key(ARRAY_SIZE(argv), argv);
+    argv[0] = "/other/app";
+    TEST("Key ignores program path", kgflags_get_cache_key(ARRAY_SIZE(argv), argv) == key);
+
+    uint64_t cache[128];
+    size_t size = kgflags_cache_write(cache, sizeof(cache), ARRAY_SIZE(argv), argv);
+    TEST("Cache written", size > 0 && size <= sizeof(cache));
+    TEST("Too small buffer reports needed size", kgflags_cache_write(cache, 8, ARRAY_SIZE(argv), argv) == size);
+    kgflags_cache_write(cache, sizeof(cache), ARRAY_SIZE(argv), argv);
+    TEST("Saved to file", kgflags_cache_save("output/cache_test.bin", ARRAY_SIZE(argv), argv, cache, sizeof(cache)));
+
+    test_kgflags_reset();
+    test_declare_image_flags(&flags);
+    char *items[4];
+    TEST("Attach cache", kgflags_cache_attach(cache, size, ARRAY_SIZE(argv), argv, items, 4));
+    TEST("Values bound", STREQ(flags.name, "srv") && flags.cache == 64 * 1024
+         && kgflags_string_array_get_count(&flags.files) == 2 && kgflags_int_list_get_items(&flags.weights)[1] == -4
+         && kgflags_get_non_flag_args_count() == 1);
+
+    test_kgflags_reset();
+    test_declare_image_flags(&flags);
+    uint64_t schema_hash = kgflags_get_schema_hash();
+    kgflags_freeze();
+    TEST("Frozen schema hash", kgflags_get_schema_hash() == schema_hash);
+    TEST("Attach with frozen schema", kgflags_cache_attach(cache, size, ARRAY_SIZE(argv), argv, items, 4)
+         && STREQ(flags.name, "srv"));
+
+    test_kgflags_reset();
+    test_declare_image_flags(&flags);
+    argv[5] = "65K";
+    TEST("Changed argument", kgflags_cache_attach(cache, size, ARRAY_SIZE(argv), argv, items, 4) == false);
+    argv[5] = "64K";
+    TEST("Truncated cache", kgflags_cache_attach(cache, size - 8, ARRAY_SIZE(argv), argv, items, 4) == false);
+    ((char*)cache)[size - 1] ^= 1;
+    TEST("Corrupted cache", kgflags_cache_attach(cache, size, ARRAY_SIZE(argv), argv, items, 4) == false);
+    TEST("Nothing bound on failure", flags.name == NULL);
+
+    kgflags_set_prefix("++");
+    TEST("Key covers prefix", kgflags_get_cache_key(ARRAY_SIZE(argv), argv) != key);
+    kgflags_set_prefix("--");
+    char *argv_long[] = { "app", "--name", "a-long-server-name" };
+    uint64_t long_key = kgflags_get_cache_key(ARRAY_SIZE(argv_long), argv_long);
+    argv_long[2] = "a-long-server-nbme"; // hashed 8 bytes at a time, last byte of the second word differs
+    TEST("Key covers every byte", kgflags_get_cache_key(ARRAY_SIZE(argv_long), argv_long) != long_key);
+
+    test_kgflags_reset();
+    test_declare_image_flags(&flags);
+    uint64_t loaded[128];
+    TEST("Too small load buffer", kgflags_cache_load("output/cache_test.bin", ARRAY_SIZE(argv), argv, loaded, 64, items, 4) == false);
+    TEST("Load from file", kgflags_cache_load("output/cache_test.bin", ARRAY_SIZE(argv), argv, loaded, sizeof(loaded), items, 4));
+    TEST("Loaded values bound", STREQ(flags.name, "srv") && STREQ(kgflags_string_array_get_item(&flags.files, 0), "x"));
+    TEST("Missing file", kgflags_cache_load("output/missing_cache.bin", ARRAY_SIZE(argv), argv, loaded, sizeof(loaded), items, 4) == false);
+
+    test_kgflags_reset();
+    test_declare_image_flags(&flags);
+    kgflags_set_short_name("name", 'n');
+    TEST("Key covers short names", kgflags_get_cache_key(ARRAY_SIZE(argv), argv) != key);
+    TEST("Stale file rejected", kgflags_cache_load("output/cache_test.bin", ARRAY_SIZE(argv), argv, loaded, sizeof(loaded), items, 4) == false);
+    TEST("Saved over existing file", kgflags_cache_save("output/cache_test.bin", ARRAY_SIZE(argv), argv, cache, sizeof(cache)));
+    remove("output/cache_test.bin");
+
+    test_kgflags_reset();
+    const char *input = NULL;
+    kgflags_path("input", NULL, KGFLAGS_PATH_FILE, NULL, true, &input);
+    FILE *input_file = fopen("output/cache_input.txt", "wb");
+    fclose(input_file);
+    char *argv_path[] = { "app", "--input", "output/cache_input.txt" };
+    TEST("Parse path", kgflags_parse(ARRAY_SIZE(argv_path), argv_path));
+    size = kgflags_cache_write(cache, sizeof(cache), ARRAY_SIZE(argv_path), argv_path);
+    test_kgflags_reset();
+    kgflags_path("input", NULL, KGFLAGS_PATH_FILE, NULL, true, &input);
+    TEST("Attach with existing path", kgflags_cache_attach(cache, size, ARRAY_SIZE(argv_path), argv_path, NULL, 0)
+         && STREQ(input, "output/cache_input.txt"));
+    remove("output/cache_input.txt");
+    kgflags_reset_values();
+    input = NULL;
+    TEST("Removed path rejected", kgflags_cache_attach(cache, size, ARRAY_SIZE(argv_path), argv_path, NULL, 0) == false
+         && input == NULL);
+}
+
+static void test_suite_trace() {
+    test_kgflags_reset();
+    const char *name = NULL;
+    bool verbose = false;
+    kgflags_int_array_t ids;
+    kgflags_string("name", NULL, NULL, true, &name);
+    kgflags_bool("verbose", false, NULL, false, &verbose);
+    kgflags_int_array("ids", NULL, false, &ids);
+    char *argv[] = { "app", "rest", "--name=srv", "--ids", "1", "x", "--verbose" };
+    TEST("Parse fails", kgflags_parse(ARRAY_SIZE(argv), argv) == false);
+    TEST("Events recorded", kgflags_trace_get_count() == 7);
+
+    kgflags_trace_event_t event;
+    kgflags_trace_get_event(0, &event);
+    TEST("Parse begin", event.kind == KGFLAGS_TRACE_PARSE_BEGIN && event.span_length == 7);
+    kgflags_trace_get_event(1, &event);
+    TEST("Non-flag argument", event.kind == KGFLAGS_TRACE_NON_FLAG && event.arg_index == 1 && event.flag_id == -1);
+    kgflags_trace_get_event(2, &event);
+    TEST("Inline value", event.kind == KGFLAGS_TRACE_FLAG && event.arg_index == 2 && event.flag_id == 0 && event.detail == 1);
+    kgflags_trace_get_event(3, &event);
+    TEST("Array item error", event.kind == KGFLAGS_TRACE_ERROR && event.detail == KGFLAGS_ERROR_KIND_INVALID_INT
+         && event.flag_id == 2 && event.span_start == 1);
+    kgflags_trace_get_event(4, &event);
+    TEST("Array span", event.kind == KGFLAGS_TRACE_FLAG && event.arg_index == 3 && event.span_start == 4 && event.span_length == 2);
+    kgflags_trace_get_event(6, &event);
+    TEST("Parse end", event.kind == KGFLAGS_TRACE_PARSE_END && event.span_length == 1);
+
+    char text[512];
+    int len = kgflags_trace_decode(text, sizeof(text));
+    TEST("Decoded", len > 0 && len < (int)sizeof(text) && strncmp(text, "begin argc=7\n", 13) == 0
+         && strstr(text, "flag arg=3 values=4+2 name=ids\n") != NULL && strstr(text, "flag arg=6 values=7+0 name=verbose\n") != NULL
+         && strstr(text, "flag arg=2 value=inline name=name\n") != NULL);
+
+    test_kgflags_reset();
+    kgflags_trace_clear();
+    char *many[22] = { "app" };
+    for (int i = 1; i < 22; i++) {
+        many[i] = "arg";
+    }
+    kgflags_parse(ARRAY_SIZE(many), many);
+    TEST("Ring keeps last events", kgflags_trace_get_count() == KGFLAGS_TRACE_CAPACITY);
+    kgflags_trace_get_event(0, &event);
+    TEST("Oldest events dropped", event.kind == KGFLAGS_TRACE_NON_FLAG && event.arg_index == 7);
+    kgflags_trace_decode(text, sizeof(text));
+    TEST("Dropped count decoded", strncmp(text, "dropped 7\nnon-flag arg=7\n", 25) == 0);
+    kgflags_trace_clear();
+    TEST("Cleared", kgflags_trace_get_count() == 0 && kgflags_trace_decode(text, sizeof(text)) == 0);
+
+    _kgflags_trace_record(KGFLAGS_TRACE_FLAG, 0, 40000, 0, 1, 0); // KGFLAGS_MAX_FLAGS can be configured above 32767
+    kgflags_trace_get_event(0, &event);
+    TEST("Large flag id kept", event.flag_id == 40000);
+    kgflags_trace_clear();
+}
+
+static void test_suite_repeatable() {
+    test_kgflags_reset();
+    char *include_storage[4];
+    char *level_storage[4];
+    char *weight_storage[2];
+    kgflags_string_array_t includes;
+    kgflags_int_array_t levels;
+    kgflags_double_array_t weights;
+    kgflags_string_repeatable("include", include_storage, 4, NULL, true, &includes);
+    kgflags_int_repeatable("level", level_storage, 4, NULL, false, &levels);
+    kgflags_double_repeatable("weight", weight_storage, 2, NULL, false, &weights);
+    kgflags_set_short_name("include", 'I');
+    kgflags_freeze();
+    char *argv[] = { "app", "--include", "a", "rest", "--level=3", "-Ib", "--include=c", "--level", "-4" };
+    TEST("Parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("Strings collected", kgflags_string_array_get_count(&includes) == 3
+         && STREQ(kgflags_string_array_get_item(&includes, 0), "a") && STREQ(kgflags_string_array_get_item(&includes, 1), "b")
+         && STREQ(kgflags_string_array_get_item(&includes, 2), "c"));
+    TEST("Values not copied", kgflags_string_array_get_item(&includes, 0) == argv[2]);
+    TEST("Ints collected", kgflags_int_array_get_count(&levels) == 2 && kgflags_int_array_get_item(&levels, 0) == 3
+         && kgflags_int_array_get_item(&levels, 1) == -4);
+    TEST("Unused repeatable is empty", kgflags_double_array_get_count(&weights) == 0);
+    TEST("Non-flag argument", kgflags_get_non_flag_args_count() == 1 && STREQ(kgflags_get_non_flag_arg(0), "rest"));
+
+    char buf[256];
+    char *out_argv[16];
+    int out_argc = ARRAY_SIZE(out_argv);
+    kgflags_serialize_argv(buf, sizeof(buf), out_argv, &out_argc);
+    TEST("Serialized one argument per occurrence", out_argc == 7 && STREQ(out_argv[2], "--include=a")
+         && STREQ(out_argv[4], "--include=c") && STREQ(out_argv[6], "--level=-4"));
+
+    kgflags_validation_t result;
+    TEST("Validates like parse", kgflags_validate(ARRAY_SIZE(argv), argv, false, &result) && result.errors_count == 0);
+
+    test_kgflags_reset();
+    kgflags_string_repeatable("include", include_storage, 4, NULL, true, &includes);
+    kgflags_int_repeatable("level", level_storage, 4, NULL, false, &levels);
+    kgflags_double_repeatable("weight", weight_storage, 2, NULL, false, &weights);
+    kgflags_freeze();
+    char *invalid_argv[] = { "app", "--include", "a", "--level", "x", "--weight", "1", "--weight", "2", "--weight", "3", "--include" };
+    TEST("Parse fails", kgflags_parse(ARRAY_SIZE(invalid_argv), invalid_argv) == false);
+    TEST("Invalid occurrence", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT));
+    TEST("Too many occurrences", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS)
+         && kgflags_double_array_get_count(&weights) == 2);
+    TEST("Missing value", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MISSING_VALUE));
+    TEST("No multiple assignment", !test_kgflags_contains_error(KGFLAGS_ERROR_KIND_MULTIPLE_ASSIGNMENT));
+    TEST("Validate finds the same errors", kgflags_validate(ARRAY_SIZE(invalid_argv), invalid_argv, false, &result) == false
+         && result.errors_count == kgflags_get_error_count());
+
+    test_kgflags_reset();
+    kgflags_int_repeatable("level", level_storage, 4, NULL, false, &levels);
+    kgflags_freeze();
+    char *range_argv[] = { "app", "--level", "1..5", "--level=7" };
+    TEST("Range occurrence validates", kgflags_validate(ARRAY_SIZE(range_argv), range_argv, false, &result)
+         && result.errors_count == 0);
+    TEST("Range occurrence parses", kgflags_parse(ARRAY_SIZE(range_argv), range_argv)
+         && kgflags_int_array_get_count(&levels) == 5 && kgflags_int_array_get_item(&levels, 4) == 7);
+
+    test_kgflags_reset();
+    kgflags_int_repeatable("level", level_storage, 4, NULL, false, &levels);
+    kgflags_freeze();
+    char *huge_argv[] = { "app", "--level", "0..2000000000", "--level", "0..2000000000" };
+    TEST("Huge range total fails validate", kgflags_validate(ARRAY_SIZE(huge_argv), huge_argv, false, &result) == false
+         && result.errors_count == 1 && result.first_error.kind == KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS
+         && result.first_error.limit == INT_MAX);
+    TEST("Huge range total fails parse", kgflags_parse(ARRAY_SIZE(huge_argv), huge_argv) == false
+         && kgflags_get_error_count() == 1 && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS));
+}
+
+static void test_suite_paths() {
+    test_kgflags_reset();
+    const char *config = NULL;
+    const char *out_dir = NULL;
+    kgflags_string_array_t inputs;
+    kgflags_path("config", NULL, KGFLAGS_PATH_FILE | KGFLAGS_PATH_READABLE, NULL, true, &config);
+    kgflags_path("out-dir", "missing-default", KGFLAGS_PATH_DIRECTORY, NULL, false, &out_dir);
+    kgflags_path_array("inputs", KGFLAGS_PATH_EXISTS, NULL, false, &inputs);
+    kgflags_freeze();
+    char *argv[] = { "app", "--config", "tests.c", "--inputs", "tests.c", "output", "../kgflags.h" };
+    TEST("Existing paths", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("Defaults aren't checked", STREQ(out_dir, "missing-default") && kgflags_string_array_get_count(&inputs) == 3);
+
+    test_kgflags_reset();
+    kgflags_path("config", NULL, KGFLAGS_PATH_FILE | KGFLAGS_PATH_READABLE, NULL, true, &config);
+    kgflags_path("out-dir", NULL, KGFLAGS_PATH_DIRECTORY, NULL, false, &out_dir);
+    kgflags_path_array("inputs", KGFLAGS_PATH_EXISTS, NULL, false, &inputs);
+    kgflags_freeze();
+    char *dir_argv[] = { "app", "--config", "output", "--out-dir=tests.c" };
+    TEST("Wrong path types", kgflags_parse(ARRAY_SIZE(dir_argv), dir_argv) == false
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_PATH_NOT_FILE)
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_PATH_NOT_DIRECTORY) && config == NULL);
+
+    test_kgflags_reset();
+    kgflags_path("config", NULL, KGFLAGS_PATH_FILE | KGFLAGS_PATH_READABLE, NULL, true, &config);
+    kgflags_path_array("inputs", KGFLAGS_PATH_EXISTS, NULL, false, &inputs);
+    kgflags_freeze();
+    int calls = 0;
+    kgflags_set_parallel_for(test_reverse_parallel_for, &calls, 2);
+    char *missing_argv[] = { "app", "--config", "tests.c", "--inputs", "tests.c", "missing-1", "output", "missing-2" };
+    TEST("Missing paths", kgflags_parse(ARRAY_SIZE(missing_argv), missing_argv) == false && calls == 4
+         && kgflags_get_error_count() == 2 && kgflags_string_array_get_count(&inputs) == 0);
+    kgflags_error_info_t err;
+    kgflags_get_error(0, &err);
+    TEST("Errors by item index", err.kind == KGFLAGS_ERROR_KIND_PATH_NOT_FOUND && err.item_index == 1 && err.arg_index == 5);
+    kgflags_get_error(1, &err);
+    TEST("Errors in item order", err.item_index == 3 && STREQ(err.value, "missing-2"));
+
+    kgflags_validation_t result;
+    TEST("Validation checks paths", kgflags_validate(ARRAY_SIZE(missing_argv), missing_argv, false, &result) == false
+         && result.errors_count == 2 && result.first_error.kind == KGFLAGS_ERROR_KIND_PATH_NOT_FOUND);
+    TEST("Validation accepts existing paths", kgflags_validate(ARRAY_SIZE(argv) - 2, argv, false, &result));
+}
+
+static void test_suite_files() {
+    FILE *empty_file = fopen("output/empty.txt", "wb");
+    fclose(empty_file);
+    FILE *tests_file = fopen("tests.c", "rb");
+    fseek(tests_file, 0, SEEK_END);
+    long tests_size = ftell(tests_file);
+    fclose(tests_file);
+
+    test_kgflags_reset();
+    kgflags_file_t source;
+    kgflags_file_t empty;
+    kgflags_file_t unset;
+    kgflags_file("source", NULL, NULL, true, &source);
+    kgflags_file("empty", NULL, NULL, false, &empty);
+    kgflags_file("unset", NULL, NULL, false, &unset);
+    char *argv[] = { "app", "--source", "tests.c", "--empty=output/empty.txt" };
+    TEST("Parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("Path kept", STREQ(kgflags_file_get_path(&source), "tests.c") && kgflags_file_get_path(&unset) == NULL);
+    kgflags_bytes_t contents = kgflags_file_get_contents(&source);
+    TEST("Contents mapped", contents.data != NULL && contents.length == (size_t)tests_size
+         && memcmp(contents.data, "/*", 2) == 0);
+    TEST("Mapped once", kgflags_file_get_contents(&source).data == contents.data);
+    TEST("Empty file", kgflags_file_get_contents(&empty).data != NULL && kgflags_file_get_contents(&empty).length == 0);
+    TEST("Unset file", kgflags_file_get_contents(&unset).data == NULL);
+
+    kgflags_release_files();
+    TEST("Released", source._data == NULL && empty._data == NULL);
+    TEST("Too large files aren't preloaded", kgflags_preload_files(16) == 1 && source._data == NULL && empty._data != NULL);
+    int calls = 0;
+    kgflags_set_parallel_for(test_reverse_parallel_for, &calls, 2);
+    TEST("Preloaded in parallel", kgflags_preload_files(SIZE_MAX) == 0 && calls == 2 && source._data != NULL);
+    kgflags_file_release(&source);
+    kgflags_file_release(&empty);
+
+    test_kgflags_reset();
+    kgflags_file("source", NULL, NULL, true, &source);
+    char *dir_argv[] = { "app", "--source", "output" };
+    TEST("Directory rejected", kgflags_parse(ARRAY_SIZE(dir_argv), dir_argv) == false
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_PATH_NOT_FILE));
+    remove("output/empty.txt");
+}
+
+static void test_suite_ranges() {
+    test_kgflags_reset();
+    kgflags_int_array_t ids;
+    kgflags_double_array_t steps;
+    kgflags_int_array_t plain;
+    kgflags_int_array("ids", NULL, false, &ids);
+    kgflags_double_array("steps", NULL, false, &steps);
+    kgflags_int_array("plain", NULL, false, &plain);
+    kgflags_freeze();
+    char *argv[] = { "app", "--ids", "0..4096", "1-10,20-30", "-7", "--steps", "0:1e6:250", "0.5:1:0.25", "--plain", "1", "2" };
+    TEST("Parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("Range counts values", kgflags_int_array_get_count(&ids) == 4096 + 10 + 11 + 1);
+    TEST("Half-open range", kgflags_int_array_get_item(&ids, 0) == 0 && kgflags_int_array_get_item(&ids, 4095) == 4095);
+    TEST("Inclusive ranges", kgflags_int_array_get_item(&ids, 4096) == 1 && kgflags_int_array_get_item(&ids, 4105) == 10
+         && kgflags_int_array_get_item(&ids, 4106) == 20 && kgflags_int_array_get_item(&ids, 4116) == 30);
+    TEST("Plain item after ranges", kgflags_int_array_get_item(&ids, 4117) == -7 && kgflags_int_array_get_item(&ids, 4118) == 0);
+    TEST("Stepped double range", kgflags_double_array_get_count(&steps) == 4000 + 2
+         && DBLEQ(kgflags_double_array_get_item(&steps, 3999), 999750.0) && DBLEQ(kgflags_double_array_get_item(&steps, 4001), 0.75));
+    TEST("Plain array", kgflags_int_array_get_count(&plain) == 2 && kgflags_int_array_get_item(&plain, 1) == 2);
+
+    int values[8];
+    TEST("Fill across items", kgflags_int_array_fill(&ids, 4093, values, 8) == 8 && values[0] == 4093 && values[2] == 4095
+         && values[3] == 1 && values[7] == 5);
+    TEST("Fill stops at end", kgflags_int_array_fill(&ids, 4116, values, 8) == 2 && values[0] == 30 && values[1] == -7);
+    TEST("Fill plain array", kgflags_int_array_fill(&plain, 0, values, 8) == 2 && values[0] == 1);
+    double doubles[4];
+    TEST("Fill doubles", kgflags_double_array_fill(&steps, 3998, doubles, 4) == 4 && DBLEQ(doubles[1], 999750.0)
+         && DBLEQ(doubles[2], 0.5));
+
+    kgflags_validation_t result;
+    TEST("Validates like parse", kgflags_validate(ARRAY_SIZE(argv), argv, false, &result) && result.errors_count == 0);
+
+    static kgflags_snapshot_t snapshot;
+    TEST("Reload", kgflags_reload(ARRAY_SIZE(argv), argv, &snapshot));
+    const kgflags_int_array_t *snapshot_ids = kgflags_snapshot_get_int_array(&snapshot, kgflags_get_flag_id("ids"));
+    TEST("Snapshot ranges", kgflags_int_array_get_count(snapshot_ids) == 4118 && kgflags_int_array_get_item(snapshot_ids, 4106) == 20
+         && kgflags_int_array_get_item(snapshot_ids, 4117) == -7 && snapshot_ids->_terms != NULL);
+
+    uint64_t image[256];
+    size_t size = kgflags_image_write(image, sizeof(image));
+    test_kgflags_reset();
+    kgflags_int_array("ids", NULL, false, &ids);
+    kgflags_double_array("steps", NULL, false, &steps);
+    kgflags_int_array("plain", NULL, false, &plain);
+    char *items[8];
+    TEST("Ranges kept in image", kgflags_image_attach(image, size, items, 8) && kgflags_int_array_get_count(&ids) == 4118
+         && kgflags_int_array_get_item(&ids, 4106) == 20 && kgflags_int_array_get_count(&plain) == 2 && ids._terms != NULL);
+
+    // Empty terms and arrays with more terms than KGFLAGS_MAX_RANGE_TERMS, which are walked instead of indexed.
+    static char many_items[KGFLAGS_MAX_RANGE_TERMS / 2 + 1][32];
+    char *many_argv[KGFLAGS_MAX_RANGE_TERMS / 2 + 6] = { "app", "--plain", "3..3,7", "0..2", "--ids" };
+    for (int i = 0; i < KGFLAGS_MAX_RANGE_TERMS / 2 + 1; i++) {
+        sprintf(many_items[i], "%d..%d,%d", i * 3, i * 3 + 2, -i);
+        many_argv[i + 5] = many_items[i];
+    }
+    test_kgflags_reset();
+    kgflags_int_array("ids", NULL, false, &ids);
+    kgflags_int_array("plain", NULL, false, &plain);
+    kgflags_freeze();
+    for (int pass = 0; pass < 2; pass++) {
+        int many_argc = pass == 0 ? 5 + KGFLAGS_MAX_RANGE_TERMS / 4 : ARRAY_SIZE(many_argv);
+        TEST("Parse many terms", kgflags_parse(many_argc, many_argv) && kgflags_int_array_get_count(&ids) == (many_argc - 5) * 3);
+        TEST("Empty term skipped", kgflags_int_array_get_count(&plain) == 3 && kgflags_int_array_get_item(&plain, 0) == 7
+             && kgflags_int_array_get_item(&plain, 2) == 1);
+        bool items_ok = true;
+        for (int i = 0; i < many_argc - 5; i++) {
+            items_ok = items_ok && kgflags_int_array_get_item(&ids, i * 3) == i * 3 && kgflags_int_array_get_item(&ids, i * 3 + 1) == i * 3 + 1
+                && kgflags_int_array_get_item(&ids, i * 3 + 2) == -i;
+        }
+        TEST(pass == 0 ? "Indexed items" : "Walked items", items_ok && (ids._terms != NULL) == (pass == 0) && plain._terms != NULL);
+        TEST("Fill from the middle", kgflags_int_array_fill(&ids, 4, values, 8) == 8 && values[0] == 4 && values[1] == -1
+             && values[2] == 6 && values[6] == 10 && values[7] == -3);
+        kgflags_reset_values();
+    }
+
+    test_kgflags_reset();
+    kgflags_int_array("ids", NULL, false, &ids);
+    kgflags_double_array("steps", NULL, false, &steps);
+    kgflags_freeze();
+    char *invalid_argv[] = { "app", "--ids", "1..", "0:10:0", "5-1", "1.5..3", "1,,2", "--steps", "0..inf" };
+    TEST("Parse fails", kgflags_parse(ARRAY_SIZE(invalid_argv), invalid_argv) == false);
+    TEST("Invalid expressions", kgflags_get_error_count() == 6 && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_INT)
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_DOUBLE));
+    TEST("Validate finds the same errors", kgflags_validate(ARRAY_SIZE(invalid_argv), invalid_argv, false, &result) == false
+         && result.errors_count == 6);
+
+    test_kgflags_reset();
+    kgflags_int_array("ids", NULL, false, &ids);
+    kgflags_freeze();
+    char *huge_argv[] = { "app", "--ids", "0..2000000000", "0..2000000000" };
+    TEST("Too many values", kgflags_parse(ARRAY_SIZE(huge_argv), huge_argv) == false
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS));
+}
+
+static void test_suite_custom() {
+    test_kgflags_reset();
+    int ipv4 = kgflags_register_custom_kind("IPv4 address", sizeof(kgflags_ipv4_t), kgflags_parse_ipv4, NULL);
+    int ipv6 = kgflags_register_custom_kind("IPv6 address", sizeof(kgflags_ipv6_t), kgflags_parse_ipv6, NULL);
+    int cidr = kgflags_register_custom_kind("CIDR block", sizeof(kgflags_cidr_t), kgflags_parse_cidr, NULL);
+    kgflags_ipv4_t bind;
+    memset(&bind, 0, sizeof(bind));
+    kgflags_ipv6_t peer;
+    kgflags_cidr_t allow_storage[4];
+    kgflags_custom_list_t allow;
+    kgflags_custom("bind", ipv4, NULL, true, &bind);
+    kgflags_custom("peer", ipv6, NULL, false, &peer);
+    kgflags_custom_list("allow", cidr, ',', allow_storage, 4, NULL, false, &allow);
+    kgflags_freeze();
+    char *argv[] = { "app", "--bind", "10.0.255.1", "--peer=2001:db8::ffff:192.0.2.1", "--allow", "10.0.0.0/8,fe80::/10" };
+    TEST("Parse", kgflags_parse(ARRAY_SIZE(argv), argv));
+    TEST("IPv4 parsed into caller's storage", bind.bytes[0] == 10 && bind.bytes[2] == 255 && bind.bytes[3] == 1);
+    static const uint8_t expected_peer[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 192, 0, 2, 1 };
+    TEST("IPv6 with embedded IPv4", memcmp(peer.bytes, expected_peer, 16) == 0);
+    const kgflags_cidr_t *blocks = (const kgflags_cidr_t*)kgflags_custom_list_get_items(&allow);
+    TEST("List is a contiguous array", kgflags_custom_list_get_count(&allow) == 2 && blocks == allow_storage
+         && !blocks[0].ipv6 && blocks[0].prefix_length == 8 && blocks[1].ipv6 && blocks[1].bytes[0] == 0xfe
+         && blocks[1].bytes[1] == 0x80 && blocks[1].prefix_length == 10);
+
+    kgflags_validation_t result;
+    TEST("Validates like parse", kgflags_validate(ARRAY_SIZE(argv), argv, false, &result) && result.errors_count == 0);
+    char buf[256];
+    char *out_argv[8];
+    int out_argc = ARRAY_SIZE(out_argv);
+    kgflags_serialize_argv(buf, sizeof(buf), out_argv, &out_argc);
+    TEST("Serialized from arguments", out_argc == 4 && STREQ(out_argv[1], "--bind=10.0.255.1")
+         && STREQ(out_argv[3], "--allow=10.0.0.0/8,fe80::/10"));
+    kgflags_dump(buf, sizeof(buf), KGFLAGS_DUMP_FORMAT_KEY_VALUE);
+    TEST("Dumped as arguments", strstr(buf, "argv bind=10.0.255.1") != NULL);
+
+    uint64_t image[128];
+    size_t size = kgflags_image_write(image, sizeof(image));
+    memset(&bind, 0, sizeof(bind));
+    memset(allow_storage, 0, sizeof(allow_storage));
+    kgflags_reset_values();
+    TEST("Reset", kgflags_custom_list_get_count(&allow) == 0);
+    TEST("Attach image", kgflags_image_attach(image, size, NULL, 0) && bind.bytes[3] == 1
+         && kgflags_custom_list_get_count(&allow) == 2
+         && ((const kgflags_cidr_t*)kgflags_custom_list_get_items(&allow))[1].prefix_length == 10);
+
+    const char *valid[] = { "0.0.0.0", "255.255.255.255", "::", "::1", "1::", "1:2:3:4:5:6:7:8", "1:2:3:4:5:6::8", "::ffff:1.2.3.4" };
+    const char *invalid[] = { "", "1.2.3", "1.2.3.4.5", "256.1.1.1", "01.2.3.4", "1.2.3.4 ", ":", ":::", "1:2", "1::2::3",
+                              "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7::8", "12345::", "1:", "g::", "::1.2.3" };
+    bool all_valid = true;
+    for (int i = 0; i < (int)ARRAY_SIZE(valid); i++) {
+        bool v6 = strchr(valid[i], ':') != NULL;
+        all_valid = all_valid && (v6 ? kgflags_parse_ipv6(valid[i], strlen(valid[i]), NULL, NULL)
+                                     : kgflags_parse_ipv4(valid[i], strlen(valid[i]), NULL, NULL));
+    }
+    TEST("Valid addresses", all_valid);
+    bool any_invalid = false;
+    for (int i = 0; i < (int)ARRAY_SIZE(invalid); i++) {
+        bool v6 = strchr(invalid[i], ':') != NULL;
+        any_invalid = any_invalid || (v6 ? kgflags_parse_ipv6(invalid[i], strlen(invalid[i]), NULL, NULL)
+                                          : kgflags_parse_ipv4(invalid[i], strlen(invalid[i]), NULL, NULL));
+    }
+    TEST("Invalid addresses rejected", !any_invalid);
+    TEST("Prefix length checked", kgflags_parse_cidr("10.0.0.0/32", 11, NULL, NULL) && !kgflags_parse_cidr("10.0.0.0/33", 11, NULL, NULL)
+         && kgflags_parse_cidr("::/128", 6, NULL, NULL) && !kgflags_parse_cidr("::/129", 6, NULL, NULL)
+         && !kgflags_parse_cidr("10.0.0.0", 8, NULL, NULL) && !kgflags_parse_cidr("10.0.0.0/", 9, NULL, NULL));
+
+    test_kgflags_reset();
+    ipv4 = kgflags_register_custom_kind("IPv4 address", sizeof(kgflags_ipv4_t), kgflags_parse_ipv4, NULL);
+    cidr = kgflags_register_custom_kind("CIDR block", sizeof(kgflags_cidr_t), kgflags_parse_cidr, NULL);
+    bind.bytes[0] = 127;
+    kgflags_custom("bind", ipv4, NULL, false, &bind);
+    kgflags_custom_list("allow", cidr, ',', allow_storage, 1, NULL, false, &allow);
+    kgflags_custom("unknown", 7, NULL, false, &bind);
+    TEST("Unregistered kind", kgflags_get_error_count() == 1 && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE));
+    test_kgflags_reset();
+    ipv4 = kgflags_register_custom_kind("IPv4 address", sizeof(kgflags_ipv4_t), kgflags_parse_ipv4, NULL);
+    cidr = kgflags_register_custom_kind("CIDR block", sizeof(kgflags_cidr_t), kgflags_parse_cidr, NULL);
+    kgflags_custom("bind", ipv4, NULL, false, &bind);
+    kgflags_custom_list("allow", cidr, ',', allow_storage, 1, NULL, false, &allow);
+    kgflags_freeze();
+    char *invalid_argv[] = { "app", "--bind", "10.0.0.256", "--allow", "10.0.0.0/8,10.1.0.0/16" };
+    TEST("Parse fails", kgflags_parse(ARRAY_SIZE(invalid_argv), invalid_argv) == false);
+    kgflags_error_info_t err;
+    kgflags_get_error(0, &err);
+    TEST("Invalid value reported", err.kind == KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE && STREQ(err.value, "10.0.0.256")
+         && err.item_index == -1 && bind.bytes[0] == 127);
+    TEST("Too many values", test_kgflags_contains_error(KGFLAGS_ERROR_KIND_TOO_MANY_LIST_ITEMS));
+    TEST("Validate finds the same errors", kgflags_validate(ARRAY_SIZE(invalid_argv), invalid_argv, false, &result) == false
+         && result.errors_count == 2);
+    char *empty_argv[] = { "app", "--bind=" };
+    TEST("Empty single value is invalid", kgflags_parse(ARRAY_SIZE(empty_argv), empty_argv) == false
+         && test_kgflags_contains_error(KGFLAGS_ERROR_KIND_INVALID_CUSTOM_VALUE));
+    int kinds_count = 2;
+    while (kgflags_register_custom_kind("x", 1, kgflags_parse_ipv4, NULL) >= 0) {
+        kinds_count++;
+    }
+    TEST("Too many kinds", kinds_count == KGFLAGS_MAX_CUSTOM_KINDS);
+}
+
+static bool test_kgflags_contains_error(kgflags_error_kind_t kind) {
+    for (int i = 0; i < kgflags_get_error_count(); i++) {
+        kgflags_error_info_t err;
+        kgflags_get_error(i, &err);
+        if (err.kind == kind) {
             return true;
         }
     }
     return false;
 }
 
+static void test_reverse_parallel_for(int count, void (*job)(void *job_ctx, int index), void *job_ctx, void *user_ctx) {
+    int *calls = (int*)user_ctx;
+    for (int i = count - 1; i >= 0; i--) {
+        job(job_ctx, i);
+        (*calls)++;
+    }
+}
+
+// "--inner-pattern" takes one value, everything else takes none.
+static int test_pass_through_arity(const char *flag_arg, void *ctx) {
+    int *calls = (int*)ctx;
+    (*calls)++;
+    return strcmp(flag_arg, "--inner-pattern") == 0 ? 1 : 0;
+}
+
+static void test_declare_image_flags(test_image_flags_t *flags) {
+    static const char *modes[] = { "a", "b" };
+    memset(flags, 0, sizeof(test_image_flags_t));
+    kgflags_string("name", NULL, NULL, true, &flags->name);
+    kgflags_bool("verbose", false, NULL, false, &flags->verbose);
+    kgflags_double("ratio", 0.5, NULL, false, &flags->ratio);
+    kgflags_size("cache", 0, NULL, false, &flags->cache);
+    kgflags_choice("mode", modes, 2, 0, NULL, false, &flags->mode);
+    kgflags_string_array("files", NULL, false, &flags->files);
+    kgflags_int_array("ids", NULL, false, &flags->ids);
+    kgflags_int_list("weights", ',', flags->weights_storage, 8, NULL, false, &flags->weights);
+    kgflags_string_list("tags", ',', flags->tags_storage, 8, NULL, false, &flags->tags);
+}
+
 static void test_kgflags_reset() {
     memset(&_kgflags_g, 0, sizeof(_kgflags_g));
+    _kgflags_g.specs_registered = true; // specs defined above are only used by test_suite_section_registration
 }